@@ -0,0 +1,71 @@
+// sudo LD_LIBRARY_PATH=/home/pi/Documents/MANET-Testbed:$LD_LIBRARY_PATH ./bench_batch.out [interface]
+//
+// Compares installing 10000 host routes one request at a time (AddUnicastRoutingEntry) with
+// ApplyRouteBatch. The routes go into table 100, which is flushed after each run, so the main
+// table is left alone. Must be run as root on a node with the interface up.
+#include "manet_testbed.h"
+
+#define BENCH_ROUTES 10000
+
+static struct route_op ops[BENCH_ROUTES];
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint32_t dest(uint32_t i) // 172.31.x.y host routes
+{
+	return htonl(0xac1f0000 | (i + 1));
+}
+
+int main(int argc, char **argv)
+{
+	char *name = (argc > 1) ? argv[1] : "wlan0";
+	uint32_t i, failed = 0;
+	if(SetInterface((uint8_t *)name) < 0 || InitializeAPI() < 0) {
+		printf("could not initialize the testbed on %s\n", name);
+		return 1;
+	}
+	if(SwitchRoutingTable((uint8_t *)"100") < 0) {
+		printf("could not switch to table 100\n");
+		return 1;
+	}
+	FlushRoutingTable();
+
+	// any address in the interface's subnet is a valid gateway for the kernel
+	uint32_t gateway = htonl(ntohl(GetInterfaceIP((uint8_t *)name, 0)) ^ 1);
+
+	double start = now();
+	for(i = 0; i < BENCH_ROUTES; i++) {
+		if(AddUnicastRoutingEntry(dest(i), gateway) < 0)
+			failed++;
+	}
+	double single = now() - start;
+	FlushRoutingTable();
+	printf("AddUnicastRoutingEntry: %5u routes in %.3f s, %9.0f routes/s (%u failed)\n",
+		BENCH_ROUTES, single, BENCH_ROUTES / single, failed);
+
+	for(i = 0; i < BENCH_ROUTES; i++) {
+		ops[i].action = ROUTE_ADD;
+		ops[i].dest = dest(i);
+		ops[i].next_hop = gateway;
+	}
+	failed = 0;
+	start = now();
+	ApplyRouteBatch(ops, BENCH_ROUTES);
+	double batch = now() - start;
+	for(i = 0; i < BENCH_ROUTES; i++) {
+		if(ops[i].error != 0)
+			failed++;
+	}
+	FlushRoutingTable();
+	printf("ApplyRouteBatch:        %5u routes in %.3f s, %9.0f routes/s (%u failed)\n",
+		BENCH_ROUTES, batch, BENCH_ROUTES / batch, failed);
+	printf("speedup: %.1fx\n", single / batch);
+
+	SwitchRoutingTable((uint8_t *)"main");
+	return 0;
+}
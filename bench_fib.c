@@ -0,0 +1,109 @@
+// ./bench_fib.out [reader threads] [seconds]
+// LD_LIBRARY_PATH=/home/pi/Documents/MANET-Testbed:$LD_LIBRARY_PATH ./bench_fib.out 4 5
+//
+// Measures SearchTable (the userspace route mirror) lookups per second while a writer
+// replaces 1000 routes per second, and without the writer for comparison. Only the mirror
+// is used, so no root or kernel routes are needed.
+#include "manet_testbed.h"
+#include "head/api.h"
+#include "head/api_fib.h"
+
+#define BENCH_ROUTES 1000 // routes in the mirror while measuring
+#define CHURN_RATE 1000 // routes replaced per second by the writer
+
+static volatile int running = 1;
+static volatile int churning = 0;
+
+static uint32_t host(uint32_t i) // 10.1.x.y host routes
+{
+	return htonl(0x0a010000 | (i & 0xffff));
+}
+
+static void *reader(void *arg)
+{
+	uint64_t *count = arg;
+	uint32_t seed = (uint32_t)(uintptr_t)arg;
+	uint32_t next_hop;
+	while(running) {
+		int i;
+		for(i = 0; i < 1024; i++) {
+			seed = seed * 1103515245 + 12345;
+			SearchTable(host(seed >> 16), &next_hop); // half hit a host route, the rest the /16 or default
+		}
+		*count += 1024;
+	}
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	uint64_t *count = arg;
+	uint32_t i = 0;
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while(running) {
+		if(churning) { // drop the oldest host route and add a new one
+			fib_remove(host(i * 2), 32, FIB_ORIGIN_API);
+			fib_insert(host((i + BENCH_ROUTES) * 2), 32, htonl(0x0a000001), 1, FIB_ORIGIN_API);
+			i++;
+			(*count)++;
+		}
+		next.tv_nsec += 1000000000L / CHURN_RATE;
+		if(next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	return NULL;
+}
+
+static double run(int threads, int seconds, int churn, uint64_t *counts)
+{
+	pthread_t t[64];
+	int i;
+	uint64_t total = 0;
+	memset(counts, 0, 64 * 8 * sizeof(uint64_t));
+	running = 1;
+	churning = churn;
+	for(i = 0; i < threads; i++)
+		pthread_create(&t[i], NULL, reader, &counts[i * 8]); // a cache line each
+	sleep(seconds);
+	running = 0;
+	for(i = 0; i < threads; i++) {
+		pthread_join(t[i], NULL);
+		total += counts[i * 8];
+	}
+	return (double)total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = (argc > 1) ? atoi(argv[1]) : 1;
+	int seconds = (argc > 2) ? atoi(argv[2]) : 3;
+	static uint64_t counts[64 * 8];
+	uint64_t writes = 0;
+	uint32_t i;
+	if(threads < 1 || threads > 64 || seconds < 1)
+		return 1;
+
+	InitializeFib();
+	for(i = 0; i < BENCH_ROUTES; i++)
+		fib_insert(host(i * 2), 32, htonl(0x0a000001), 1, FIB_ORIGIN_API);
+	fib_insert(htonl(0x0a010000), 16, htonl(0x0a000002), 1, FIB_ORIGIN_KERNEL);
+	fib_insert(0, 0, htonl(0x0a000003), 1, FIB_ORIGIN_KERNEL);
+
+	double idle = run(threads, seconds, 0, counts);
+
+	pthread_t w;
+	running = 1;
+	pthread_create(&w, NULL, writer, &writes);
+	double busy = run(threads, seconds, 1, counts);
+	running = 0;
+	pthread_join(w, NULL);
+
+	printf("%d reader thread(s), %u routes\n", threads, BENCH_ROUTES + 2);
+	printf("no writer:            %12.0f lookups/s\n", idle);
+	printf("%5.0f routes/s churn: %12.0f lookups/s\n", (double)writes / seconds, busy);
+	return 0;
+}
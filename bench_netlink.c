@@ -0,0 +1,123 @@
+// sudo LD_LIBRARY_PATH=/home/pi/Documents/MANET-Testbed:$LD_LIBRARY_PATH ./bench_netlink.out [interface] [seconds]
+//
+// Netlink contention benchmark: 1 and then 4 threads mix route updates (AddUnicastRoutingEntry
+// and DeleteEntry of their own host routes) with address queries (an RTM_GETADDR dump), each
+// on its own netlink socket. Prints operations per second and the mean and worst latency of
+// each kind. The routes go into table 100, which is flushed at the end. Must be run as root.
+#include "manet_testbed.h"
+
+#define BENCH_THREADS 4
+#define QUERY_EVERY 4 // one query per 3 route updates
+
+int if_cache_load(); // libtestbed helper: one RTM_GETADDR dump on the calling thread's netlink socket
+
+struct bench_stats{
+  int      id;
+  uint64_t updates, queries, failed;
+  double   update_time, query_time; // seconds spent in each kind
+  double   update_max, query_max;
+  char     pad[64];
+};
+
+static volatile int running;
+static uint32_t gateway;
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg)
+{
+	struct bench_stats *s = arg;
+	uint64_t k;
+	for(k = 0; running; k++) {
+		uint32_t dest = htonl(0xac1e0000 | (s->id << 8) | (k / 2 % 250 + 1)); // 172.30.id.x
+		double start = now(), t;
+		int r;
+		if(k % QUERY_EVERY == QUERY_EVERY - 1) {
+			r = if_cache_load();
+			t = now() - start;
+			s->queries++;
+			s->query_time += t;
+			if(t > s->query_max)
+				s->query_max = t;
+		}
+		else {
+			r = (k % 2 == 0) ? AddUnicastRoutingEntry(dest, gateway) : DeleteEntry(dest, gateway);
+			t = now() - start;
+			s->updates++;
+			s->update_time += t;
+			if(t > s->update_max)
+				s->update_max = t;
+		}
+		if(r < 0)
+			s->failed++;
+	}
+	return NULL;
+}
+
+static void run(int threads, int seconds)
+{
+	static struct bench_stats stats[BENCH_THREADS];
+	pthread_t t[BENCH_THREADS];
+	struct bench_stats sum;
+	int i;
+	memset(stats, 0, sizeof(stats));
+	memset(&sum, 0, sizeof(sum));
+	running = 1;
+	for(i = 0; i < threads; i++) {
+		stats[i].id = i;
+		pthread_create(&t[i], NULL, worker, &stats[i]);
+	}
+	sleep(seconds);
+	running = 0;
+	for(i = 0; i < threads; i++) {
+		pthread_join(t[i], NULL);
+		sum.updates += stats[i].updates;
+		sum.queries += stats[i].queries;
+		sum.failed += stats[i].failed;
+		sum.update_time += stats[i].update_time;
+		sum.query_time += stats[i].query_time;
+		if(stats[i].update_max > sum.update_max)
+			sum.update_max = stats[i].update_max;
+		if(stats[i].query_max > sum.query_max)
+			sum.query_max = stats[i].query_max;
+	}
+	FlushRoutingTable();
+
+	printf("%d thread(s): %9.0f ops/s (%lu failed)\n", threads,
+		(double)(sum.updates + sum.queries) / seconds, (unsigned long)sum.failed);
+	printf("  route updates: %9.0f /s, mean %7.1f us, max %8.1f us\n", (double)sum.updates / seconds,
+		sum.updates ? sum.update_time / sum.updates * 1e6 : 0, sum.update_max * 1e6);
+	printf("  queries:       %9.0f /s, mean %7.1f us, max %8.1f us\n", (double)sum.queries / seconds,
+		sum.queries ? sum.query_time / sum.queries * 1e6 : 0, sum.query_max * 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	char *name = (argc > 1) ? argv[1] : "wlan0";
+	int seconds = (argc > 2) ? atoi(argv[2]) : 3;
+	if(seconds < 1)
+		return 1;
+	if(SetInterface((uint8_t *)name) < 0 || InitializeAPI() < 0) {
+		printf("could not initialize the testbed on %s\n", name);
+		return 1;
+	}
+	if(SwitchRoutingTable((uint8_t *)"100") < 0) {
+		printf("could not switch to table 100\n");
+		return 1;
+	}
+	FlushRoutingTable();
+
+	// any address in the interface's subnet is a valid gateway for the kernel
+	gateway = htonl(ntohl(GetInterfaceIP((uint8_t *)name, 0)) ^ 1);
+
+	run(1, seconds);
+	run(BENCH_THREADS, seconds);
+
+	SwitchRoutingTable((uint8_t *)"main");
+	return 0;
+}
@@ -0,0 +1,164 @@
+// sudo LD_LIBRARY_PATH=/home/pi/Documents/MANET-Testbed:$LD_LIBRARY_PATH ./bench_qsched.out [seconds] [cpu] > /dev/null
+//
+// Queue scheduling benchmark: how long an incoming control message waits for its callback while
+// the incoming data queue is saturated, first with every queue thread at the default priority and
+// then with SetQueueScheduling (SCHED_FIFO for QUEUE_IN_CONTROL, niceness 19 for QUEUE_IN_DATA).
+// Two namespaces joined by a veth pair are created: a sender floods UDP data at the node and sends
+// a timestamped control message every 10 ms, and the node's data callback spends DATA_WORK_US on
+// each packet. All queue threads are pinned to one CPU so they compete for it. Prints the mean,
+// 99th percentile and worst control latency, and the control messages lost. Must be run as root.
+// The queue threads print every packet, so results go to stderr.
+#define _GNU_SOURCE // setns
+#include <sched.h>
+#include <fcntl.h>
+#include "manet_testbed.h"
+
+#define PROBE_INTERVAL 10000 // us between control messages
+#define MAX_PROBES 100000
+#define DATA_WORK_US 50 // time the data callback spends on each packet
+
+struct probe{ // payload of a control message
+  uint32_t phase;
+  uint32_t seq;
+  double   sent;
+};
+
+static volatile uint32_t phase = 0;
+static volatile int flooding;
+static double latency[MAX_PROBES];
+static volatile uint32_t received = 0;
+static int data_fd, control_fd;
+static struct sockaddr_in data_addr, control_addr;
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// runs on the control queue thread only, so no lock is needed
+static uint8_t control_cb(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info)
+{
+	struct probe p;
+	if(payload_length < sizeof(p))
+		return PACKET_DROP;
+	memcpy(&p, payload, sizeof(p));
+	if(p.phase == phase && received < MAX_PROBES) // late probes of the last phase are not counted
+		latency[received++] = now() - p.sent;
+	return PACKET_DROP;
+}
+
+static uint8_t data_cb(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info)
+{
+	double end = now() + DATA_WORK_US / 1e6; // stands in for inspection or encryption
+	while(now() < end)
+		;
+	return PACKET_DROP;
+}
+
+static void *flood(void *arg)
+{
+	uint8_t buf[64] = {0};
+	while(flooding)
+		sendto(data_fd, buf, sizeof(buf), 0, (struct sockaddr *)&data_addr, sizeof(data_addr));
+	return NULL;
+}
+
+// send probes for the given time with or without the data flood, and print their latency
+static void run(const char *name, int seconds, int loaded)
+{
+	pthread_t t;
+	uint32_t sent = 0;
+	phase++;
+	received = 0;
+	flooding = loaded;
+	if(loaded)
+		pthread_create(&t, NULL, flood, NULL);
+	usleep(200000); // let the data queue fill up
+
+	double end = now() + seconds;
+	while(now() < end) {
+		struct probe p = { phase, sent++, now() };
+		sendto(control_fd, &p, sizeof(p), 0, (struct sockaddr *)&control_addr, sizeof(control_addr));
+		usleep(PROBE_INTERVAL);
+	}
+	usleep(200000); // last probes
+	flooding = 0;
+	if(loaded)
+		pthread_join(t, NULL);
+
+	uint32_t n = received, i;
+	double sum = 0;
+	for(i = 0; i < n; i++)
+		sum += latency[i];
+	qsort(latency, n, sizeof(double), cmp);
+	if(n == 0) {
+		fprintf(stderr, "%-28s no control messages received (%u sent)\n", name, sent);
+		return;
+	}
+	fprintf(stderr, "%-28s mean %8.1f us   p99 %8.1f us   max %8.1f us   lost %u of %u\n", name,
+		sum / n * 1e6, latency[n * 99 / 100] * 1e6, latency[n - 1] * 1e6, sent - n, sent);
+}
+
+int main(int argc, char **argv)
+{
+	int seconds = (argc > 1) ? atoi(argv[1]) : 5;
+	int cpu = (argc > 2) ? atoi(argv[2]) : 0;
+	if(seconds < 1 || cpu < 0 || cpu >= sysconf(_SC_NPROCESSORS_CONF))
+		return 1;
+
+	// sender 192.168.1.101 in bqs_tx, node 192.168.1.2 in bqs_rx (inside the testbed's data range)
+	system("ip netns add bqs_rx; ip netns add bqs_tx;"
+	       "ip link add bqs0 netns bqs_rx type veth peer name bqs1 netns bqs_tx;"
+	       "ip -n bqs_rx addr add 192.168.1.2/24 dev bqs0; ip -n bqs_rx link set bqs0 up;"
+	       "ip -n bqs_tx addr add 192.168.1.101/24 dev bqs1; ip -n bqs_tx link set bqs1 up");
+
+	// open the sender's sockets in its namespace, then come back
+	int self = open("/proc/self/ns/net", O_RDONLY);
+	int tx = open("/var/run/netns/bqs_tx", O_RDONLY);
+	if(self < 0 || tx < 0 || setns(tx, CLONE_NEWNET) < 0) {
+		fprintf(stderr, "could not create the namespaces\n");
+		return 1;
+	}
+	data_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	control_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	setns(self, CLONE_NEWNET);
+	close(self);
+	close(tx);
+	data_addr.sin_family = control_addr.sin_family = AF_INET;
+	data_addr.sin_addr.s_addr = control_addr.sin_addr.s_addr = inet_addr("192.168.1.2");
+	data_addr.sin_port = htons(9);
+	control_addr.sin_port = htons(269);
+
+	TestbedHandle node = CreateTestbed((uint8_t *)"bqs_rx");
+	if(node == NULL || UseTestbed(node) < 0 || SetInterface((uint8_t *)"bqs0") < 0 || InitializeAPI() < 0) {
+		fprintf(stderr, "could not initialize the testbed in bqs_rx\n");
+		system("ip netns del bqs_rx; ip netns del bqs_tx");
+		return 1;
+	}
+
+	struct queue_sched same = { 0, 0, cpu };
+	SetQueueScheduling(QUEUE_IN_CONTROL, &same);
+	SetQueueScheduling(QUEUE_IN_DATA, &same);
+	RegisterIncomingCallback(control_cb, data_cb);
+
+	fprintf(stderr, "control latency, %d s per run, queue threads on CPU %d, %d us per data packet\n", seconds, cpu, DATA_WORK_US);
+	run("idle", seconds, 0);
+	run("data flood, default", seconds, 1);
+
+	struct queue_sched control = { 50, 0, cpu }, data = { 0, 19, cpu };
+	if(SetQueueScheduling(QUEUE_IN_CONTROL, &control) < 0 || SetQueueScheduling(QUEUE_IN_DATA, &data) < 0)
+		fprintf(stderr, "SetQueueScheduling failed\n");
+	run("data flood, SetQueueScheduling", seconds, 1);
+
+	DestroyTestbed(node);
+	system("ip netns del bqs_rx; ip netns del bqs_tx");
+	return 0;
+}
@@ -0,0 +1,97 @@
+// ./bench_timer.out [timers]
+// LD_LIBRARY_PATH=/home/pi/Documents/MANET-Testbed:$LD_LIBRARY_PATH ./bench_timer.out 100000
+//
+// Timing wheel benchmark: the cost of StartTimer, RestartTimer and StopTimer with 100000 timers
+// active, and how late the callbacks of 100000 timers expiring within one second run. Only the
+// timer service is started, so no root is needed.
+#include "manet_testbed.h"
+
+#define MAX_TIMERS 100000
+
+int InitializeTimer(); // libtestbed helper: starts the timing wheel and its thread
+
+static int ids[MAX_TIMERS];
+static struct timespec due[MAX_TIMERS];
+static volatile uint32_t fired = 0;
+static double late_sum = 0, late_max = 0;
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void never(void *arg)
+{
+}
+
+static void expired(void *arg) // runs on the timer thread only, so no lock is needed
+{
+	struct timespec *d = arg;
+	double late = now() - (d->tv_sec + d->tv_nsec / 1e9);
+	late_sum += late;
+	if(late > late_max)
+		late_max = late;
+	fired++;
+}
+
+static void after(struct timespec *t, uint32_t ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, t);
+	t->tv_sec += ms / 1000;
+	t->tv_nsec += (ms % 1000) * 1000000L;
+	if(t->tv_nsec >= 1000000000L) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000L;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int n = (argc > 1) ? atoi(argv[1]) : MAX_TIMERS;
+	uint32_t seed = 1;
+	int i;
+	if(n < 1 || n > MAX_TIMERS || InitializeTimer() < 0)
+		return 1;
+
+	// operations on a full wheel (delays up to 10 minutes, so none fire meanwhile)
+	double start = now();
+	for(i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		ids[i] = StartTimer(1000 + (seed >> 8) % 600000, 0, never, NULL);
+	}
+	double t_start = now() - start;
+
+	start = now();
+	for(i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		RestartTimer(ids[i], 1000 + (seed >> 8) % 600000);
+	}
+	double t_restart = now() - start;
+
+	start = now();
+	for(i = 0; i < n; i++)
+		StopTimer(ids[i]);
+	double t_stop = now() - start;
+
+	printf("%d timers\n", n);
+	printf("StartTimer:   %7.1f ns/op\n", t_start / n * 1e9);
+	printf("RestartTimer: %7.1f ns/op\n", t_restart / n * 1e9);
+	printf("StopTimer:    %7.1f ns/op\n", t_stop / n * 1e9);
+
+	// expiry: every timer fires within the next second
+	for(i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t delay = 1 + (seed >> 8) % 1000;
+		after(&due[i], delay);
+		StartTimer(delay, 0, expired, &due[i]);
+	}
+	start = now();
+	while(fired < (uint32_t)n && now() - start < 5)
+		usleep(10000);
+
+	printf("fired %u of %d, late by %.3f ms on average, %.3f ms at most\n", fired, n,
+		fired ? late_sum / fired * 1e3 : 0, late_max * 1e3);
+	return 0;
+}
@@ -3,7 +3,7 @@
 
 /*
 Andre Koka - Created 10/27/2023
-             Last Updated: 11/9/2023
+             Last Updated: 10/19/2026
 
 Internal header file for MANET Testbed. Includes:
 - global variables that are used between api source files
@@ -17,6 +17,8 @@ Internal header file for MANET Testbed. Includes:
 //          - look into queueing based on destination
 
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>          // num_ifaces is read without a lock
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -32,6 +34,9 @@ Internal header file for MANET Testbed. Includes:
 #include <libnetfilter_queue/libnetfilter_queue.h>
 
 #define BUFLEN		4096
+#define MAX_INTERFACES	4 // max radios used by the testbed at once
+#define DEFAULT_INTERFACE "wlan0" // used if SetInterface is not called before InitializeAPI
+#define NODE_MAX_THREADS 32 // threads the API can start for one node
 
 #define for_each_nlmsg(n, buf, len)					\
 	for (n = (struct nlmsghdr*)buf;					\
@@ -41,18 +46,186 @@ Internal header file for MANET Testbed. Includes:
 #define for_each_rattr(n, buf, len)					\
 	for (n = (struct rtattr*)buf; RTA_OK(n, len); n = RTA_NEXT(n, len))
 
-// global variables
-extern int fd; // netlink socket
-extern int f_err;
-extern uint32_t local_ip; // node's ipv4 addr on wlan0
-extern uint32_t broadcast_ip; // node's broadcast addr for current network
-pthread_mutex_t lock; // providing thread safety
+struct testbed_if{ // one interface (radio) used by the testbed
+  char     name[IF_NAMESIZE];
+  int      index; // kernel ifindex
+  uint32_t local_ip;
+  uint32_t broadcast_ip;
+  uint8_t  prefix_len; // subnet size of local_ip
+  int      sock; // UDP socket bound to this interface (SO_BINDTODEVICE)
+  uint32_t ts_key; // key of the next timestamped send on sock (SOF_TIMESTAMPING_OPT_ID)
+  uint8_t  hw_stamps; // the nic timestamps packets in hardware
+};
+
+struct testbed{ // one node (TestbedHandle): its network namespace and the state of every api file
+  int      netns; // fd of the node's network namespace
+  ino_t    ns_ino; // inode of the namespace, 0 if it is the process's
+  int      f_err;
+  uint32_t local_ip; // node's ipv4 addr on the primary interface (first set)
+  uint32_t broadcast_ip; // node's broadcast addr on the primary interface
+  struct testbed_if ifaces[MAX_INTERFACES]; // interfaces added with SetInterface
+  atomic_int num_ifaces; // stored (release) once the new slot is set up, read with if_count
+  pthread_mutex_t lock; // providing thread safety (queue registration, not used by netlink requests)
+  pthread_mutex_t state_lock; // allocation of the state below
+  pthread_mutex_t thread_lock; // threads and num_threads
+  pthread_t threads[NODE_MAX_THREADS]; // started by start_thread, stopped by DestroyTestbed
+  int      num_threads;
+
+  // state of each api file, allocated by its Initialize function (NULL until then); the
+  // optional features allocate theirs when first used, so they are published atomically
+  struct if_state       *iface;
+  struct route_state    *route;
+  struct fib_state      *fib;
+  struct event_state    *event;
+  struct neigh_state    *neigh;
+  struct metric_state   *metric;
+  struct async_state    *async;
+  struct lifetime_state *_Atomic lifetime;
+  struct send_state     *send;
+  struct sched_state    *sched;
+  struct jitter_state   *_Atomic jitter;
+  struct dup_state      *_Atomic dup;
+  struct sync_state     *_Atomic sync;
+  struct loop_state     *loop;
+  struct timer_state    *timer;
+  struct handoff_state  *handoff;
+  struct pool_state     *pool;
+  struct queue_state    *queue;
+};
+
+struct thread_start{ // passed from start_thread to the new thread
+  struct testbed *node;
+  void *(*func)();
+};
+
+struct ns_call{ // passed from ns_run to the thread that runs func in the node's namespace
+  struct testbed *node;
+  int (*func)(void *);
+  void *arg;
+  int ret;
+};
 
 void check(int val); // check for error
 char *ntop(int domain, void *buf); // convert ip to string
 
 /**
- * \brief Helper function that receives a message over the current netlink socket, using
+ * \brief Helper function that returns the node of the calling thread: the one given to
+ * UseTestbed, or the default node (created on first use) if the thread never called it.
+ * Threads started by the API use the node that started them
+ * 
+ * \return The node
+*/
+struct testbed *testbed();
+
+/**
+ * \brief Helper function that starts the threads of the API with the node that creates them
+ * 
+ * \param thread Filled in with the new thread
+ * \param func The start function of the thread
+ * 
+ * \return 0 for success, -1 for failure
+*/
+int start_thread(pthread_t *thread, void *(*func)());
+
+/**
+ * \brief Helper function that lets DestroyTestbed cancel the calling API thread until wait_end.
+ * The API's threads are only cancelled while they wait for work, so they never stop while
+ * holding a lock (a wait on a condition variable pushes unlock_on_cancel). Does nothing on the
+ * user's threads
+ * 
+*/
+void wait_begin();
+
+/**
+ * \brief Helper function that stops the calling API thread from being cancelled again (see wait_begin)
+ * 
+*/
+void wait_end();
+
+/**
+ * \brief Helper function used as the pthread_cleanup_push handler of a condition wait, so a
+ * thread cancelled in pthread_cond_wait releases the mutex it got back
+ * 
+ * \param lock The pthread_mutex_t of the wait
+*/
+void unlock_on_cancel(void *lock);
+
+/**
+ * \brief Helper function that runs func in the network namespace of the calling thread's node.
+ * The API's threads already are in it; a caller's thread is never moved, func runs on a
+ * short-lived thread that enters the namespace instead
+ * 
+ * \param func The function to run
+ * \param arg Passed to func
+ * 
+ * \return The return value of func, or -1 if the namespace could not be entered
+*/
+int ns_run(int (*func)(void *), void *arg);
+
+/**
+ * \brief Helper function that opens a socket in the network namespace of the calling thread's
+ * node (a socket stays in the namespace it was created in)
+ * 
+ * \param domain, type, protocol As for socket()
+ * 
+ * \return The socket, or -1 on error
+*/
+int ns_socket(int domain, int type, int protocol);
+
+/**
+ * \brief Helper function that runs a shell command (iptables, sysctl) in the network namespace
+ * of the calling thread's node
+ * 
+ * \param cmd The command
+ * 
+ * \return The return value of system()
+*/
+int ns_system(const char *cmd);
+
+/**
+ * \brief Helper function that returns the netlink socket of the calling thread, opening it on
+ * first use. Every thread has its own socket (closed when the thread exits), so netlink
+ * requests from different threads never wait on each other or read each other's replies. The
+ * socket is opened in the network namespace of the thread's node, and reopened if the thread
+ * switches to a node in another namespace
+ * 
+ * \return The socket, or -1 on error
+*/
+int nl_sock();
+
+/**
+ * \brief Helper function that returns the next netlink sequence number of the calling thread
+ * 
+ * \return A sequence number between 1 and INT32_MAX
+*/
+int nl_next_seq();
+
+/**
+ * \brief Helper function that sends one netlink request on the calling thread's socket with
+ * the next sequence number
+ * 
+ * \param sa Pointer to a struct sockaddr_nl for the kernel
+ * \param nl The request (nlmsg_seq is set)
+ * 
+ * \return The sequence number of the request, or -1 on error
+*/
+int nl_send(struct sockaddr_nl *sa, struct nlmsghdr *nl);
+
+/**
+ * \brief Helper function that receives the next reply to a request, skipping replies with
+ * other sequence numbers
+ * 
+ * \param sa Pointer to a struct sockaddr_nl that was used in nl_send()
+ * \param buf Buffer to hold msg contents
+ * \param len Length of buf
+ * \param seq The sequence number returned by nl_send()
+ * 
+ * \return number of bytes read, or -1 on error
+*/
+int get_reply(struct sockaddr_nl *sa, void *buf, size_t len, int seq);
+
+/**
+ * \brief Helper function that receives a message over the calling thread's netlink socket, using
  * struct msghdr and struct iovec
  * 
  * \param sa Pointer to a struct sockaddr_nl that was used in get_ip()
@@ -0,0 +1,87 @@
+#ifndef API_ASYNC_H
+#define API_ASYNC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>        // wakes the netlink I/O thread when a route is submitted
+#include <sys/socket.h>         // linux socket API
+#include <linux/netlink.h>      // netlink allows kernel<->userspace communications
+#include <pthread.h>			// API should be thread-safe
+
+#define ASYNC_QUEUE_LEN 1024 // max route changes waiting to be sent
+#define ASYNC_MAX_INFLIGHT 64 // max route changes sent but not yet acknowledged
+
+struct async_req{ // one submitted route change
+  struct route_op *op; // owned by the user, error is updated on completion
+  RouteCallback    cb;
+  void            *arg;
+  uint32_t         seq; // netlink sequence number while in flight
+  int              used; // in-flight slot is taken
+};
+
+struct async_state{ // route changes waiting for their ACK of one node
+  int async_fd; // netlink socket owned by the I/O thread
+  int wake_fd; // eventfd, written when a route change is submitted
+  struct async_req queue[ASYNC_QUEUE_LEN]; // submitted, not yet sent
+  uint32_t queue_head;
+  uint32_t queue_count;
+  struct async_req inflight[ASYNC_MAX_INFLIGHT]; // indexed by seq % ASYNC_MAX_INFLIGHT
+  uint32_t async_seq;
+  pthread_mutex_t async_lock;
+  pthread_t async_thread;
+};
+
+/**
+ * \brief Initializes the asynchronous route API. Opens a netlink socket that is only used by
+ * the I/O thread (so it never waits on the calling threads' sockets) and starts that thread, or
+ * adds the socket and its eventfd to the event loop if it is on
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeAsync();
+
+/**
+ * \brief Helper function that moves queued route changes into free in-flight slots and sends
+ * them with one sendmsg on the async socket
+ *
+*/
+static void send_pending();
+
+/**
+ * \brief Helper function that reads the kernel's ACKs from the async socket (without blocking)
+ * and completes the route changes they belong to by nlmsg_seq
+ *
+*/
+static void read_acks();
+
+/**
+ * \brief Helper function used as the event loop callback of wake_fd. Clears the eventfd and
+ * sends the new submissions
+ *
+ * \param fd The eventfd
+ * \param arg Unused
+*/
+static void loop_wake(int fd, void *arg);
+
+/**
+ * \brief Helper function used as the event loop callback of the async socket. Completes the
+ * acknowledged route changes and sends the ones that were waiting for an in-flight slot
+ *
+ * \param fd The async netlink socket
+ * \param arg Unused
+*/
+static void loop_acks(int fd, void *arg);
+
+/**
+ * \brief Helper function that sends queued route changes and matches the kernel's ACKs to them
+ * by nlmsg_seq. It is used as the start function for the pthread_t thread that owns the
+ * async netlink socket
+ *
+*/
+void *thread_func_async();
+
+#endif
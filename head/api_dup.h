@@ -0,0 +1,101 @@
+#ifndef API_DUP_H
+#define API_DUP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>			// API should be thread-safe
+
+#define DUP_GENERATIONS 4 // number of generations in the ring (oldest is cleared on rotation)
+#define DUP_SLOTS 1024 // hash slots per generation (must be a power of 2)
+#define DUP_MAX_LOAD (DUP_SLOTS * 3 / 4) // rotate early once a generation is this full
+
+struct dup_slot{ // one (originator, sequence number) key
+  uint32_t orig;
+  uint32_t seq;
+  uint32_t stamp; // slot is only valid if this matches its generation's stamp
+};
+
+struct dup_gen{ // one generation of the duplicate cache
+  struct dup_slot slots[DUP_SLOTS];
+  uint32_t stamp; // bumping the stamp clears the whole generation in O(1)
+  uint32_t count;
+};
+
+struct dup_cache{ // ring of generations, keys are held for at least hold_time
+  struct dup_gen gens[DUP_GENERATIONS];
+  uint32_t cur_gen; // generation new keys are inserted into
+  uint32_t gen_interval; // ms between rotations
+  struct timespec last_rotate;
+};
+
+struct dup_state{ // duplicate caches and filter of one node
+  struct dup_cache user; // keys recorded by IsDuplicate
+  struct dup_cache filter; // keys recorded by the incoming control queue's filter
+  pthread_mutex_t dup_lock;
+  // filter configuration for the incoming control queue (set by EnableDuplicateFilter)
+  int filter_enabled;
+  int32_t filter_type_offset;
+  uint8_t filter_type;
+  uint32_t filter_orig_offset;
+  uint32_t filter_seq_offset;
+  uint8_t filter_seq_size;
+};
+
+/**
+ * \brief Empties the duplicate caches and disables the filter. The caches are allocated
+ * by the first IsDuplicate or EnableDuplicateFilter call, so this does nothing before then
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeDup();
+
+/**
+ * \brief Helper function that empties one cache and sets how long it holds keys
+ *
+ * \param c The cache to empty
+ * \param hold_time Minimum time (ms) a key is remembered
+*/
+static void cache_reset(struct dup_cache *c, uint32_t hold_time);
+
+/**
+ * \brief Helper function that checks a key against one cache and records it if it is new.
+ * Called with dup_lock held
+ *
+ * \param c The cache to check (the IsDuplicate cache or the filter's cache)
+ * \param orig The originator address
+ * \param seq The sequence number
+ *
+ * \return 1 if the key was already in the cache, 0 if it was recorded now
+*/
+static int check_key(struct dup_cache *c, uint32_t orig, uint32_t seq);
+
+/**
+ * \brief Helper function that empties both caches and disables the filter
+ *
+ * \param st The node's duplicate state
+*/
+static void dup_reset(struct dup_state *st);
+
+/**
+ * \brief Helper function that allocates and empties the node's duplicate caches on first use
+ *
+ * \return the node's duplicate state, NULL if it could not be allocated
+*/
+static struct dup_state *dup_alloc();
+
+/**
+ * \brief Helper function used by the incoming control queue to check a queued packet against
+ * the duplicate filter configured with EnableDuplicateFilter(). Packets that do not match the
+ * filter (filter disabled, wrong type, or too short) are never reported as duplicates. The
+ * filter has its own cache, so it never sees keys recorded by IsDuplicate (and vice versa)
+ *
+ * \param payload Pointer to the UDP payload of the packet
+ * \param payload_length Length of payload
+ *
+ * \return 1 if the packet is a duplicate and should be dropped, 0 otherwise
+*/
+int dup_filter_packet(uint8_t *payload, uint32_t payload_length);
+
+#endif
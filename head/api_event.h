@@ -0,0 +1,82 @@
+#ifndef API_EVENT_H
+#define API_EVENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <sys/socket.h>         // linux socket API
+#include <linux/netlink.h>      // netlink allows kernel<->userspace communications
+#include <linux/rtnetlink.h>    // rtnetlink multicast groups
+#include <pthread.h>			// API should be thread-safe
+
+#define EVENT_GROUPS (RTMGRP_IPV4_ROUTE | RTMGRP_IPV4_IFADDR | RTMGRP_LINK | RTMGRP_NEIGH) // groups joined by the event socket
+#define EVENT_BUFLEN 16384 // one recv can hold many events during a burst of changes
+#define EVENT_RCVBUF (4 * 1024 * 1024) // socket buffer for bursts of events (a flush of thousands of routes) before they overflow
+
+struct event_state{ // event feed of one node
+  int event_fd; // netlink socket bound to the multicast groups
+  EventCallback event_cb;
+  pthread_t event_thread;
+};
+
+/**
+ * \brief Initializes the event feed. Opens a netlink socket bound to the IPv4 route, IPv4
+ * address, link and neighbour multicast groups and starts the thread that reads it, or adds it
+ * to the event loop if one was selected with SetEventLoopMode
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeEvent();
+
+/**
+ * \brief Helper function that parses an RTM_NEWROUTE or RTM_DELROUTE message into an event.
+ * Also used to parse route dumps
+ *
+ * \param nl The netlink message
+ * \param ev Filled in with the route (type, destination, prefix length, gateway, interface, table)
+ *
+ * \return 0 for success, -1 if the message is not an ipv4 unicast route
+*/
+int parse_route_msg(struct nlmsghdr *nl, struct net_event *ev);
+
+/**
+ * \brief Helper function that allocates the event state of the node the first time it is needed
+ * (RegisterEventCallback can be called before InitializeAPI)
+ *
+ * \return The state, or NULL if it could not be allocated
+*/
+static struct event_state *event_alloc();
+
+/**
+ * \brief Helper function that reloads the interface cache, the route mirror and the neighbour
+ * table after the event socket overflowed (ENOBUFS), since the lost events are not resent
+*/
+static void event_resync();
+
+/**
+ * \brief Helper function that reads one batch of change events from the kernel, updates the
+ * cached interface addresses, route mirror and neighbour table, and calls the user's event callback
+ *
+ * \return The number of bytes read (0 after an interrupt or an overflow, which resyncs), or -1
+ * if the socket failed
+*/
+int read_events();
+
+/**
+ * \brief Helper function that reads the event socket when the event loop finds it readable
+ *
+ * \param fd The event socket
+ * \param arg Unused
+*/
+static void loop_events(int fd, void *arg);
+
+/**
+ * \brief Helper function to read change events from the kernel until the socket is closed or
+ * fails. It is used as the start function for the pthread_t thread that reads the event socket
+ *
+*/
+void *thread_func_event();
+
+#endif
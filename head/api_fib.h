@@ -0,0 +1,120 @@
+#ifndef API_FIB_H
+#define API_FIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <stdatomic.h>          // sequence counter for lock-free reads
+#include <sys/socket.h>         // linux socket API
+#include <linux/netlink.h>      // netlink allows kernel<->userspace communications
+#include <linux/rtnetlink.h>    // rtnetlink allows for modification of routing table
+#include <pthread.h>			// API should be thread-safe
+
+#define FIB_SIZE 8192 // slots in the route mirror (must be a power of 2)
+#define FIB_MAX_ROUTES (FIB_SIZE * 3 / 4) // keep probe chains short
+
+#define FIB_ORIGIN_API 1 // in the API's table: installed through this API (or a route event of that table)
+#define FIB_ORIGIN_KERNEL 2 // in the main table: read by MirrorMainTable or a route event
+#define FIB_ORIGINS 2
+
+struct fib_entry{ // one route in the mirror, 16 bytes so 4 fit in a cache line
+  uint32_t prefix; // destination, masked to len bits
+  uint32_t next_hop; // 0 for directly connected routes
+  int32_t  ifindex;
+  uint8_t  len; // prefix length
+  uint8_t  used;
+  uint8_t  origin; // FIB_ORIGIN_API or FIB_ORIGIN_KERNEL, part of the key
+  uint8_t  seen; // set by every insert, fib_resync drops the routes a dump did not set it on
+};
+
+struct fib_state{ // route mirror of one node
+  struct fib_entry fib[FIB_SIZE];
+  uint32_t fib_count;
+  uint32_t len_count[FIB_ORIGINS][33]; // routes per origin and prefix length
+  uint8_t lens[FIB_ORIGINS][33]; // prefix lengths in use by each origin, longest first
+  uint32_t num_lens[FIB_ORIGINS];
+  atomic_uint fib_seq; // odd while a writer is changing the table
+  pthread_mutex_t fib_lock;
+  uint8_t mirror_all; // set by MirrorMainTable, route events then add new main table routes
+};
+
+struct resync_routes{ // routes of the API's table found by the dump of fib_resync
+  struct route_spec *routes;
+  uint32_t count;
+  uint32_t size;
+  uint8_t failed; // out of memory, some routes are missing
+};
+
+/**
+ * \brief Initializes the (empty) userspace mirror of the routing table
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeFib();
+
+/**
+ * \brief Adds or replaces a route in the mirror. Called whenever the API installs a route. A
+ * route is identified by its prefix, length and origin, so the same prefix can be mirrored once
+ * for the API's table and once for main
+ *
+ * \param prefix The destination of the route
+ * \param len The prefix length of the destination
+ * \param next_hop The gateway of the route (0 if directly connected)
+ * \param ifindex The interface of the route
+ * \param origin FIB_ORIGIN_API or FIB_ORIGIN_KERNEL
+ *
+ * \return 0 for success, -1 if the mirror is full
+*/
+int fib_insert(uint32_t prefix, uint8_t len, uint32_t next_hop, int ifindex, uint8_t origin);
+
+/**
+ * \brief Removes a route from the mirror. Called whenever the API deletes a route
+ *
+ * \param prefix The destination of the route
+ * \param len The prefix length of the destination
+ * \param origin FIB_ORIGIN_API or FIB_ORIGIN_KERNEL, the table the route was removed from
+ *
+ * \return 0 for success, -1 if the route was not in the mirror
+*/
+int fib_remove(uint32_t prefix, uint8_t len, uint8_t origin);
+
+/**
+ * \brief Mirrors a route change that the kernel accepted (host route through the interface
+ * whose subnet holds the next hop, like form_request)
+ *
+ * \param op The completed route change, ignored if op->error is not 0
+*/
+void fib_apply(struct route_op *op);
+
+/**
+ * \brief Mirrors a route change reported by the event socket (main table or the API's table).
+ * Deletions are always applied; additions only update routes already mirrored unless
+ * MirrorMainTable was called
+ *
+ * \param ev The route event
+*/
+void fib_event(struct net_event *ev);
+
+/**
+ * \brief Longest prefix match in the mirror. Lock-free, may be called from any thread. If the
+ * API has its own table, its routes win over main table routes like its policy rule does (main
+ * is only searched when none matches); if the API uses main, the longest prefix of either wins
+ *
+ * \param dest The address to look up
+ * \param out Filled in with the matching route
+ *
+ * \return 1 if a route was found, 0 otherwise
+*/
+int fib_lookup(uint32_t dest, struct fib_entry *out);
+
+/**
+ * \brief Helper function used by the event thread after the event socket overflowed. Dumps the
+ * routing table again: mirrored routes are refreshed, the ones the kernel no longer has are
+ * removed, and the routes SyncRoutes installed are checked against the API's table
+ *
+ * \return 0 for success, -1 if the dump failed
+*/
+int fib_resync();
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef API_HANDOFF_H
+#define API_HANDOFF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <stdatomic.h>          // lock-free ring
+#include <sys/eventfd.h>        // wakes the worker when the ring was empty, and receivers when it was full
+#include <pthread.h>			// API should be thread-safe
+#include <linux/netfilter.h>
+#include <libnetfilter_queue/libnetfilter_queue.h>
+#include "api_pool.h" // packets stay in their receive buffers
+
+#define HANDOFF_RING_LEN 1024 // packets waiting for the worker (must be a power of 2)
+#define HANDOFF_BATCH 64 // packets the worker handles before it flushes its verdicts (and wakes receivers of a full ring, must be a power of 2)
+#define HANDOFF_MAX_WORKERS 16 // callback workers of the data-plane queues (SetQueueWorkers)
+
+struct pkt_desc{ // one queued packet handed to the worker
+  struct nfq_q_handle *qh; // queue the verdict goes to
+  uint32_t id; // packet id in that queue
+  uint16_t queue; // QUEUE_IN_CONTROL, QUEUE_IN_DATA, QUEUE_OUT or QUEUE_FORWARD
+  struct packet *pkt; // held in its receive buffer, released after the verdict
+};
+
+struct ring_slot{
+  atomic_size_t seq; // position the slot is ready for: pos to push, pos + 1 to pop
+  struct pkt_desc d;
+};
+
+struct pkt_ring{ // bounded lock-free ring: the receiver threads push, one worker pops
+  atomic_size_t tail __attribute__ ((aligned(CACHE_LINE))); // next position to push, shared by the receivers
+  size_t head __attribute__ ((aligned(CACHE_LINE))); // next position to pop, worker only
+  atomic_int sleeping; // the worker is waiting on wake_fd
+  int wake_fd; // eventfd
+  atomic_int full_waiters; // receivers waiting on space_fd for a free slot
+  int space_fd; // eventfd (semaphore), written by the worker as it frees slots
+  struct ring_slot slots[HANDOFF_RING_LEN] __attribute__ ((aligned(CACHE_LINE)));
+};
+
+struct verdict_batch{ // accepts of one queue not sent yet
+  struct nfq_q_handle *qh;
+  uint32_t id; // highest accepted id
+};
+
+struct handoff_state{ // packet handoff of one node
+  struct pkt_ring *ring; // allocated when the handoff is first enabled
+  atomic_int enabled;
+  pthread_t worker_thread;
+
+  // worker pool of the incoming data and forward queues, one ring per worker
+  struct pkt_ring *pool_rings[HANDOFF_MAX_WORKERS]; // allocated when a worker is first started
+  pthread_t pool_threads[HANDOFF_MAX_WORKERS];
+  atomic_int num_workers; // workers packets are spread over, 0 when the pool is off
+  atomic_int next_worker; // ring the next started worker takes
+};
+
+/**
+ * \brief Helper function that allocates the node's handoff state the first time the handoff
+ * or the worker pool is enabled
+ *
+ * \return the node's handoff state, NULL if it could not be allocated
+*/
+static struct handoff_state *handoff_alloc();
+
+/**
+ * \brief Helper function that allocates a ring with every slot free
+ *
+ * \return The ring, or NULL for failure
+*/
+struct pkt_ring *ring_create();
+
+/**
+ * \brief Helper function that frees a ring
+ *
+ * \param r The ring
+*/
+void ring_destroy(struct pkt_ring *r);
+
+/**
+ * \brief Helper function that takes the next free slot of a ring. Many threads can push at once;
+ * each sleeps on space_fd while the ring is full (the worker wakes it after freeing slots), so the
+ * kernel queue backs up instead of packets being lost here and no CPU is spent waiting
+ *
+ * \param r The ring
+ * \param pos Filled in with the position of the slot, for ring_publish
+ *
+ * \return The slot to fill in
+*/
+struct pkt_desc *ring_reserve(struct pkt_ring *r, size_t *pos);
+
+/**
+ * \brief Helper function that makes a slot filled in after ring_reserve visible to the worker
+ *
+ * \param r The ring
+ * \param pos The position from ring_reserve
+*/
+void ring_publish(struct pkt_ring *r, size_t pos);
+
+/**
+ * \brief Helper function that returns the oldest packet of a ring without removing it (worker only)
+ *
+ * \param r The ring
+ *
+ * \return The packet, or NULL if the ring is empty
+*/
+struct pkt_desc *ring_peek(struct pkt_ring *r);
+
+/**
+ * \brief Helper function that frees the slot returned by ring_peek (worker only)
+ *
+ * \param r The ring
+*/
+void ring_release(struct pkt_ring *r);
+
+/**
+ * \brief Helper function that wakes the worker of a ring if it is waiting. Called once per
+ * receive batch, not per packet
+ *
+ * \param r The ring
+*/
+void ring_wake(struct pkt_ring *r);
+
+/**
+ * \brief Helper function that wakes the receivers waiting for a slot of a full ring. Called by
+ * ring_release every HANDOFF_BATCH slots and by ring_wait before the worker sleeps (worker only)
+ *
+ * \param r The ring
+*/
+void ring_space(struct pkt_ring *r);
+
+/**
+ * \brief Helper function that waits until the ring has a packet (worker only)
+ *
+ * \param r The ring
+*/
+void ring_wait(struct pkt_ring *r);
+
+/**
+ * \brief Helper function used by the queue handlers to check whether packets go to the worker
+ *
+ * \return 1 if the handoff is enabled, 0 otherwise
+*/
+int handoff_enabled();
+
+/**
+ * \brief Helper function used by the queue handlers to hold a parsed packet and put its handle in
+ * the ring instead of calling the user's callback (the packet data is not copied)
+ *
+ * \param qh The queue of the packet
+ * \param id The id of the packet in the queue
+ * \param queue The queue number
+ * \param pkt The packet, from packet_start
+ *
+ * \return 0 when the packet was queued, or the result of its verdict if it was dropped (no buffer)
+*/
+int handoff_push(struct nfq_q_handle *qh, uint32_t id, uint16_t queue, struct packet *pkt);
+
+/**
+ * \brief Helper function used by the incoming data and forward handlers to check whether packets
+ * go to the worker pool
+ *
+ * \param queue The queue number
+ *
+ * \return 1 if the queue's packets are spread over the workers, 0 otherwise
+*/
+int workers_enabled(uint16_t queue);
+
+/**
+ * \brief Helper function that hashes the flow of a packet: addresses, protocol and the TCP or UDP
+ * ports. Fragments are hashed without ports, so every fragment of a packet goes to one worker
+ *
+ * \param pkt The packet
+ *
+ * \return The hash
+*/
+static uint32_t flow_hash(struct packet *pkt);
+
+/**
+ * \brief Helper function used by the queue handlers to hold a parsed packet and put it in the ring
+ * of the worker its flow hashes to, so packets of one flow are handled (and get their verdicts)
+ * in order
+ *
+ * \param qh The queue of the packet
+ * \param id The id of the packet in the queue
+ * \param queue The queue number
+ * \param pkt The packet, from packet_start
+ *
+ * \return 0 when the packet was queued, or the result of its verdict if it was dropped (no buffer)
+*/
+int worker_push(struct nfq_q_handle *qh, uint32_t id, uint16_t queue, struct packet *pkt);
+
+/**
+ * \brief Helper function called by the queue threads after each receive batch, to wake the
+ * worker (and the pool workers) once for every packet the batch pushed
+*/
+void handoff_wake();
+
+/**
+ * \brief Helper function that calls the user's callback of the packet's queue
+ *
+ * \param d The packet
+ *
+ * \return The verdict of the callback
+*/
+uint8_t handoff_callback(struct pkt_desc *d);
+
+/**
+ * \brief Helper function that records the verdict of a packet. Accepts of one queue are merged
+ * into one nfq_set_verdict_batch; a drop first sends the accepts before it
+ *
+ * \param b Accepts not sent yet, one per queue
+ * \param d The packet
+ * \param verdict PACKET_ACCEPT or PACKET_DROP
+*/
+static void add_verdict(struct verdict_batch *b, struct pkt_desc *d, uint8_t verdict);
+
+/**
+ * \brief Helper function that sends the accepts not sent yet
+ *
+ * \param b Accepts not sent yet, one per queue
+*/
+static void flush_verdicts(struct verdict_batch *b);
+
+/**
+ * \brief Helper function that takes packets from the ring, calls the user's callbacks and issues
+ * the verdicts. It is used as the start function for the pthread_t thread of the protocol worker
+ *
+*/
+void *thread_func_handoff();
+
+/**
+ * \brief Helper function that takes packets from one worker pool ring, calls the user's callbacks
+ * and issues each verdict on its own (a batch verdict would also cover lower ids still being
+ * handled by other workers). It is used as the start function for the pthread_t threads of the
+ * worker pool
+ *
+*/
+void *thread_func_worker();
+
+#endif
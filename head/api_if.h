@@ -9,6 +9,27 @@
 #include <sys/socket.h>         // linux socket API
 #include <linux/netlink.h>      // netlink allows kernel<->userspace communications
 #include <pthread.h>			// API should be thread-safe
+#include <stdatomic.h>          // sequence counter for lock-free reads
+#include <net/if.h>             // IF_NAMESIZE
+
+#define IF_CACHE_MAX 32 // ipv4 addresses kept in the interface cache
+
+struct if_addr{ // one cached ipv4 address
+  uint32_t index; // kernel ifindex
+  char     name[IF_NAMESIZE]; // address label, the interface name unless it has an alias
+  uint32_t local_ip;
+  uint32_t broadcast_ip;
+  uint8_t  prefix_len;
+  uint8_t  secondary; // IFA_F_SECONDARY, another address of the interface is in the same subnet
+};
+
+struct if_state{ // interface address cache of one node
+  struct if_addr cache[IF_CACHE_MAX]; // every ipv4 address of the node
+  uint32_t cache_count;
+  int cache_loaded;
+  atomic_uint cache_seq; // odd while a writer is changing the cache
+  pthread_mutex_t cache_lock;
+};
 
 /**
  * \brief Helper function that initializes netlink socket for the testbed. Also sets local_ip 
@@ -18,6 +39,91 @@
 */
 int InitializeIF();
 
+/**
+ * \brief Helper function that allocates the interface cache of the node the first time it is
+ * needed (SetInterface can be called before InitializeAPI)
+ *
+ * \return The cache, or NULL if it could not be allocated
+*/
+static struct if_state *if_alloc();
+
+/**
+ * \brief Helper function run with ns_run, so interface names are looked up in the node's namespace
+ *
+ * \param name The interface name
+ *
+ * \return The ifindex, or 0 if there is no such interface
+*/
+static int name_to_index(void *name);
+
+/**
+ * \brief Helper function that returns the number of testbed interfaces. Slots below it are fully
+ * set up, so they can be read without a lock
+ *
+ * \return The number of interfaces added with SetInterface
+*/
+int if_count();
+
+/**
+ * \brief Helper function that reads the broadcast address of a testbed interface, which the event
+ * thread may be changing
+ *
+ * \param iface The interface
+ *
+ * \return The broadcast address, 0 if the interface has no address
+*/
+uint32_t if_broadcast(struct testbed_if *iface);
+
+/**
+ * \brief Helper function that sets the addresses of a testbed interface (and of the node, for the
+ * primary interface). Called with cache_lock held, inside the seqlock
+ *
+ * \param iface The interface
+ * \param entry Its address from the cache, NULL if it has none
+*/
+static void set_if_addr(struct testbed_if *iface, struct if_addr *entry);
+
+/**
+ * \brief Helper function that picks the cached address a testbed interface should use. The
+ * current address is kept while it is cached, otherwise the first primary address of the
+ * interface is used, and a secondary one only if it has no primary. Called with cache_lock held
+ * 
+ * \param iface The testbed interface
+ * 
+ * \return The address, or NULL if the interface has none
+*/
+static struct if_addr *pick_if_addr(struct testbed_if *iface);
+
+/**
+ * \brief Helper function that finds the interface to reach an address on, by checking which
+ * interface subnet holds the address
+ * 
+ * \param address The ipv4 address to reach (for example the next hop of a route)
+ * 
+ * \return The ifindex of the matching interface, or the primary interface if none match
+*/
+int if_for_addr(uint32_t address);
+
+/**
+ * \brief Helper function that finds a testbed interface by its kernel ifindex
+ * 
+ * \param index The ifindex to look up
+ * 
+ * \return Pointer to the interface, or NULL if it is not used by the testbed
+*/
+struct testbed_if *if_by_index(int index);
+
+/**
+ * \brief Helper function that checks if a packet is a broadcast sent by this node on any
+ * of its interfaces
+ * 
+ * \param src The source address of the packet
+ * \param dest The destination address of the packet
+ * 
+ * \return 1 if the packet is our own broadcast, 0 otherwise
+*/
+int is_own_broadcast(uint32_t src, uint32_t dest);
+
 /**
  * \brief Helper function that formats and sends a netlink message to 
  * acquire a node's local or broadcast ip, using struct msghdr and struct iovec
@@ -25,7 +131,7 @@ int InitializeIF();
  * \param sa Pointer to a struct sockaddr_nl to be included in the iovec
  * \param domain Indicates use of ipv4 or ipv6 (only ipv4, known as AF_INET, currently supported)
  * 
- * \return 0 for success, -1 for failure
+ * \return The sequence number of the request, or -1 for failure
 */
 static int get_ip(struct sockaddr_nl *sa, int domain);
 
@@ -36,21 +142,53 @@ static int get_ip(struct sockaddr_nl *sa, int domain);
  * ifa message to parse
  * \param buf Buffer to hold ifa msg contents
  * \param len Length of buf
- * \param type Indicates which address to get (0 for local, 1 for broadcast)
+ * \param entry Filled in with the interface index, label and addresses of the message
  * 
- * \return number of bytes read, or -1 on error
+ * \return 0 for success
 */
-static int parse_ifa_msg(struct ifaddrmsg *ifa, void *buf, size_t len, uint8_t type);
+int parse_ifa_msg(struct ifaddrmsg *ifa, void *buf, size_t len, struct if_addr *entry);
 
 /**
  * \brief Helper function that parses one received netlink message regarding interfaces
  * 
  * \param buf Buffer to hold netlink msg contents
  * \param len Length of buf
- * \param type Indicates which address to get (0 for local, 1 for broadcast)
+ * \param entries Array the addresses are added to (at most IF_CACHE_MAX)
+ * \param count Number of entries in use, updated
+ * 
+ * \return type of the last netlink message, NLMSG_DONE at the end of the dump
+*/
+static uint32_t parse_nl_if_msg(void *buf, size_t len, struct if_addr *entries, uint32_t *count);
+
+/**
+ * \brief Helper function that reads every ipv4 address with one RTM_GETADDR dump, replaces
+ * the interface cache with them and refreshes the addresses of the testbed interfaces
+ * 
+ * \return 0 for success, -1 for failure
+*/
+int if_cache_load();
+
+/**
+ * \brief Helper function used by the event thread to apply an RTM_NEWADDR or RTM_DELADDR to
+ * the interface cache and to the testbed interface it belongs to. The interface keeps its address
+ * when another one is added, and falls back to another cached address when its own is removed
+ * (see pick_if_addr)
+ * 
+ * \param add 1 for a new (or changed) address, 0 for a removed one
+ * \param entry The address, as parsed by parse_ifa_msg
+*/
+void if_cache_update(int add, struct if_addr *entry);
+
+/**
+ * \brief Helper function that looks up an address in the interface cache without taking a lock.
+ * By index, a primary address is returned before a secondary one
+ * 
+ * \param index The ifindex to find, or 0 to find by name
+ * \param name The label to find (used when index is 0)
+ * \param out Filled in with the cached address
  * 
- * \return number of bytes read, or -1 on error
+ * \return 1 if found, 0 otherwise
 */
-static uint32_t parse_nl_if_msg(void *buf, size_t len, uint8_t type);
+int if_cache_find(unsigned int index, const char *name, struct if_addr *out);
 
-#endif
\ No newline at end of file
+#endif
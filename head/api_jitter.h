@@ -0,0 +1,88 @@
+#ifndef API_JITTER_H
+#define API_JITTER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>			// API should be thread-safe
+
+#define JITTER_MAX_PENDING 64 // max broadcasts waiting for their jitter timer
+#define JITTER_MAX_PACKET 1400 // max size of a (merged) jittered broadcast, fits one wifi frame
+#define JITTER_BROKEN UINT32_MAX // max_jitter when the timer thread could not be started
+
+struct jitter_msg{ // one broadcast waiting for its jitter timer
+  int      used;
+  uint8_t  msg_class;
+  int      ifindex; // interface to broadcast on (0 for all)
+  struct timespec due; // time the broadcast is sent
+  uint32_t size;
+  uint8_t  buf[JITTER_MAX_PACKET];
+};
+
+struct jitter_state{ // jittered sends of one node
+  struct jitter_msg pending[JITTER_MAX_PENDING];
+  uint32_t max_jitter; // ms, 0 disables jitter
+  uint8_t merge_pending;
+  unsigned int seed;
+  pthread_mutex_t jitter_lock;
+  pthread_cond_t jitter_cond;
+  pthread_t jitter_thread;
+};
+
+/**
+ * \brief Initializes the broadcast jitter scheduler. Jitter starts disabled and its state is
+ * only allocated by the first SetBroadcastJitter that enables it, so this does nothing
+ *
+ * \return 0
+*/
+int InitializeJitter();
+
+/**
+ * \brief Helper function that allocates the jitter state the first time jitter is enabled and
+ * starts the timer thread that sends jittered broadcasts. In event loop mode no thread is
+ * started, each held broadcast gets its own StartTimer timer
+ *
+ * \return the node's jitter state, NULL if it could not be allocated
+*/
+static struct jitter_state *jitter_alloc();
+
+/**
+ * \brief Helper function that copies a due broadcast out of its slot, frees the slot and passes
+ * the broadcast to the send scheduler. Called with jitter_lock held, which is dropped while sending
+ *
+ * \param j The slot of the broadcast
+*/
+static void send_slot(struct jitter_msg *j);
+
+/**
+ * \brief Helper function used as the timer callback of a held broadcast in event loop mode
+ *
+ * \param arg Index of the broadcast's slot in pending
+*/
+static void jitter_expire(void *arg);
+
+/**
+ * \brief Helper function used by SendBroadcast and SendBroadcastClass. If jitter is enabled,
+ * delays the broadcast by a random time in [0, max_jitter] ms (merging it into a pending
+ * broadcast of the same class if enabled), otherwise passes it straight to the send scheduler
+ *
+ * \param msg_buf Buffer containing the contents of the message to send
+ * \param size Size of the message to be sent
+ * \param msg_class The message class, one of the MSG_CLASS_* definitions
+ * \param ifindex The interface to broadcast on, or 0 for all interfaces
+ *
+ * \return 0 for success, -1 for failure
+*/
+int jitter_send(uint8_t *msg_buf, uint32_t size, uint8_t msg_class, int ifindex);
+
+/**
+ * \brief Helper function to send broadcasts once their jitter timer expires. It is used as the
+ * start function for the pthread_t thread that sends jittered broadcasts
+ *
+*/
+void *thread_func_jitter();
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef API_LIFETIME_H
+#define API_LIFETIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>			// API should be thread-safe
+
+#define LIFETIME_INDEX_BITS 12
+#define LIFETIME_MAX_ROUTES (1 << LIFETIME_INDEX_BITS) // routes that can have a lifetime at once
+#define LIFETIME_HASH 4096 // hash buckets for finding a route by destination (must be a power of 2)
+#define LIFETIME_GRACE_MS 60000 // how long an expired route waits for its delete event
+#define LIFETIME_SLACK_MS 1000 // a kernel delete this close to the expiry time counts as an expiry
+
+#define LIFETIME_FIXED   0x01 // expiry is not moved by TouchRoute
+#define LIFETIME_KERNEL  0x02 // the kernel deletes the route (RTA_EXPIRES), only reported here
+#define LIFETIME_EXPIRED 0x04 // expired, waiting for the delete event
+
+struct route_timer{ // one route with a lifetime
+  uint32_t dest;
+  uint32_t next_hop;
+  uint32_t lifetime; // ms added by each refresh
+  uint64_t expires; // ms the route expires at, moved forward by TouchRoute
+  uint64_t due; // ms its timer fires at (expires >= due)
+  int      timer; // StartTimer id, -1 if none
+  int32_t  hnext; // next route in the hash bucket (or free list)
+  uint16_t gen; // bumped when the route is freed, passed to its timer with the index
+  uint8_t  used;
+  uint8_t  flags; // LIFETIME_FIXED, LIFETIME_KERNEL, LIFETIME_EXPIRED
+};
+
+struct lifetime_state{ // route lifetimes of one node
+  struct route_timer routes[LIFETIME_MAX_ROUTES];
+  int32_t buckets[LIFETIME_HASH]; // first route of each hash bucket, -1 if empty
+  int32_t free_list;
+  struct timespec start; // time of ms 0
+  uint8_t auto_refresh;
+  struct route_op expired[LIFETIME_MAX_ROUTES]; // deletes collected in one tick of the timer service
+  uint32_t num_expired;
+  int flush_timer; // deletes expired at the next tick, -1 if none is pending
+  pthread_mutex_t lifetime_lock; // routes
+  pthread_mutex_t expire_lock; // orders expiry deletes and AddTimedRoute
+};
+
+/**
+ * \brief Clears the route lifetime table. The table is allocated by the first route that gets
+ * a lifetime, so this does nothing before then. Expiries are run by the timer service, which
+ * InitializeTimer must start first
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeLifetime();
+
+/**
+ * \brief Helper function that stops every route timer and empties the table. Called with
+ * lifetime_lock held, or on a table nobody else can see yet
+ *
+ * \param st The node's lifetime table
+*/
+static void lifetime_reset(struct lifetime_state *st);
+
+/**
+ * \brief Helper function that allocates the node's lifetime table on first use
+ *
+ * \return the node's lifetime table, NULL if it could not be allocated
+*/
+static struct lifetime_state *lifetime_alloc();
+
+/**
+ * \brief Helper function that starts the timer of a route (lifetime_lock held)
+ *
+ * \param i The route
+ * \param delay Time (ms) until the timer fires
+ *
+ * \return 0 for success, -1 if the timer service has no free timer
+*/
+static int arm_route(int32_t i, uint64_t delay);
+
+/**
+ * \brief Helper function that runs when the timer of a route fires. Expires the route (its delete
+ * is batched with the other routes of the same tick), or starts a new timer if TouchRoute moved
+ * its expiry
+ *
+ * \param arg The route's index and generation
+*/
+static void route_timeout(void *arg);
+
+/**
+ * \brief Helper function that deletes the routes that expired in one tick with one ApplyRouteBatch
+ *
+ * \param arg Unused
+*/
+static void flush_expired(void *arg);
+
+/**
+ * \brief Helper function used by the forward and outgoing queues to refresh the lifetime of the
+ * route to a packet's destination (only if auto refresh is enabled)
+ *
+ * \param dest The destination of the packet
+*/
+void lifetime_packet(uint32_t dest);
+
+/**
+ * \brief Helper function that gives an installed route a lifetime (used by AddTimedRoute, and by
+ * AddRoute for routes with an expiry)
+ *
+ * \param dest The destination of the route
+ * \param next_hop The gateway of the route (used to delete it)
+ * \param lifetime Time in ms until the route expires
+ * \param flags 0 for a route refreshed by TouchRoute, or LIFETIME_FIXED / LIFETIME_KERNEL
+ *
+ * \return 0 for success, -1 if the lifetime table is full
+*/
+int lifetime_track(uint32_t dest, uint32_t next_hop, uint32_t lifetime, uint8_t flags);
+
+/**
+ * \brief Helper function used by the event thread when a route is deleted. Stops tracking the
+ * route and tells whether the delete was its expiry
+ *
+ * \param dest The destination of the deleted route
+ *
+ * \return 1 if the route expired, 0 otherwise
+*/
+int lifetime_deleted(uint32_t dest);
+
+#endif
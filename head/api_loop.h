@@ -0,0 +1,84 @@
+#ifndef API_LOOP_H
+#define API_LOOP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>          // one wait for every socket (and the timing wheel's timerfd)
+#include <pthread.h>			// API should be thread-safe
+
+#define LOOP_MAX_SOURCES 256 // fds in the loop at once
+#define LOOP_MAX_EVENTS 64 // ready sources handled per epoll_wait
+
+struct loop_source{ // one fd in the loop
+  int           fd;
+  uint8_t       used;
+  LoopCallback  fd_cb;
+  void          *arg;
+};
+
+struct loop_state{ // event loop of one node
+  uint8_t mode; // EVENT_LOOP_OFF, EVENT_LOOP_USER or EVENT_LOOP_THREAD
+  int epfd;
+  struct loop_source sources[LOOP_MAX_SOURCES]; // indexed by the slot stored in each epoll event
+  pthread_mutex_t loop_lock; // sources (added from any thread, run on the loop's thread)
+  pthread_t loop_thread;
+};
+
+/**
+ * \brief Initializes the event loop if SetEventLoopMode selected one: creates the epoll fd and,
+ * for EVENT_LOOP_THREAD, starts the thread that runs it. Must be called before the other
+ * Initialize functions so they add their sockets to the loop instead of starting threads
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeLoop();
+
+/**
+ * \brief Helper function that tells the other api files whether to add their sockets to the
+ * event loop (1) or to read them from their own threads (0)
+ *
+ * \return 1 if the event loop is on, 0 otherwise
+*/
+int loop_enabled();
+
+/**
+ * \brief Helper function that allocates the node's loop state when SetEventLoopMode selects a
+ * loop mode (nodes in the default mode have none)
+ *
+ * \return the node's loop state, NULL if it could not be allocated
+*/
+static struct loop_state *loop_alloc();
+
+/**
+ * \brief Helper function that adds a fd to the event loop. Used by AddLoopFd and by the api files
+ * for the nfqueue and netlink event sockets
+ *
+ * \param fd The fd to watch
+ * \param cb Called on the loop's thread when fd is readable
+ * \param arg Passed to cb
+ *
+ * \return 0 for success, -1 for failure
+*/
+int loop_add(int fd, LoopCallback cb, void *arg);
+
+/**
+ * \brief Helper function that runs the callback of one ready source
+ *
+ * \param ev The epoll event of the source
+ *
+ * \return 1 if a callback was run, 0 if the source was removed
+*/
+static int dispatch(struct epoll_event *ev);
+
+/**
+ * \brief Helper function that runs the event loop forever. It is used as the start function for
+ * the pthread_t thread of EVENT_LOOP_THREAD mode
+ *
+*/
+void *thread_func_loop();
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef API_METRIC_H
+#define API_METRIC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>          // sequence counter for lock-free reads
+#include <sys/socket.h>         // linux socket API
+#include <linux/netlink.h>      // netlink allows kernel<->userspace communications
+#include <linux/genetlink.h>    // generic netlink, used to reach nl80211
+#include <linux/nl80211.h>      // wireless station statistics
+#include <pthread.h>			// API should be thread-safe
+
+#define METRIC_MAX_STATIONS 128 // stations tracked over all testbed interfaces
+#define METRIC_BUFLEN 32768 // one recv of a station dump (each station is a few hundred bytes)
+#define METRIC_EWMA_SHIFT 3 // smoothing weight of a new sample is 1/8
+#define METRIC_SCALE 16 // fixed point scale of the smoothed values
+
+struct station{ // one station and the state needed to smooth its statistics
+  struct link_metrics m; // what readers get
+  int32_t signal_avg; // smoothed values, times METRIC_SCALE
+  int32_t bitrate_avg;
+  int32_t retry_avg;
+  int32_t fail_avg;
+};
+
+struct metric_state{ // link metrics of one node
+  int metric_fd; // generic netlink socket owned by the metrics thread
+  int family; // generic netlink id of nl80211
+  uint32_t metric_seq;
+  uint32_t metric_interval;
+  struct station stations[2][METRIC_MAX_STATIONS]; // published table and the one being built
+  uint32_t station_count[2];
+  atomic_uint cur; // index of the published table
+  atomic_uint metric_seqlock; // odd while the published table is being switched
+  pthread_t metric_thread;
+};
+
+/**
+ * \brief Initializes the link metrics service. Looks up the nl80211 generic netlink family and
+ * starts the thread that dumps the station statistics of every testbed interface (a timer on the
+ * event loop does the dumps in event loop mode). If the kernel
+ * has no nl80211 (no wireless drivers) the service stays off (its tables are freed) and
+ * GetLinkMetrics fails
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeMetric();
+
+/**
+ * \brief Helper function that allocates the link metrics of the node the first time they are
+ * needed (SetLinkMetricsInterval can be called before InitializeAPI)
+ *
+ * \return The state, or NULL if it could not be allocated
+*/
+static struct metric_state *metric_alloc();
+
+/**
+ * \brief Helper function that dumps the stations of every testbed interface into the table the
+ * readers are not using and then publishes it
+ *
+*/
+static void refresh_stations();
+
+/**
+ * \brief Helper function used as the timer callback that refreshes the stations in event loop
+ * mode. Re-arms itself with the current interval
+ *
+ * \param arg Unused
+*/
+static void metric_tick(void *arg);
+
+/**
+ * \brief Helper function that finds the generic netlink family id of nl80211
+ *
+ * \return The family id, or -1 if nl80211 is not available
+*/
+static int get_family();
+
+/**
+ * \brief Helper function that sends an NL80211_CMD_GET_STATION dump for one interface and reads
+ * every station in the reply into the next table
+ *
+ * \param ifindex The interface to dump
+ * \param next The table being built
+ * \param count Number of stations in next, updated
+*/
+static void dump_stations(uint32_t ifindex, struct station *next, uint32_t *count);
+
+/**
+ * \brief Helper function that parses one station of a dump and smooths its statistics with the
+ * previous values of the same station
+ *
+ * \param nl The NL80211_CMD_NEW_STATION message
+ * \param ifindex The interface that was dumped
+ * \param s Filled in with the station
+ *
+ * \return 0 for success, -1 if the message has no station address
+*/
+static int parse_station(struct nlmsghdr *nl, uint32_t ifindex, struct station *s);
+
+/**
+ * \brief Helper function that dumps the stations of the testbed interfaces every metric interval
+ * and publishes the new table to readers. It is used as the start function for the pthread_t
+ * thread of the metrics service
+ *
+*/
+void *thread_func_metric();
+
+#endif
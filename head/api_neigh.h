@@ -0,0 +1,100 @@
+#ifndef API_NEIGH_H
+#define API_NEIGH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <sys/socket.h>         // linux socket API
+#include <linux/netlink.h>      // netlink allows kernel<->userspace communications
+#include <linux/rtnetlink.h>    // rtnetlink allows for modification of routing table
+#include <linux/neighbour.h>    // ndmsg, NDA_* attributes and NUD_* states
+#include <pthread.h>			// API should be thread-safe
+
+#define NEIGH_MAX 1024 // neighbours tracked at once
+#define NEIGH_HASH 1024 // hash buckets for finding a neighbour by address (must be a power of 2)
+
+struct neigh_entry{ // one neighbour in the table
+  struct neigh_info info;
+  int32_t hnext; // next neighbour in the hash bucket (or free list)
+  uint8_t used;
+  uint8_t seen; // set by every update, neigh_load drops the neighbours its dump did not set it on
+};
+
+struct neigh_state{ // neighbour table of one node
+  struct neigh_entry neighs[NEIGH_MAX];
+  int32_t buckets[NEIGH_HASH]; // first neighbour of each hash bucket, -1 if empty
+  int32_t free_list;
+  NeighbourCallback neigh_cb;
+  pthread_mutex_t neigh_lock;
+};
+
+/**
+ * \brief Initializes the (empty) neighbour table. InitializeEvent fills it with one dump of the
+ * kernel's ipv4 neighbours on the testbed interfaces once the event socket is subscribed, and
+ * neighbour events keep it current after that
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeNeigh();
+
+/**
+ * \brief Helper function that allocates the neighbour table of the node the first time it is
+ * needed (RegisterNeighbourCallback can be called before InitializeAPI)
+ *
+ * \return The table, or NULL if it could not be allocated
+*/
+static struct neigh_state *neigh_alloc();
+
+/**
+ * \brief Helper function that parses an RTM_NEWNEIGH or RTM_DELNEIGH message
+ *
+ * \param nl The netlink message
+ * \param n Filled in with the neighbour (address, interface, link-layer address, NUD state)
+ *
+ * \return 0 for success, -1 if the message is not an ipv4 neighbour on a testbed interface
+*/
+static int parse_neigh_msg(struct nlmsghdr *nl, struct neigh_info *n);
+
+/**
+ * \brief Helper function that adds, updates or removes a neighbour in the table
+ *
+ * \param n The neighbour
+ * \param del 1 if the kernel deleted the neighbour, 0 otherwise
+ *
+ * \return 1 if the neighbour just became NUD_FAILED or NUD_STALE, 0 otherwise
+*/
+static int neigh_update(struct neigh_info *n, int del);
+
+/**
+ * \brief Helper function used by the event thread for every neighbour message. Updates the
+ * table and calls the neighbour callback when a neighbour becomes unreachable
+ *
+ * \param nl The RTM_NEWNEIGH or RTM_DELNEIGH message
+*/
+void neigh_event(struct nlmsghdr *nl);
+
+/**
+ * \brief Helper function that dumps the kernel's ipv4 neighbours into the table and removes the
+ * neighbours it no longer has. Used by InitializeEvent and by the event thread after the event
+ * socket overflowed
+ *
+ * \param report 1 to call the neighbour callback for neighbours that became unreachable while
+ * their events were lost, 0 otherwise
+ *
+ * \return 0 for success, -1 for failure
+*/
+int neigh_load(int report);
+
+/**
+ * \brief Helper function that finds the ipv4 address of a neighbour from its MAC address (used to
+ * name the stations reported by nl80211)
+ *
+ * \param ifindex The interface the neighbour is on
+ * \param lladdr The MAC address (6 bytes)
+ *
+ * \return The ipv4 address, or 0 if the neighbour is not in the table
+*/
+uint32_t neigh_by_lladdr(uint32_t ifindex, uint8_t *lladdr);
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef API_POOL_H
+#define API_POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <stddef.h>             // offsetof
+#include <sys/socket.h>         // recvmsg
+#include <stdatomic.h>          // lock-free free list and reference counts
+#include <pthread.h>			// API should be thread-safe
+
+#define CACHE_LINE 64
+#define POOL_BUFFERS 1024 // packet buffers of one node (about 4 MB)
+#define POOL_CONTROL_RESERVE 64 // buffers only the incoming control queue may take
+#define POOL_BUFFER_SIZE 4096 // one recv from a queue socket
+#define POOL_RECV_MAX 128000 // largest recv from a queue socket (a whole 64 KB packet and its attributes)
+#define POOL_COPY_RANGE 0xffff // bytes of each packet copied from the kernel (all of it)
+
+struct pkt_buf{ // one packet buffer: a whole recv, and the packet a hold keeps in it
+  uint8_t     data[POOL_BUFFER_SIZE] __attribute__ ((aligned(CACHE_LINE)));
+  atomic_uint refs; // the receiving thread and every hold or clone
+  int32_t     next; // free list
+  uint8_t     held; // pkt is kept by a hold
+  struct pool_state *pool; // pool the buffer goes back to
+  uint8_t     *big; // whole recv when it did not fit in data (malloc, freed with the buffer), else NULL
+  int32_t     big_len;
+  struct packet pkt;
+};
+
+struct pool_state{ // packet buffers of one node
+  struct pkt_buf *bufs; // POOL_BUFFERS buffers, allocated by InitializePool
+  _Atomic uint64_t free_top; // free list: tag << 32 | (index + 1), index 0 when empty (the tag stops ABA)
+  atomic_uint in_use;
+  atomic_uint peak;
+  atomic_uint held;
+  _Atomic uint64_t waits;
+  _Atomic uint64_t copies;
+  atomic_int  waiters; // queue threads sleeping in pool_get
+  pthread_mutex_t wait_lock;
+  pthread_cond_t wait_cond; // signalled by pool_put while there are waiters
+};
+
+/**
+ * \brief Initializes the packet buffer pool: allocates every buffer once, so receiving, holding
+ * and releasing packets never calls malloc
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializePool();
+
+/**
+ * \brief Helper function that takes a free buffer with one reference. Lock-free unless it has
+ * to wait
+ *
+ * \param wait 1 to sleep until a held packet is released if the caller's share of the pool is
+ * in use, 0 to return NULL instead
+ * \param control 1 for the incoming control queue, which may also take the last
+ * POOL_CONTROL_RESERVE buffers
+ *
+ * \return The buffer, or NULL if the pool is empty
+*/
+struct pkt_buf *pool_get(int wait, int control);
+
+/**
+ * \brief Helper function that pops a buffer from the free list after admit counted it in use
+ *
+ * \param st The node's pool
+ *
+ * \return The buffer
+*/
+static struct pkt_buf *pop_buf(struct pool_state *st);
+
+/**
+ * \brief Helper function that counts one more buffer in use if fewer than limit are
+ *
+ * \param st The node's pool
+ * \param limit Buffers the caller may use in total
+ *
+ * \return 1 if the caller may take a buffer, 0 otherwise
+*/
+static int admit(struct pool_state *st, uint32_t limit);
+
+/**
+ * \brief Helper function that drops one reference to a buffer, returning it to its pool when it
+ * was the last. Lock-free
+ *
+ * \param b The buffer
+*/
+void pool_put(struct pkt_buf *b);
+
+/**
+ * \brief Helper function used by the queue receive loops to receive one batch of packets into a
+ * buffer. A recv larger than the buffer (packets above about 4 KB) spills into tail and is then
+ * copied into one heap block that belongs to the buffer, so big packets arrive whole and can be
+ * held like any other
+ *
+ * \param fd The queue socket
+ * \param b The buffer, from pool_get
+ * \param tail Scratch space of POOL_RECV_MAX - POOL_BUFFER_SIZE bytes for the rest of a big recv
+ * \param flags Flags for recvmsg
+ *
+ * \return Bytes received (at pool_data(b)), or the result of recvmsg if it failed. -1 with errno
+ * ENOMEM if a big recv could not be copied (the batch is lost)
+*/
+int pool_recv(int fd, struct pkt_buf *b, uint8_t *tail, int flags);
+
+/**
+ * \brief Helper function that returns where the last pool_recv into a buffer put its data
+ *
+ * \param b The buffer
+ *
+ * \return b->big for a big recv, b->data otherwise
+*/
+uint8_t *pool_data(struct pkt_buf *b);
+
+/**
+ * \brief Helper function used by the queue receive loops to tell packet_start which buffer the
+ * packets being handled were received into
+ *
+ * \param b The buffer, or NULL after the batch
+*/
+void pool_receiving(struct pkt_buf *b);
+
+/**
+ * \brief Helper function used by the queue handlers that returns the packet being handled: the
+ * struct packet of its receive buffer, or a scratch one if that buffer already keeps another held
+ * packet. The handlers pass its info to the user, so HoldPacket can find the buffer
+ *
+ * \param data The packet, from the ip header on (inside the receive buffer)
+ * \param len Length of data
+ *
+ * \return The packet, valid until the handler returns unless it is held
+*/
+struct packet *packet_start(uint8_t *data, int32_t len);
+
+/**
+ * \brief Helper function that keeps a packet from packet_start after its handler returns. A packet
+ * in its receive buffer only gains a reference; a scratch packet is copied into a free buffer
+ *
+ * \param pkt The packet
+ *
+ * \return The held packet, or NULL if a copy was needed and every buffer is in use
+*/
+struct packet *packet_hold(struct packet *pkt);
+
+#endif
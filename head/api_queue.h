@@ -12,22 +12,30 @@
 #include <linux/netfilter.h>
 #include <libnetfilter_queue/libnetfilter_queue.h>
 #include <linux/ip.h> // for IP header
+#include "../manet_testbed.h" // for CallbackFunction and struct packet_info
 
 #define QUEUE_LEN 100000
-// define queue numbers
-
-typedef uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length); 
-
-// store registered callback functions from user
-CallbackFunction incoming_control;
-CallbackFunction incoming_data;
-CallbackFunction outgoing;
-CallbackFunction forwarded;
-
-pthread_t in_thread_control; // to pull from incoming control plane queue
-pthread_t in_thread_data; // to pull from incoming data plane queue
-pthread_t out_thread; // to pull from outgoing queue
-pthread_t forward_thread; // to pull from forward queue
+#define NUM_QUEUES (QUEUE_IN_DATA + 1) // queue numbers (QUEUE_IN_CONTROL ... in manet_testbed.h) index per-queue arrays
+
+struct queue_state{ // queues of one node
+  // store registered callback functions from user
+  CallbackFunction incoming_control;
+  CallbackFunction incoming_data;
+  CallbackFunction outgoing;
+  CallbackFunction forwarded;
+
+  pthread_t in_thread_control; // to pull from incoming control plane queue
+  pthread_t in_thread_data; // to pull from incoming data plane queue
+  pthread_t out_thread; // to pull from outgoing queue
+  pthread_t forward_thread; // to pull from forward queue
+
+  struct queue_sched sched[NUM_QUEUES]; // scheduling of each queue thread, from SetQueueScheduling
+  uint8_t sched_set[NUM_QUEUES];
+  pid_t tids[NUM_QUEUES]; // kernel thread ids of the running queue threads (0 if not running)
+  pthread_mutex_t sched_lock; // sched, sched_set and tids
+  struct nfq_handle *control_h; // control queue in event loop mode, drained before every data batch
+  struct nfq_handle *loop_h[NUM_QUEUES]; // handles the event loop reads, closed by DestroyTestbed
+};
 
 // size of ipv4 pseudoheader + udp header
 #define IP_UDP_HDR_OFFSET 28 
@@ -101,6 +109,96 @@ int handle_outgoing(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_
 */
 int handle_forwarded(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_data *nfa, void *data);
 
+/**
+ * \brief Helper function that allocates the node's queue state on first use (InitializeQueue,
+ * a Register*Callback or SetQueueScheduling)
+ *
+ * \return the node's queue state, NULL if it could not be allocated
+*/
+static struct queue_state *queue_alloc();
+
+/**
+ * \brief Helper function that opens the library handle of a queue. Run with ns_run, so the
+ * handle's netlink socket is opened in the node's namespace
+ *
+ * \param arg Pointer to the handle to fill in (NULL for failure)
+ *
+ * \return 0
+*/
+static int open_handle(void *arg);
+
+/**
+ * \brief Helper function that opens a netfilter queue in copy mode with the given packet handler
+ * 
+ * \param num The queue number (QUEUE_IN_CONTROL, QUEUE_IN_DATA, QUEUE_OUT or QUEUE_FORWARD)
+ * \param cb The handler called by nfq_handle_packet for each packet of the queue
+ * \param qh Filled in with the queue handle
+ * 
+ * \return The library handle, or NULL for failure
+*/
+static struct nfq_handle *open_queue(uint16_t num, nfq_callback *cb, struct nfq_q_handle **qh);
+
+/**
+ * \brief Helper function that applies the scheduling set by SetQueueScheduling to a running queue
+ * thread (sched_lock held)
+ * 
+ * \param num The queue number
+ * 
+ * \return 0 for success, -1 for failure
+*/
+static int apply_sched(uint16_t num);
+
+/**
+ * \brief Helper function that opens a queue and pulls packets from it until its socket fails.
+ * Used by the thread of each queue
+ * 
+ * \param num The queue number
+ * \param cb The handler of the queue's packets
+*/
+static void run_queue(uint16_t num, nfq_callback *cb);
+
+/**
+ * \brief Helper function that closes the library handle of a queue thread that DestroyTestbed
+ * cancelled while it waited for packets
+ *
+ * \param h The library handle of the queue
+*/
+static void close_queue(void *h);
+
+/**
+ * \brief Helper function that receives one batch of packets from a queue socket into a pool buffer
+ * without waiting, and handles them. Used by the event loop
+ * 
+ * \param fd The socket of the queue
+ * \param h The library handle of the queue
+ * 
+ * \return Bytes received, 0 or -1 if there was nothing to receive (or no free buffer)
+*/
+static int recv_batch(int fd, struct nfq_handle *h);
+
+/**
+ * \brief Helper function that reads one batch of packets from a queue when the event loop finds
+ * its socket readable. Before a batch of any other queue, the control queue is drained, so
+ * routing control messages never wait behind data
+ * 
+ * \param fd The socket of the queue
+ * \param arg The library handle of the queue
+*/
+static void loop_queue(int fd, void *arg);
+
+/**
+ * \brief Helper function that starts pulling packets from a queue: with its own thread by
+ * default, or from the event loop if one was selected with SetEventLoopMode
+ * 
+ * \param num The queue number
+ * \param cb The handler of the queue's packets
+ * \param thread Filled in with the thread of the queue (thread mode only)
+ * \param func The start function of the thread
+ * 
+ * \return 0 for success, -1 for failure
+*/
+static int start_queue(uint16_t num, nfq_callback *cb, pthread_t *thread, void *(*func)());
+
 /**
  * \brief Helper function to pull packets from the incoming control plane queue. It is used as the start function for the 
  * pthread_t thread that pulls from the queue of incoming control plane packets
@@ -8,23 +8,77 @@
 #include <sys/socket.h>         // linux socket API
 #include <linux/netlink.h>      // netlink allows kernel<->userspace communications
 #include <linux/rtnetlink.h>    // rtnetlink allows for modification of routing table
+#include <linux/fib_rules.h>    // policy rules that select the API's routing table
 #include <pthread.h>			// API should be thread-safe
 
+#define ROUTE_BATCH_BUFLEN 32768 // max bytes of route requests sent in one netlink message
+#define ROUTE_BATCH_MAX 1024 // max route requests sent in one netlink message
+#define ROUTE_RULE_PRIORITY 1000 // rule for the API's table, looked up before main (32766)
+#define RT_TABLES_FILE "/etc/iproute2/rt_tables" // names of numbered tables
+
 struct rt_request{ // buffer to hold formed rtnetlink request
   struct nlmsghdr nl;
   struct rtmsg    rt;
   char            buf[BUFLEN];
 };
 
+typedef int (*route_builder) (struct rt_request *req, uint32_t i, void *arg); // forms request i of a batch, returns its length
+typedef void (*route_result) (uint32_t i, int error, void *arg); // called with the kernel's answer to request i
+
+struct route_state{ // routing table settings of one node
+  uint32_t route_table; // table the API adds routes to (RT_TABLE_MAIN until SwitchRoutingTable)
+  pthread_mutex_t table_lock; // SwitchRoutingTable and FlushRoutingTable
+  int kernel_expiry; // whether the kernel enforces RTA_EXPIRES (-1 until probed)
+};
+
 /**
- * \brief Initializes functions related to modifying routes (UNUSED)
+ * \brief Initializes functions related to modifying routes. Allocates the routing table
+ * settings of the node (the main table until SwitchRoutingTable)
  * 
  * \return 0 for success, -1 for failure
 */
 int InitializeRoute();
 
 /**
- * \brief Helper function that forms and sends a netlink message to modify a unicast route in the main routing table
+ * \brief Helper function that appends an attribute to a netlink message
+ * 
+ * \param nl The netlink message, nlmsg_len is updated
+ * \param type The attribute type
+ * \param data The attribute value (may be NULL if len is 0)
+ * \param len The size of data
+ * 
+ * \return Pointer to the attribute (used to fix up the length of nested attributes)
+*/
+static struct rtattr *add_attr(struct nlmsghdr *nl, uint16_t type, void *data, uint16_t len);
+
+/**
+ * \brief Helper function that forms a netlink message to modify a route in the API's routing
+ * table. Routes with several next hops are sent as RTA_MULTIPATH
+ * 
+ * \param req The request to fill in
+ * \param domain Indicates which family the netlink message should be formed for (only ipv4 supported)
+ * \param route The destination subnet, metric and next hops of the route
+ * \param action The netlink action required for the netlink message (should always be RTM_NEWROUTE or RTM_DELROUTE)
+ * 
+ * \return The length of the netlink message
+*/
+int build_route(struct rt_request *req, int domain, struct route_spec *route, uint8_t action);
+
+/**
+ * \brief Helper function that forms a netlink message to modify a unicast host route in the API's routing table
+ * 
+ * \param req The request to fill in
+ * \param domain Indicates which family the netlink message should be formed for (only ipv4 supported)
+ * \param dest The destination address (ipv4)
+ * \param nexthop The address for where the route should use as its gateway (the next hop needed by the routing protocol)
+ * \param action The netlink action required for the netlink message (should always be RTM_NEWROUTE or RTM_DELROUTE)
+ * 
+ * \return The length of the netlink message
+*/
+int build_request(struct rt_request *req, int domain, uint32_t dest, uint32_t nexthop, uint8_t action);
+
+/**
+ * \brief Helper function that forms and sends a netlink message to modify a unicast route in the API's routing table
  * 
  * \param sa The struct sockaddr_nl pointer to indicate what family (ipv4) the netlink message is for
  * \param domain Indicates which family the netlink message should be formed for (only ipv4 supported)
@@ -32,7 +86,7 @@ int InitializeRoute();
  * \param nexthop The address for where the route should use as its gateway (the next hop needed by the routing protocol)
  * \param action The netlink action required for the netlink message (should always be RTM_NEWROUTE or RTM_DELROUTE)
  * 
- * \return 0 for success, -1 for failure
+ * \return The sequence number of the request, or -1 for failure
 */
 static int form_request(struct sockaddr_nl *sa, int domain, uint32_t dest, uint32_t nexthop, uint8_t action);
 
@@ -46,6 +100,116 @@ static int form_request(struct sockaddr_nl *sa, int domain, uint32_t dest, uint3
 */
 uint32_t parse_nl_route_msg(void *buf, size_t len);
 
+/**
+ * \brief Helper function that waits for the kernel's ACK of a request sent with nl_send
+ * 
+ * \param sa The struct sockaddr_nl pointer used to send the request
+ * \param seq The sequence number returned by nl_send (-1 if sending failed)
+ * 
+ * \return 0 for success, or a negative errno from the kernel
+*/
+static int get_ack(struct sockaddr_nl *sa, int seq);
+
+/**
+ * \brief Helper function that asks the kernel for a route and checks whether it kept its
+ * RTA_EXPIRES, to find out if the kernel enforces route expiry for ipv4
+ * 
+ * \param sa The struct sockaddr_nl pointer to indicate what family (ipv4) the netlink message is for
+ * \param dest The destination of a route that was just added with an expiry
+ * 
+ * \return 1 if the route has an expiry in the kernel, 0 otherwise
+*/
+static int probe_expiry(struct sockaddr_nl *sa, uint32_t dest);
+
+/**
+ * \brief Helper function that gives a route that was just added its expiry: recorded for the
+ * event feed if the kernel enforces it, otherwise handed to the route lifetime wheel
+ * 
+ * \param sa The struct sockaddr_nl pointer to indicate what family (ipv4) the netlink message is for
+ * \param route The route that was added
+ * 
+ * \return 0 for success, -1 if the route cannot be expired
+*/
+static int track_expiry(struct sockaddr_nl *sa, struct route_spec *route);
+
+/**
+ * \brief Helper function that sends one route change to the kernel, waits for the result,
+ * and updates the userspace mirror
+ * 
+ * \param route The route to add or remove
+ * \param action RTM_NEWROUTE or RTM_DELROUTE
+ * 
+ * \return 0 for success, -1 for failure
+*/
+static int send_route(struct route_spec *route, uint8_t action);
+
+/**
+ * \brief Helper function that adds or removes the policy rule (priority ROUTE_RULE_PRIORITY)
+ * that sends every lookup to a table before the main table
+ * 
+ * \param sa The struct sockaddr_nl pointer to indicate what family (ipv4) the netlink message is for
+ * \param table The table number
+ * \param action RTM_NEWRULE or RTM_DELRULE
+ * 
+ * \return 0 for success, -1 for failure
+*/
+static int form_rule(struct sockaddr_nl *sa, uint32_t table, uint16_t action);
+
+/**
+ * \brief Helper function that converts a table label to its number
+ * 
+ * \param label A decimal table number, "main", or a name from RT_TABLES_FILE
+ * 
+ * \return The table number, or 0 if it is unknown
+*/
+static uint32_t table_id(char *label);
+
+/**
+ * \brief Helper function that dumps the ipv4 unicast routes of one table
+ * 
+ * \param sa The struct sockaddr_nl pointer to indicate what family (ipv4) the netlink message is for
+ * \param table The table number
+ * \param out_len Set to the number of bytes returned
+ * \param out_count Set to the number of routes returned
+ * 
+ * \return A malloc'd buffer of RTM_NEWROUTE messages (freed by the caller), or NULL for failure
+*/
+static char *dump_table(struct sockaddr_nl *sa, uint32_t table, uint32_t *out_len, uint32_t *out_count);
+
+
+/**
+ * \brief Helper function that sends many route requests in as few netlink messages as possible
+ * on the calling thread's socket, then collects the ACKs and matches them by sequence number.
+ * Used by ApplyRouteBatch and the route sync manager
+ * 
+ * \param count Number of requests
+ * \param build Called to form request i (0 to count-1)
+ * \param result Called once for every request with 0 or a negative errno
+ * \param arg Passed to build and result
+ * 
+ * \return The number of requests that failed
+*/
+uint32_t route_batch(uint32_t count, route_builder build, route_result result, void *arg);
+
+/**
+ * \brief Helper function that forms request i of ApplyRouteBatch
+ * 
+ * \param req The request to fill in
+ * \param i Index into the route_op array
+ * \param arg The route_op array
+ * 
+ * \return The length of the netlink message
+*/
+static int build_op(struct rt_request *req, uint32_t i, void *arg);
+
+/**
+ * \brief Helper function that stores the result of request i of ApplyRouteBatch and updates the mirror
+ * 
+ * \param i Index into the route_op array
+ * \param error 0 or a negative errno from the kernel
+ * \param arg The route_op array
+*/
+static void op_result(uint32_t i, int error, void *arg);
 
 #endif
 
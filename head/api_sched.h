@@ -0,0 +1,100 @@
+#ifndef API_SCHED_H
+#define API_SCHED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>			// API should be thread-safe
+
+#define SCHED_BACKLOG_LEN 64 // max messages waiting per message class
+
+struct sched_msg{ // one control message waiting for a token
+  uint32_t dest;
+  int      type; // broadcast(1) or unicast(0)
+  int      ifindex; // interface to send on (0 for any)
+  uint32_t size;
+  uint8_t  *buf; // private copy of the user's buffer
+};
+
+struct token_bucket{ // rate limiter and backlog for one message class
+  double   rate; // tokens added per second (0 = unlimited)
+  double   burst; // max tokens that can be saved up
+  double   tokens;
+  struct timespec last; // last time tokens were added
+  struct sched_msg backlog[SCHED_BACKLOG_LEN]; // ring buffer, oldest at head
+  uint32_t head;
+  uint32_t count;
+  uint32_t dropped; // messages dropped because the backlog was full
+};
+
+struct sched_state{ // rate limited control traffic of one node
+  struct token_bucket buckets[NUM_MSG_CLASSES];
+  uint32_t backlog_total; // messages waiting across all classes
+  pthread_mutex_t sched_lock;
+  pthread_cond_t sched_cond;
+  pthread_t sched_thread;
+  int drain_timer; // StartTimer id that drains the backlog in event loop mode, -1 if none
+};
+
+/**
+ * \brief Initializes the send scheduler. Sets the default per-class rate limits and
+ * starts the thread that drains the backlog (in event loop mode a timer drains it instead)
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeSched();
+
+/**
+ * \brief Sends a message through the scheduler. The message is sent right away if the
+ * backlog is empty and its class has a token, otherwise it is copied into the backlog
+ * of its class (dropping the oldest message of that class if the backlog is full)
+ *
+ * \param dest_address The destination ipv4 address (ignored for broadcast)
+ * \param msg_buf Buffer containing the contents of the message to send
+ * \param size Size of the message to be sent
+ * \param type Indicates if the message is broadcast(1) or unicast(0)
+ * \param msg_class The message class, one of the MSG_CLASS_* definitions
+ * \param ifindex The interface to send on, or 0 for any (see send_sock_msg)
+ *
+ * \return 0 for success (sent or queued), -1 for failure
+*/
+int sched_send(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, int type, uint8_t msg_class, int ifindex);
+
+/**
+ * \brief Helper function that takes the highest priority queued message whose class has a token.
+ * Called with sched_lock held
+ *
+ * \param m Filled with the message, whose buffer the caller frees after sending it
+ * \param wait Set to the seconds until the next token of a class with a backlog, or -1 if none
+ *
+ * \return 1 if a message was taken, 0 otherwise
+*/
+static int sched_next(struct sched_msg *m, double *wait);
+
+/**
+ * \brief Helper function that arms the drain timer if there is a backlog and no timer is armed
+ * (event loop mode). Called with sched_lock held
+ *
+ * \param delay Time (ms) until the backlog is drained
+*/
+static void arm_drain(uint32_t delay);
+
+/**
+ * \brief Helper function used as the drain timer's callback in event loop mode. Sends queued
+ * messages while their classes have tokens, then re-arms itself for the next token
+ *
+ * \param arg Unused
+*/
+static void sched_drain(void *arg);
+
+/**
+ * \brief Helper function to drain the backlog in priority order. It is used as the start
+ * function for the pthread_t thread that sends queued control messages
+ *
+*/
+void *thread_func_sched();
+
+#endif
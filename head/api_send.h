@@ -11,8 +11,21 @@
 #include <arpa/inet.h>          // for converting ip addresses to binary
 #include <net/if.h>             // for converting network interface names to binary
 #include <pthread.h>			
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/net_tstamp.h>   // SO_TIMESTAMPING flags
+#include <linux/errqueue.h>     // struct scm_timestamping
+#include <linux/sockios.h>      // SIOCSHWTSTAMP
 
-int sock; // UDP socket for communcations between nodes
+struct send_state{ // sockets of one node
+  int sock; // UDP socket for communcations between nodes
+  uint32_t ts_key; // key of the next timestamped send on sock (SOF_TIMESTAMPING_OPT_ID)
+  pthread_mutex_t ts_lock; // one timestamped send at a time
+};
+
+#define CONTROL_SO_PRIORITY 6 // TC_PRIO_INTERACTIVE, highest priority allowed without CAP_NET_ADMIN
+#define CONTROL_DSCP 48 // CS6 (network control)
+#define TX_TIMESTAMP_TIMEOUT 10 // ms to wait for the kernel to report the tx timestamps of a send
 
 /**
  * \brief Initializes functions related to sending UDP messages by opening a 
@@ -23,17 +36,31 @@ int sock; // UDP socket for communcations between nodes
 int InitializeSend();
 
 /**
- * \brief Formats and sends a message on socket sock, either broadcast or unicast. Only supports
- * sending broadcast within the network (192.168.1.X)
+ * \brief Formats and sends a message, either broadcast or unicast. Broadcasts are sent to the
+ * broadcast address of each interface on that interface's socket, and succeed if it was sent on
+ * at least one of them. Unicasts are sent on socket
+ * sock and routed by the kernel, unless an interface is given
  * 
  * \param dest_address The destination ipv4 address
  * \param msg_buf Buffer containing the contents of the message to send
  * \param header Parameter to provide a custom header to the UDP packet (UNUSED)
  * \param type Indicates if the message is broadcast(1) or unicast(0)
  * \param size Size of the message to be sent
+ * \param ifindex The interface to send on, or 0 for all interfaces (broadcast) or the kernel's choice (unicast)
  * 
  * \return number of bytes sent, or -1 for failure
 */
-int send_sock_msg(uint32_t dest_address, uint8_t *msg_buf, uint8_t *header, int type, uint32_t size);
+int send_sock_msg(uint32_t dest_address, uint8_t *msg_buf, uint8_t *header, int type, uint32_t size, int ifindex);
+
+/**
+ * \brief Opens a UDP socket bound to one interface with SO_BINDTODEVICE, with the same options
+ * (broadcast, priority, DSCP) as socket sock
+ * 
+ * \param name The name of the interface
+ * \param hw_stamps Set to 1 if the nic timestamps packets in hardware, 0 otherwise
+ * 
+ * \return The socket, or -1 for failure
+*/
+int open_if_sock(char *name, uint8_t *hw_stamps);
 #endif
 
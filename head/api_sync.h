@@ -0,0 +1,96 @@
+#ifndef API_SYNC_H
+#define API_SYNC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>			// API should be thread-safe
+
+#define SYNC_MAX_ROUTES 4096 // routes the sync manager can own
+
+struct sync_entry{ // one destination seen while comparing the desired and installed tables
+  struct route_spec *old; // installed route, NULL if there was none
+  struct route_spec *new; // desired route, NULL if it should be removed
+  int32_t del; // index of its delete in the change list, -1 if none
+  int32_t add; // index of its add in the change list, -1 if none
+};
+
+struct sync_change{ // one route request sent by SyncRoutes
+  struct route_spec *route;
+  uint8_t action; // RTM_NEWROUTE or RTM_DELROUTE
+  int error; // kernel's answer
+};
+
+struct sync_state{ // routes owned by the sync manager of one node
+  struct route_spec installed[SYNC_MAX_ROUTES]; // routes owned by the manager, sorted
+  uint32_t num_installed;
+  pthread_mutex_t sync_lock;
+};
+
+/**
+ * \brief Helper function that orders routes by destination and prefix length
+ *
+ * \param a Pointer to the first struct route_spec
+ * \param b Pointer to the second struct route_spec
+ *
+ * \return <0, 0 or >0 like strcmp
+*/
+int route_cmp(const void *a, const void *b);
+
+/**
+ * \brief Helper function that allocates the node's copy of installed routes on first use
+ *
+ * \return the node's sync state, NULL if it could not be allocated
+*/
+static struct sync_state *sync_alloc();
+
+/**
+ * \brief Helper function that forms request i of a sync (used with route_batch)
+ *
+ * \param req The request to fill in
+ * \param i Index into the change list
+ * \param arg The change list
+ *
+ * \return The length of the netlink message
+*/
+static int build_change(struct rt_request *req, uint32_t i, void *arg);
+
+/**
+ * \brief Helper function that stores the result of request i of a sync and updates the mirror
+ *
+ * \param i Index into the change list
+ * \param error 0 or a negative errno from the kernel
+ * \param arg The change list
+*/
+static void change_result(uint32_t i, int error, void *arg);
+
+/**
+ * \brief Helper function that drops a route from the routes the sync manager installed, once it
+ * was removed from the kernel outside SyncRoutes. Called for route deletes made by the API and
+ * for route delete events
+ *
+ * \param dest The destination of the route
+ * \param prefix_len The prefix length of the destination
+ * \param metric The metric of the route (the delete of an old metric when SyncRoutes changed it
+ * must not drop the new route)
+*/
+void sync_forget(uint32_t dest, uint8_t prefix_len, uint32_t metric);
+
+/**
+ * \brief Helper function that drops the routes the kernel no longer has from the routes the sync
+ * manager installed. Called by fib_resync, since route delete events may have been lost
+ *
+ * \param routes Every route of the API's table (destination, prefix length and metric), sorted
+ * by this function
+ * \param count Number of routes
+*/
+void sync_resync(struct route_spec *routes, uint32_t count);
+
+/**
+ * \brief Helper function that forgets every route the sync manager installed. Called when the
+ * API's table is flushed or switched
+*/
+void sync_reset();
+
+#endif
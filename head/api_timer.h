@@ -0,0 +1,96 @@
+#ifndef API_TIMER_H
+#define API_TIMER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/timerfd.h>        // wakes the timer thread (or the event loop) at the next due slot
+#include <pthread.h>			// API should be thread-safe
+
+#define TIMER_INDEX_BITS 17
+#define TIMER_MAX (1 << TIMER_INDEX_BITS) // timers active at once (ids carry a generation above the index)
+
+// hierarchical timing wheel with 1 ms ticks: level 0 holds the next 256 ms, each slot of a higher
+// level covers a whole turn of the level below it and is cascaded down when that turn starts
+#define TIMER_WHEEL0_BITS 8
+#define TIMER_WHEELN_BITS 6 // bits of levels 1 to TIMER_LEVELS
+#define TIMER_LEVELS 3
+#define TIMER_WHEEL0_SIZE (1 << TIMER_WHEEL0_BITS)
+#define TIMER_WHEELN_SIZE (1 << TIMER_WHEELN_BITS)
+#define TIMER_SPAN ((uint64_t)1 << (TIMER_WHEEL0_BITS + TIMER_LEVELS * TIMER_WHEELN_BITS)) // ms the wheel can hold (about 18 hours)
+
+struct wheel_timer{ // one protocol timer
+  uint64_t      expires; // tick the timer fires at
+  uint32_t      interval; // ms between expiries, 0 for a one-shot timer
+  TimerCallback cb;
+  void          *arg;
+  int32_t       wprev; // neighbours in the wheel slot or due list (wnext is also the free list)
+  int32_t       wnext;
+  int32_t       *slot; // head of the wheel slot or due list the timer is in
+  uint16_t      gen; // bumped when the timer is freed, so stale ids are refused
+  uint8_t       used;
+};
+
+struct timer_state{ // protocol timers of one node
+  struct wheel_timer *timers; // TIMER_MAX timers, allocated by InitializeTimer
+  int32_t free_list;
+  int32_t wheel0[TIMER_WHEEL0_SIZE];
+  int32_t wheeln[TIMER_LEVELS][TIMER_WHEELN_SIZE];
+  int32_t due; // timers that fired and wait for their callback, in firing order
+  int32_t due_tail;
+  uint64_t cur_tick; // last tick processed
+  uint64_t armed_tick; // tick the timerfd fires at, 0 if disarmed
+  struct timespec start; // time of tick 0
+  uint32_t active;
+  int timer_fd;
+  pthread_mutex_t timer_lock; // timers and wheel
+  pthread_t timer_thread;
+};
+
+/**
+ * \brief Allocates and initializes the protocol timers and starts the thread that runs their callbacks, or adds
+ * the wheel's timerfd to the event loop if one was selected with SetEventLoopMode
+ *
+ * \return 0 for success, -1 for failure
+*/
+int InitializeTimer();
+
+/**
+ * \brief Helper function that puts a timer in the wheel slot (or due list) for its expiry,
+ * relative to cur_tick. O(1)
+ *
+ * \param i The timer
+*/
+static void timer_insert(int32_t i);
+
+/**
+ * \brief Helper function that removes a timer from its wheel slot or the due list. O(1)
+ *
+ * \param i The timer
+*/
+static void timer_unlink(int32_t i);
+
+/**
+ * \brief Helper function that sets the timerfd to the next tick that has timers (or the next
+ * cascade), and disarms it when there are no timers
+*/
+static void arm_wheel();
+
+/**
+ * \brief Helper function that advances the wheel to the current time and runs the callbacks of
+ * the timers that fired, one at a time without the lock held (so callbacks can start and stop
+ * timers)
+*/
+void run_timers();
+
+/**
+ * \brief Helper function that runs the timers whenever the timerfd fires. It is used as the
+ * start function for the pthread_t thread of the timer service
+ *
+*/
+void *thread_func_timer();
+
+#endif
@@ -3,7 +3,7 @@
 
 /*
 Andre Koka - Created 10/2/2023
-             Last Updated: 11/9/2023
+             Last Updated: 10/19/2026
 
 Header file for MANET Testbed API. Includes definitions for all global variables 
 and function that are visibile to the user (routing protocol tester)
@@ -21,21 +21,197 @@ and function that are visibile to the user (routing protocol tester)
 #include <arpa/inet.h>          // definitions of internet operations
 #include <net/if.h>             // for managing network interfaces
 #include <pthread.h>
+#include <time.h>
+
+#define ROUTE_ADD 0 // route_op actions
+#define ROUTE_DELETE 1
+#define ROUTE_PENDING 1 // route_op.error while waiting for the kernel (real results are <= 0)
 
 #define PACKET_ACCEPT 1
 #define PACKET_DROP 0
 
-typedef uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length); 
+// netfilter queue numbers, for SetQueueScheduling
+#define QUEUE_IN_CONTROL 0
+#define QUEUE_OUT 1
+#define QUEUE_FORWARD 2
+#define QUEUE_IN_DATA 4
+
+// control message classes for the send scheduler, highest priority first
+#define MSG_CLASS_RERR    0
+#define MSG_CLASS_RREP    1
+#define MSG_CLASS_HELLO   2
+#define MSG_CLASS_RREQ    3
+#define MSG_CLASS_DEFAULT 4 // used by SendUnicast() and SendBroadcast()
+#define NUM_MSG_CLASSES   5
+
+#define RREQ_RATELIMIT 10 // default max RREQ messages per second (RFC 3561)
+#define RERR_RATELIMIT 10 // default max RERR messages per second (RFC 3561)
+
+#define DEFAULT_DUP_HOLD_TIME 5600 // ms a duplicate key is remembered (AODV PATH_DISCOVERY_TIME)
+
+#define DEFAULT_METRIC_INTERVAL 1000 // ms between nl80211 station statistics dumps
+
+#define EVENT_LOOP_OFF    0 // event loop modes: one thread per queue and for events (default)
+#define EVENT_LOOP_USER   1 // the user runs the loop with RunEventLoop()
+#define EVENT_LOOP_THREAD 2 // one API thread runs the loop
+
+#define EVENT_ROUTE_ADD 0 // net_event types
+#define EVENT_ROUTE_DEL 1
+#define EVENT_ADDR_ADD  2
+#define EVENT_ADDR_DEL  3
+#define EVENT_LINK_UP   4
+#define EVENT_LINK_DOWN 5
+#define EVENT_ROUTE_EXPIRED 6 // a route with a lifetime or expiry was deleted because it expired
+
+struct packet_info{ // extra information about a queued packet, passed to every callback
+  uint32_t in_ifindex; // interface the packet arrived on (0 if locally generated)
+  uint32_t out_ifindex; // interface the packet leaves on (0 if not known yet)
+  struct timespec rx_time; // kernel receive timestamp (CLOCK_REALTIME, us resolution, 0 if not received)
+  struct timespec deliver_time; // time the packet was handed to the callback (CLOCK_REALTIME)
+};
+
+struct packet{ // a queued packet kept with HoldPacket, valid until its last ReleasePacket
+  uint8_t  *raw_pack; // from the ip header on
+  uint32_t length; // of raw_pack
+  uint32_t src;
+  uint32_t dest;
+  uint8_t  *payload; // after the ipv4 and udp headers
+  uint32_t payload_length;
+  struct packet_info info;
+};
+
+struct queue_sched{ // scheduling of one queue's receive thread, for SetQueueScheduling
+  uint8_t rt_priority; // SCHED_FIFO priority (1 to 99), 0 for the normal scheduler
+  int8_t  nice; // niceness with the normal scheduler (-20 is the highest priority, 0 the default)
+  int16_t cpu; // CPU the thread is pinned to, -1 for any CPU
+};
+
+struct pool_stats{ // packet buffers of one node, from GetPoolStats
+  uint32_t buffers; // buffers in the pool (the most packets received or held at once)
+  uint32_t buffer_size; // bytes of one buffer, so buffers * buffer_size is all the memory used
+  uint32_t in_use; // buffers receiving or holding packets
+  uint32_t peak; // most buffers in use at once
+  uint32_t held; // HoldPacket and ClonePacket references not released yet (including packets waiting for the protocol worker)
+  uint64_t waits; // times a queue waited for a buffer because every one was held
+  uint64_t copies; // held packets that had to be copied because their buffer kept another packet
+};
+
+struct route_op{ // one route change for ApplyRouteBatch
+  uint8_t  action; // ROUTE_ADD or ROUTE_DELETE
+  uint32_t dest;
+  uint32_t next_hop;
+  int      error; // set by ApplyRouteBatch: 0 for success, or a negative errno from the kernel
+};
+
+#define MAX_NEXT_HOPS 8 // next hops of one multipath route
+
+struct route_hop{ // one next hop of a route_spec
+  uint32_t gateway;
+  uint8_t  weight; // share of the traffic relative to the other next hops (1-255, 0 is the same as 1)
+};
+
+struct route_spec{ // a route for AddRoute and DeleteRoute
+  uint32_t dest; // destination subnet (host bits are ignored)
+  uint8_t  prefix_len; // 0-32, 32 for a host route
+  uint32_t metric; // route priority, lower is preferred (0 for the kernel default)
+  uint8_t  num_hops; // 1 for a normal route, up to MAX_NEXT_HOPS for a multipath route
+  uint32_t expires; // seconds until the route is deleted (0 for never), see AddRoute
+  struct route_hop hops[MAX_NEXT_HOPS];
+};
+
+typedef void (*RouteCallback) (struct route_op *op, void *arg); // called when an async route change completes
+
+struct net_event{ // one change reported by the kernel, passed to the event callback
+  uint8_t  type; // EVENT_ROUTE_ADD, EVENT_ROUTE_DEL, EVENT_ADDR_ADD, ...
+  uint8_t  prefix_len; // routes and addresses
+  uint32_t address; // route destination or interface address (0 for link events)
+  uint32_t next_hop; // routes only, 0 if directly connected
+  uint32_t ifindex;
+  uint32_t table; // routes only
+  uint32_t metric; // routes only (RTA_PRIORITY, 0 for the kernel default)
+};
+
+typedef void (*EventCallback) (struct net_event *ev); // called from the event thread (or loop) for every change
+
+struct neigh_info{ // a link-layer neighbour, passed to the neighbour callback
+  uint32_t address; // ipv4 address of the neighbour
+  uint32_t ifindex; // interface it is reached on
+  uint8_t  lladdr[6]; // MAC address (0 if not resolved)
+  uint16_t state; // NUD_* state from linux/neighbour.h
+};
+
+typedef void (*NeighbourCallback) (struct neigh_info *n); // called from the event thread (or loop) when a neighbour becomes unreachable
+
+struct link_metrics{ // link quality to one station, from nl80211 station statistics
+  uint32_t address; // ipv4 address of the station (0 if it is not in the neighbour table yet)
+  uint32_t ifindex; // interface the station was seen on
+  uint8_t  mac[6];
+  int8_t   signal; // dBm, smoothed
+  uint32_t tx_bitrate; // kbit/s, smoothed
+  uint32_t tx_packets; // totals reported by the driver
+  uint32_t tx_retries;
+  uint32_t tx_failed;
+  uint16_t retry_rate; // retries per 1000 packets sent, smoothed
+  uint16_t fail_rate; // failed packets per 1000 packets sent, smoothed
+};
+
+typedef uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info); 
+
+typedef void (*LoopCallback) (int fd, void *arg); // called from the event loop when fd is readable
+typedef void (*TimerCallback) (void *arg); // called when a timer expires (timer thread or event loop)
+
+typedef struct testbed *TestbedHandle; // one emulated node, created by CreateTestbed
+typedef struct packet *PacketHandle; // a held packet, from HoldPacket or ClonePacket
 
 /**
  * \brief Initializes structures for the MANET Testbed. Required to be called first
- * before using any functions provided by the API.
+ * before using any functions provided by the API. Initializes the node of the calling
+ * thread (see UseTestbed), or the default node if no node was created. Optional features
+ * (jitter, duplicate cache, route lifetimes, SyncRoutes, handoff) allocate their state the
+ * first time they are used
  * 
  * \return 0 for success, -1 for failure
  * 
 */
 int InitializeAPI();
 
+/**
+ * \brief Creates a node. A node owns its sockets, queues, interfaces, route tables and
+ * threads, and lives in a network namespace, so one process can run many emulated nodes
+ * (one per namespace). Programs that run one node do not need to call this. The node holds
+ * no state until InitializeAPI (or a function that needs it) allocates it
+ * 
+ * \param netns The network namespace of the node: a name created with "ip netns add", the path
+ * of a namespace file, or NULL for the namespace of the process
+ * 
+ * \return The new node, or NULL for failure
+*/
+TestbedHandle CreateTestbed(uint8_t *netns);
+
+/**
+ * \brief Selects the node that API calls from the calling thread act on. Call it before
+ * InitializeAPI and the other functions of a node. The calling thread stays in its own network
+ * namespace: the API opens the node's sockets and runs its commands in the node's namespace,
+ * and the threads it starts (including the ones that call the user's callbacks) run there and
+ * use the node that started them, so callbacks do not need to call it
+ * 
+ * \param node The node, from CreateTestbed
+ * 
+ * \return 0 for success, -1 for failure
+*/
+int UseTestbed(TestbedHandle node);
+
+/**
+ * \brief Destroys a node: stops the threads the API started for it, closes its sockets and
+ * queues and frees its state. Threads that used the node go back to the default node. Must not
+ * be called from one of the node's callbacks, and packets still held (HoldPacket) are freed
+ * 
+ * \param node The node, from CreateTestbed (the default node cannot be destroyed)
+ * 
+ * \return 0 for success, -1 for failure
+*/
+int DestroyTestbed(TestbedHandle node);
+
 /**
  * \brief Adds a unicast route to the current routing table. The route follows:
  * ip route add <dest_address> via <next_hop>
@@ -60,15 +236,129 @@ int AddUnicastRoutingEntry(uint32_t dest_address, uint32_t next_hop);
 */
 int DeleteEntry(uint32_t dest_address, uint32_t next_hop);
 
+/**
+ * \brief Adds and deletes many routes at once. The requests are packed into as few netlink
+ * messages as possible (each with its own sequence number) and the kernel's ACKs are collected
+ * afterwards, instead of one round trip per route like AddUnicastRoutingEntry and DeleteEntry
+ * 
+ * \param ops Array of route changes. The error field of each one is set to the kernel's result
+ * \param count Number of entries in ops
+ * 
+ * \return 0 if every route change succeeded, -1 if any failed (see the error fields)
+ * 
+*/
+int ApplyRouteBatch(struct route_op *ops, uint32_t count);
+
+/**
+ * \brief Queues a route change and returns right away. A netlink I/O thread keeps several
+ * route changes in flight on its own socket and completes each one when the kernel answers.
+ * Safe to call from inside queue callbacks
+ * 
+ * \param op The route change. Must stay valid until it completes: op->error is ROUTE_PENDING
+ * until then, and is set to 0 or a negative errno when the kernel answers
+ * \param cb Function called (from the I/O thread) when the route change completes, or NULL
+ * \param arg User pointer passed to cb
+ * 
+ * \return 0 if the route change was queued, -1 for failure (queue full)
+ * 
+*/
+int SubmitRouteAsync(struct route_op *op, RouteCallback cb, void *arg);
+
+/**
+ * \brief Adds (or replaces) a route to a subnet with a metric and one or more next hops. With
+ * more than one next hop the kernel spreads flows over them in proportion to their weights,
+ * for example over disjoint paths found by a multipath routing protocol
+ * 
+ * If route->expires is set, the route is installed with RTA_EXPIRES so the kernel deletes it
+ * without any userspace timer. Kernels that do not enforce RTA_EXPIRES for ipv4 routes are
+ * detected on the first such route; after that, host routes with one next hop and no metric
+ * are expired by the route lifetime wheel instead, and other routes with an expiry fail.
+ * Either way the deletion is reported to the event callback as EVENT_ROUTE_EXPIRED
+ * 
+ * \param route The route to add
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int AddRoute(struct route_spec *route);
+
+/**
+ * \brief Removes a route added with AddRoute (dest, prefix_len and metric must match)
+ * 
+ * \param route The route to remove
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int DeleteRoute(struct route_spec *route);
+
+/**
+ * \brief Makes the routes owned by the sync manager match a desired table, for protocols that
+ * recompute their whole table (for example after each OLSR TC update). Only routes that are
+ * new, gone, or have a different next hop or metric are sent to the kernel, batched into as
+ * few netlink messages as possible. Changed next hops are replaced in place. Routes added with
+ * other API functions are not touched. SyncRoutes(NULL, 0) removes every route it owns
+ * 
+ * \param routes The full desired table (route_spec.expires is ignored)
+ * \param count Number of routes, up to 4096
+ * 
+ * \return 0 for success, -1 if any route change failed (the rest are still applied)
+ */
+int SyncRoutes(struct route_spec *routes, uint32_t count);
+
+/**
+ * \brief Adds a unicast route (like AddUnicastRoutingEntry) that is deleted automatically once
+ * it has not been refreshed for `lifetime` ms, for example AODV's ACTIVE_ROUTE_TIMEOUT. Adding
+ * a route that already has a lifetime replaces its next hop and lifetime
+ * 
+ * \param dest_address The destination address
+ * \param next_hop The gateway of the route
+ * \param lifetime Time in ms the route lives after each refresh
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int AddTimedRoute(uint32_t dest_address, uint32_t next_hop, uint32_t lifetime);
+
+/**
+ * \brief Refreshes a route added with AddTimedRoute, so it lives for another full lifetime.
+ * Cheap enough to call for every packet
+ * 
+ * \param dest_address The destination of the route
+ * 
+ * \return 0 for success, -1 if the route has no lifetime (or already expired)
+ */
+int TouchRoute(uint32_t dest_address);
+
+/**
+ * \brief Sets whether the outgoing and forward queues call TouchRoute for the destination of
+ * every packet they see (enabled by default). Only has an effect once the queue is registered
+ * 
+ * \param enable 1 to refresh routes automatically, 0 to only refresh them with TouchRoute
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int SetRouteAutoRefresh(uint8_t enable);
+
 /** 
- * \brief Switch the current routing table to the table provided (currently unused)
+ * \brief Switch the routing table the API adds routes to. A policy rule is added so the table is
+ * looked up before the main table (lookups that miss fall through to main), and the rule of the
+ * previous table is removed. Keeping protocol routes in their own table keeps the main table
+ * small and lets FlushRoutingTable remove them all at once
  * 
- * \param label The label of the table to switch to or create
+ * \param table The label of the table to switch to or create: a number (1-252, or 256 and up),
+ * a name from /etc/iproute2/rt_tables, or "main" to go back to the main table
  * 
- * \return If the process was a success
+ * \return 0 for success, -1 for failure
 */
 int SwitchRoutingTable(uint8_t *table);
 
+/** 
+ * \brief Deletes every route in the table the API adds routes to (see SwitchRoutingTable), for
+ * when the routing protocol restarts or the experiment ends. The routes are deleted with one
+ * batched netlink send instead of one request per route
+ * 
+ * \return 0 for success, -1 for failure (including when the API still uses the main table)
+*/
+int FlushRoutingTable();
+
 /**
  * \brief Sends a unicast message to the `dest_address`
  * 
@@ -82,7 +372,7 @@ int SwitchRoutingTable(uint8_t *table);
 int SendUnicast(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t *header);
 
 /**
- * \brief Sends a broadcast message to the interface broadcast IP address
+ * \brief Sends a broadcast message to the broadcast IP address of every interface
  *
  * \param[in] message_buffer The buffer to send in the packet (CRC calculated internally)
  * \param[in] header Optionally overwrite the header of the packet
@@ -91,10 +381,116 @@ int SendUnicast(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t
  */
 int SendBroadcast(uint8_t *msg_buf, uint32_t size, uint8_t *header);
 
+/**
+ * \brief Sets the token bucket of a control message class. Messages of a class that is
+ * out of tokens wait in a bounded backlog (oldest dropped first) and are sent in class
+ * priority order as tokens become available. RREQ and RERR default to RREQ_RATELIMIT and
+ * RERR_RATELIMIT, all other classes default to unlimited
+ *
+ * \param msg_class The message class to limit, one of the MSG_CLASS_* definitions
+ * \param rate Messages per second allowed for the class (0 for unlimited)
+ * \param burst Max number of messages that can be sent back-to-back
+ *
+ * \return 0 for success, -1 for failure
+ */
+int SetRateLimit(uint8_t msg_class, uint32_t rate, uint32_t burst);
+
+/**
+ * \brief Sends a unicast control message of the given class through the send scheduler
+ *
+ * \param[in] dest_address The destination ipv4 address
+ * \param[in] msg_buf The buffer to send in the packet (copied if it has to wait)
+ * \param[in] size Size of msg_buf
+ * \param[in] msg_class The message class, one of the MSG_CLASS_* definitions
+ *
+ * \return 0 for success (sent or queued), -1 for failure
+ */
+int SendUnicastClass(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t msg_class);
+
+/**
+ * \brief Broadcasts a control message of the given class through the send scheduler
+ *
+ * \param[in] msg_buf The buffer to send in the packet (copied if it has to wait)
+ * \param[in] size Size of msg_buf
+ * \param[in] msg_class The message class, one of the MSG_CLASS_* definitions
+ *
+ * \return 0 for success (sent or queued), -1 for failure
+ */
+int SendBroadcastClass(uint8_t *msg_buf, uint32_t size, uint8_t msg_class);
+
+/**
+ * \brief Sends a unicast control message on one interface, instead of the interface picked by
+ * the routing table
+ *
+ * \param[in] ifindex The interface to send on (see if_nametoindex)
+ * \param[in] dest_address The destination ipv4 address
+ * \param[in] msg_buf The buffer to send in the packet
+ * \param[in] size Size of msg_buf
+ * \param[in] msg_class The message class, one of the MSG_CLASS_* definitions
+ *
+ * \return 0 for success (sent or queued), -1 for failure
+ */
+int SendUnicastIf(uint32_t ifindex, uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t msg_class);
+
+/**
+ * \brief Broadcasts a control message on one interface only. SendBroadcast() and 
+ * SendBroadcastClass() broadcast on every interface
+ *
+ * \param[in] ifindex The interface to broadcast on (see if_nametoindex)
+ * \param[in] msg_buf The buffer to send in the packet
+ * \param[in] size Size of msg_buf
+ * \param[in] msg_class The message class, one of the MSG_CLASS_* definitions
+ *
+ * \return 0 for success (sent or queued), -1 for failure
+ */
+int SendBroadcastIf(uint32_t ifindex, uint8_t *msg_buf, uint32_t size, uint8_t msg_class);
+
+/**
+ * \brief Sends a unicast message right away (skipping the send scheduler and jitter) and
+ * returns the kernel transmit timestamp of the message. The timestamp is taken by the network
+ * card if it supports hardware timestamps, otherwise by the kernel when the packet is handed
+ * to the driver. Compare with rx_time in the receiver's struct packet_info for one-hop latency
+ *
+ * \param[in] dest_address The destination ipv4 address
+ * \param[in] msg_buf The buffer to send in the packet
+ * \param[in] size Size of msg_buf
+ * \param[out] tx_time The transmit timestamp (CLOCK_REALTIME), or 0 if the kernel gave none
+ *
+ * \return 0 for success, -1 for failure
+ */
+int SendUnicastTimestamped(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, struct timespec *tx_time);
+
+/**
+ * \brief Broadcasts a message right away on one interface (skipping the send scheduler and
+ * jitter) and returns its kernel transmit timestamp, like SendUnicastTimestamped()
+ *
+ * \param[in] ifindex The interface to broadcast on, or 0 for the primary interface
+ * \param[in] msg_buf The buffer to send in the packet
+ * \param[in] size Size of msg_buf
+ * \param[out] tx_time The transmit timestamp (CLOCK_REALTIME), or 0 if the kernel gave none
+ *
+ * \return 0 for success, -1 for failure
+ */
+int SendBroadcastTimestamped(uint32_t ifindex, uint8_t *msg_buf, uint32_t size, struct timespec *tx_time);
+
+/**
+ * \brief Enables RFC 5148 jitter for SendBroadcast() and SendBroadcastClass(). Each broadcast
+ * is held for a random time in [0, jitter] ms and then sent from a timer thread, so neighbours
+ * that rebroadcast the same message do not collide. RFC 5148 suggests HELLO_INTERVAL/4
+ * 
+ * \param jitter The max jitter (MAXJITTER) in ms, or 0 to send broadcasts right away (default)
+ * \param merge If 1, a broadcast is appended to a pending broadcast of the same class (sent as
+ * one packet when the pending timer expires). Only use if the protocol can parse several
+ * messages in one packet
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int SetBroadcastJitter(uint32_t jitter, uint8_t merge);
+
 /**
  * \brief Gets the desired IP address associated with the given interface
  * 
- * \param interface The name of the interface to get the IP address
+ * \param interface The name of the interface to get the IP address (NULL for the primary interface)
  * \param type The type of ip address to get (0 - default, 1 - broadcast)
  * 
  * \return The IP address of the interface or -1 for failure
@@ -102,40 +498,374 @@ int SendBroadcast(uint8_t *msg_buf, uint32_t size, uint8_t *header);
 uint32_t GetInterfaceIP(uint8_t *interface, uint8_t type);
 
 /**
- * \brief Sets the interface for the protocol to that interface (currently unused)
+ * \brief Adds an interface (radio) to the set used by the testbed. Each interface gets its own
+ * UDP socket (bound with SO_BINDTODEVICE) and its own local and broadcast address. The first
+ * interface added is the primary one. If no interface is added before InitializeAPI, "wlan0" is
+ * used. Interfaces should be added before registering callbacks
  * 
  * \param interface The name of the interface to send packets on 
+ * 
+ * \return 0 for success, -1 for failure
  */
 int SetInterface(uint8_t *interface);
 
 /**
- * Planned to-do
- * \brief Search the routing table for a specific entry
+ * \brief Searches the userspace mirror of the routing table for the route to an address
+ * (longest prefix match). The mirror holds every route added through this API, plus the main
+ * table if MirrorMainTable was called. Like the kernel's policy rules, a route of the API's table
+ * (see SwitchRoutingTable) is preferred over any main table route. Does not lock, so it is cheap
+ * enough to call for every packet from queue callbacks
+ * 
+ * \param dest_address The address to find a route to
+ * \param next_hop Filled in with the next hop of the route (0 if directly connected), may be NULL
+ * 
+ * \return 1 if there is a route, 0 if not
+ */
+int SearchTable(uint32_t dest_address, uint32_t *next_hop);
+
+/**
+ * \brief Loads the unicast routes of the kernel's main routing table into the mirror used by
+ * SearchTable (routes added by this API are mirrored automatically)
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int MirrorMainTable();
+
+/**
+ * \brief Registers the provided function to be called for every route, address and link change
+ * the kernel reports (including changes made by other programs). Interface addresses and the
+ * route mirror used by SearchTable are kept in sync with these events whether or not a callback
+ * is registered
+ * 
+ * \param cb Pointer to the desired callback, which should have the form:
+ *           - void (*EventCallback) (struct net_event *ev);
+ *           - called from the event thread (or the event loop), so it should not block. NULL stops the callbacks
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int RegisterEventCallback(EventCallback cb);
+
+/**
+ * \brief Registers the provided function to be called when a neighbour on a testbed interface
+ * becomes NUD_FAILED (the kernel's ARP or unicast probes got no answer) or NUD_STALE (it has not
+ * been confirmed reachable recently). Failures are reported as soon as the kernel detects them,
+ * usually within milliseconds of sending to a lost next hop, so a broken link can be handled
+ * without waiting for missed HELLOs
+ * 
+ * \param cb Pointer to the desired callback, which should have the form:
+ *           - void (*NeighbourCallback) (struct neigh_info *n);
+ *           - called from the event thread (or the event loop), so it should not block. NULL stops the callbacks
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int RegisterNeighbourCallback(NeighbourCallback cb);
+
+/**
+ * \brief Looks up a neighbour in the neighbour table (kept current by neighbour events)
+ * 
+ * \param address The ipv4 address of the neighbour
+ * \param n Filled in with the neighbour if found (may be NULL)
+ * 
+ * \return The NUD state of the neighbour (NUD_REACHABLE, NUD_STALE, NUD_FAILED, ...), or -1 if
+ * the neighbour is not known
+ */
+int GetNeighbourState(uint32_t address, struct neigh_info *n);
+
+/**
+ * \brief Gets the link quality to a neighbour (signal, tx bitrate, retry and failure rates) from
+ * the nl80211 station statistics of the testbed interfaces. The statistics are read once every
+ * metric interval by one thread and smoothed, so this never talks to the kernel and can be
+ * called for every packet (for example to compute ETX or ETT)
+ * 
+ * \param address The ipv4 address of the neighbour
+ * \param m Filled in with the metrics
+ * 
+ * \return 0 for success, -1 if the neighbour is not a known station (or there is no nl80211)
+ */
+int GetLinkMetrics(uint32_t address, struct link_metrics *m);
+
+/**
+ * \brief Gets the link quality to every station on the testbed interfaces, including stations
+ * whose ipv4 address is not known yet
+ * 
+ * \param m Array filled in with the metrics
+ * \param max Size of m
+ * 
+ * \return The number of stations copied to m, or -1 for failure
+ */
+int GetAllLinkMetrics(struct link_metrics *m, uint32_t max);
+
+/**
+ * \brief Sets how often the station statistics are read (one nl80211 dump per interface each
+ * time). DEFAULT_METRIC_INTERVAL if it is not called
+ * 
+ * \param interval Time in ms between dumps
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int SetLinkMetricsInterval(uint32_t interval);
+
+/**
+ * \brief Selects how queued packets, events and timers are delivered. By default (EVENT_LOOP_OFF)
+ * every queue and the event feed have their own thread, so callbacks run concurrently. With
+ * EVENT_LOOP_USER or EVENT_LOOP_THREAD the nfqueue sockets, the netlink event socket, the
+ * SubmitRouteAsync socket, timers (StartTimer, AddLoopTimer, route lifetimes) and the user's own
+ * sockets (AddLoopFd) are multiplexed in one epoll loop, and every callback runs to completion on
+ * the loop's thread, so the protocol's tables need no locks. Jittered broadcasts, the send
+ * scheduler's backlog and the link metrics dumps are driven by timers of the same loop, so the
+ * loop's thread (EVENT_LOOP_THREAD) is the only thread the API starts. Must be called before
+ * InitializeAPI
+ * 
+ * \param mode EVENT_LOOP_OFF, EVENT_LOOP_USER (the user calls RunEventLoop) or EVENT_LOOP_THREAD
+ * (one API thread runs the loop)
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int SetEventLoopMode(uint8_t mode);
+
+/**
+ * \brief Waits for ready sockets or timers and calls their callbacks, one at a time on the
+ * calling thread. Used in EVENT_LOOP_USER mode, usually as while(RunEventLoop(-1) >= 0);
+ * 
+ * \param timeout_ms Longest time (ms) to wait, 0 to only handle what is ready, -1 to wait forever
+ * 
+ * \return The number of callbacks run, or -1 for failure
+ */
+int RunEventLoop(int timeout_ms);
+
+/**
+ * \brief Gets the epoll fd of the event loop, so the loop can be nested in the user's own poll
+ * or epoll loop (call RunEventLoop(0) when it is readable)
+ * 
+ * \return The fd, or -1 if the event loop is off
+ */
+int GetEventLoopFd();
+
+/**
+ * \brief Adds a socket or other fd of the user to the event loop (for example a UDP socket that
+ * receives control messages directly)
+ * 
+ * \param fd The fd to watch
+ * \param cb Pointer to the function called when fd is readable, which should have the form:
+ *           - void (*LoopCallback) (int fd, void *arg);
+ * \param arg Passed to cb
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int AddLoopFd(int fd, LoopCallback cb, void *arg);
+
+/**
+ * \brief Removes a fd added with AddLoopFd. The fd is not closed
+ * 
+ * \param fd The fd
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int RemoveLoopFd(int fd);
+
+/**
+ * \brief Starts a protocol timer in the event loop, for example a HELLO interval or a route
+ * discovery timeout. Same as StartTimer (the timing wheel runs in the loop), but needs an event
+ * loop mode other than EVENT_LOOP_OFF
+ * 
+ * \param delay Time (ms) until the first expiry
+ * \param interval Time (ms) between later expiries, or 0 for a one-shot timer (its id is
+ * released when it expires)
+ * \param cb Pointer to the function called when the timer expires, which should have the form:
+ *           - void (*TimerCallback) (void *arg);
+ * \param arg Passed to cb
+ * 
+ * \return The id of the timer (>= 0), or -1 for failure
+ */
+int AddLoopTimer(uint32_t delay, uint32_t interval, TimerCallback cb, void *arg);
+
+/**
+ * \brief Stops a timer started with AddLoopTimer (same as StopTimer)
+ * 
+ * \param id The id of the timer
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int CancelLoopTimer(int id);
+
+/**
+ * \brief Starts a protocol timer (HELLO interval, neighbour hold time, route lifetime, RREQ retry,
+ * ...). Timers are kept in a hierarchical timing wheel with 1 ms resolution, so starting,
+ * stopping and restarting one is O(1) and thousands can be active at once. Callbacks run one at a
+ * time on the timer thread, or on the event loop's thread if SetEventLoopMode selected one
+ * 
+ * \param delay Time (ms) until the first expiry
+ * \param interval Time (ms) between later expiries, or 0 for a one-shot timer (its id is
+ * released when it expires)
+ * \param cb Pointer to the function called when the timer expires, which should have the form:
+ *           - void (*TimerCallback) (void *arg);
+ * \param arg Passed to cb
+ * 
+ * \return The id of the timer (>= 0), or -1 for failure
+ */
+int StartTimer(uint32_t delay, uint32_t interval, TimerCallback cb, void *arg);
+
+/**
+ * \brief Stops a timer started with StartTimer. Ids of timers that already expired (one-shot) or
+ * were stopped are refused, even if their slot was reused
+ * 
+ * \param id The id of the timer
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int StopTimer(int id);
+
+/**
+ * \brief Moves the next expiry of a timer, for example to push back a neighbour hold time when a
+ * HELLO arrives. A periodic timer keeps its interval from the new expiry on
  * 
- * \param entry the entry to search for
+ * \param id The id of the timer
+ * \param delay Time (ms) from now until the timer expires
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int RestartTimer(int id, uint32_t delay);
+
+/**
+ * \brief Moves the queue callbacks to one protocol worker thread. The queue threads then only
+ * parse each packet and pass a handle to its buffer (see HoldPacket) through a lock-free ring; the
+ * worker takes packets in batches, calls the incoming, outgoing and forward callbacks one at a
+ * time and issues the verdicts (accepts are merged into batch verdicts). Protocol state touched only from callbacks needs no locks and stays
+ * on one core. Not available in event loop mode, which already runs callbacks on one thread
+ * 
+ * \param enable 1 to hand packets to the worker, 0 to call the callbacks from the queue threads
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int SetQueueHandoff(uint8_t enable);
+
+/**
+ * \brief Runs the incoming data and forward callbacks on a pool of worker threads, for heavy
+ * data-plane callbacks such as inspection or encryption. Packets are hashed by flow (addresses,
+ * protocol and ports) onto the workers: packets of one flow are handled and get their verdicts in
+ * order, different flows in parallel. Control packets and outgoing packets are not affected. Must
+ * be called before RegisterIncomingCallback and RegisterForwardCallback; not available in event
+ * loop mode
+ * 
+ * \param workers Number of workers (at most 16), 0 to call the callbacks from the queue threads
+ * 
+ * \return 0 for success, -1 for failure
  */
-int SearchTable(uint8_t *entry);
+int SetQueueWorkers(uint8_t workers);
+
+/**
+ * \brief Sets the scheduling of a queue's receive thread, so routing control messages are not
+ * delayed by bulk data: for example SCHED_FIFO for QUEUE_IN_CONTROL and a positive niceness for
+ * QUEUE_IN_DATA and QUEUE_FORWARD, or each queue pinned to its own CPU. Applied right away if
+ * the queue is registered, otherwise when it is. SCHED_FIFO and negative niceness need root (or
+ * CAP_SYS_NICE). Not available in event loop mode, where the control queue is always drained
+ * before each batch of a data queue instead. With SetQueueHandoff(1) the callbacks run on the
+ * worker in the order packets were put into its ring, so this only changes how soon each queue
+ * thread hands its packets over, not the order of callbacks already waiting for the worker
+ * 
+ * \param queue QUEUE_IN_CONTROL, QUEUE_IN_DATA, QUEUE_OUT or QUEUE_FORWARD
+ * \param sched The priority, niceness and CPU of the thread
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int SetQueueScheduling(uint16_t queue, struct queue_sched *sched);
+
+/**
+ * \brief Keeps the packet of a queue callback after the callback returns, for example to buffer it
+ * while a route is discovered or to pass it to another thread. The packet is not copied: the
+ * handle points into the buffer the packet was received into, which stays out of the pool until
+ * every reference is released. Only the info pointer given to a callback may be passed. Held
+ * packets are read-only, and the packet's verdict is still the callback's return value
+ * 
+ * \param info The info argument of the callback
+ * 
+ * \return The packet, or NULL for failure
+ */
+PacketHandle HoldPacket(struct packet_info *info);
+
+/**
+ * \brief Adds a reference to a held packet, for a second consumer (another thread, or a second
+ * next hop). The data is shared, not copied; every reference is released separately
+ * 
+ * \param pkt The packet
+ * 
+ * \return pkt, or NULL for failure
+ */
+PacketHandle ClonePacket(PacketHandle pkt);
+
+/**
+ * \brief Releases one reference to a held packet (from HoldPacket or ClonePacket). The buffer goes
+ * back to the pool with the last reference. Can be called from any thread
+ * 
+ * \param pkt The packet
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int ReleasePacket(PacketHandle pkt);
+
+/**
+ * \brief Reports the packet buffer pool of the node. Buffers are allocated once by InitializeAPI;
+ * when every buffer is held the queues sleep until packets are released. A small reserve of
+ * buffers is kept for the incoming control queue, so held data packets never block it
+ * 
+ * \param stats Filled in with the pool's size and use
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int GetPoolStats(struct pool_stats *stats);
 
 /**
  * \brief Registers the provided function as callback function for handling queued incoming packets, and
  *        begins queueing incoming packets
  * 
  * \param control_cb Pointer to the desired callback for control plane messages, which should have the form:
- *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length);
+ *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info);
  *           - function should return PACKET_ACCEPT or PACKET_DROP to indicate verdict
   * \param data_cb Pointer to the desired callback for data plane messages, which should have the form:
- *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length);
+ *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info);
  *           - function should return PACKET_ACCEPT or PACKET_DROP to indicate verdict
  * \return 0 for success, -1 for failure
  */
 uint32_t RegisterIncomingCallback(CallbackFunction control_cb, CallbackFunction data_cb);
 
+/**
+ * \brief Checks whether an (originator, sequence number) pair was already seen, and records
+ * it if not. Keys are held for DEFAULT_DUP_HOLD_TIME ms, in a fixed-size cache with O(1) insert and lookup.
+ * This cache is separate from the one used by EnableDuplicateFilter, so a control callback can still
+ * call IsDuplicate on messages that passed the filter (they are new to this cache). The key is only
+ * (orig, seq), so protocols whose message types have their own sequence spaces (RREQ IDs and TC ANSNs,
+ * for example) should keep them apart, for example by folding the type into the top bits of seq
+ * 
+ * \param orig The originator address of the message
+ * \param seq The sequence number (or RREQ ID) of the message
+ * 
+ * \return 1 if the pair is a duplicate, 0 if it is new
+ */
+int IsDuplicate(uint32_t orig, uint32_t seq);
+
+/**
+ * \brief Enables dropping of duplicate incoming control messages before the control callback
+ * registered with RegisterIncomingCallback is called. The key of each message is read from the
+ * UDP payload at the given offsets. The filter keeps its own cache (emptied whenever it is
+ * reconfigured), separate from the one used by IsDuplicate, and only records messages of the given type
+ * 
+ * \param type_offset Offset of the message type byte, or -1 to filter every message
+ * \param type Message type to filter (for example 1 for an AODV RREQ)
+ * \param orig_offset Offset of the 4-byte originator address
+ * \param seq_offset Offset of the sequence number (network byte order)
+ * \param seq_size Size of the sequence number in bytes (1, 2 or 4)
+ * \param hold_time How long (ms) a key is remembered (at least 3 ms, shorter times are rounded up), or 0 to disable the filter
+ * 
+ * \return 0 for success, -1 for failure
+ */
+int EnableDuplicateFilter(int32_t type_offset, uint8_t type, uint32_t orig_offset, uint32_t seq_offset, uint8_t seq_size, uint32_t hold_time);
+
 /**
  * \brief Registers the provided function as callback function for handling queued outgoing packets, and
  *        begins queueing outgoing packets
  * 
  * \param cb Pointer to the desired callback function, which should have the form:
- *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length);
+ *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info);
  *           - function should return PACKET_ACCEPT or PACKET_DROP to indicate verdict
  * 
  * \return 0 for success, -1 for failure
@@ -147,7 +877,7 @@ uint32_t RegisterOutgoingCallback(CallbackFunction cb);
  *        begins queueing forwarded packets
  * 
  * \param cb Pointer to the desired callback function, which should have the form:
- *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length);
+ *   *       - uint8_t (*CallbackFunction) (uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info);
  *           - function should return PACKET_ACCEPT or PACKET_DROP to indicate verdict
  * 
  * \return 0 for success, -1 for failure
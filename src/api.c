@@ -1,36 +1,394 @@
 /*
 Andre Koka - Created 10/8/2023
-             Last Updated: 11/7/2023
+             Last Updated: 10/19/2026
 
 The basic API file for the MANET Testbed - to implement:
 - all common functions between other API files
+- CreateTestbed - create a node, with its own network namespace, sockets, queues and tables
+- UseTestbed - select the node that the calling thread's API calls act on
+- DestroyTestbed - stop a node's threads, close its sockets and free its state
+
+Every api file keeps its state in the node (struct testbed), so one process can run many
+emulated nodes, each in its own network namespace. API calls act on the node of the calling
+thread; programs that never create a node use a default one in the process's namespace.
+The calling threads never change namespace: the threads the API starts for a node enter the
+node's namespace once, and the sockets (and commands) the API opens from a caller's thread are
+created by a short-lived thread in that namespace. Each api file allocates its state when it
+is initialized, or when its feature is first used.
 */
 
+#define _GNU_SOURCE // setns
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "../manet_testbed.h"
 #include "api.h"
 #include "api_if.h"
 #include "api_send.h"
 #include "api_route.h"
 #include "api_queue.h"
+#include "api_sched.h"
+#include "api_dup.h"
+#include "api_jitter.h"
+#include "api_async.h"
+#include "api_fib.h"
+#include "api_event.h"
+#include "api_lifetime.h"
+#include "api_neigh.h"
+#include "api_metric.h"
+#include "api_sync.h"
+#include "api_loop.h"
+#include "api_timer.h"
+#include "api_handoff.h"
+#include "api_pool.h"
+
+static __thread struct testbed *cur_node = NULL; // node of the calling thread
+static __thread ino_t thread_ns = 0; // namespace the calling thread is in, 0 for the process's
+static __thread int api_thread = 0; // the calling thread was started by start_thread
+static struct testbed *default_node = NULL; // node of threads that never called UseTestbed
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+static __thread int nl_fd = -1; // netlink socket of the calling thread
+static __thread ino_t nl_ns = 0; // namespace nl_fd was opened in
+static __thread int nl_seq = 0; // last sequence number sent on nl_fd
+static pthread_key_t nl_key; // closes nl_fd when its thread exits
+static pthread_once_t nl_once = PTHREAD_ONCE_INIT;
+
+static void make_default()
+{
+	default_node = CreateTestbed(NULL);
+}
+
+struct testbed *testbed()
+{
+	if(cur_node == NULL) { // thread never called UseTestbed
+		pthread_once(&default_once, make_default);
+		cur_node = default_node;
+	}
+	return cur_node;
+}
+
+// enter the namespace of node on a thread the API owns
+static int enter_ns(struct testbed *node)
+{
+	if(node->ns_ino != thread_ns && setns(node->netns, CLONE_NEWNET) < 0)
+		return -1;
+	thread_ns = node->ns_ino;
+	return 0;
+}
+
+// close the calling thread's netlink socket if it is not in namespace ns
+static void drop_nl_sock(ino_t ns)
+{
+	if(nl_fd >= 0 && nl_ns != ns) {
+		close(nl_fd);
+		nl_fd = -1;
+		pthread_setspecific(nl_key, NULL);
+	}
+}
+
+static void *run_thread(void *arg)
+{
+	struct thread_start start = *(struct thread_start *)arg;
+	free(arg);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL); // enabled only while waiting
+	api_thread = 1;
+	cur_node = start.node;
+	if(enter_ns(start.node) < 0)
+		return NULL;
+	return start.func();
+}
+
+int start_thread(pthread_t *thread, void *(*func)())
+{
+	struct testbed *node = testbed();
+	struct thread_start *start = malloc(sizeof(*start));
+	if(start == NULL)
+		return -1;
+	start->node = node;
+	start->func = func;
+
+	pthread_mutex_lock(&node->thread_lock);
+	if(node->num_threads == NODE_MAX_THREADS || pthread_create(thread, NULL, run_thread, start)) {
+		pthread_mutex_unlock(&node->thread_lock);
+		free(start);
+		return -1;
+	}
+	node->threads[node->num_threads++] = *thread; // stopped by DestroyTestbed
+	pthread_mutex_unlock(&node->thread_lock);
+	return 0;
+}
+
+void wait_begin()
+{
+	if(api_thread) // the user's threads (RunEventLoop) keep their own cancel state
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+}
+
+void wait_end()
+{
+	if(api_thread)
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+}
 
-pthread_mutex_t lock;
-int fd = 0;
-int f_err = 0;
-uint32_t local_ip = 0; 
-uint32_t broadcast_ip = 0; 
+void unlock_on_cancel(void *lock)
+{
+	pthread_mutex_unlock(lock);
+}
+
+static void *run_ns_call(void *arg)
+{
+	struct ns_call *call = arg;
+	call->ret = (enter_ns(call->node) < 0) ? -1 : call->func(call->arg);
+	return NULL;
+}
+
+int ns_run(int (*func)(void *), void *arg)
+{
+	struct testbed *node = testbed();
+	if(node->ns_ino == thread_ns) // already in the node's namespace
+		return func(arg);
+
+	struct ns_call call = { node, func, arg, -1 };
+	pthread_t thread;
+	if(pthread_create(&thread, NULL, run_ns_call, &call))
+		return -1;
+	pthread_join(thread, NULL);
+	return call.ret;
+}
+
+static int open_socket(void *arg)
+{
+	int *a = arg;
+	return socket(a[0], a[1], a[2]);
+}
+
+int ns_socket(int domain, int type, int protocol)
+{
+	int a[3] = { domain, type, protocol };
+	return ns_run(open_socket, a);
+}
+
+static int run_cmd(void *cmd)
+{
+	return system(cmd);
+}
+
+int ns_system(const char *cmd)
+{
+	return ns_run(run_cmd, (void *)cmd);
+}
+
+// close every socket of a node and free its state (its threads are stopped)
+static void free_state(struct testbed *node)
+{
+	uint32_t j;
+	int i;
+	for(i = 0; i < node->num_ifaces; i++)
+		close(node->ifaces[i].sock);
+	free(node->iface);
+	free(node->route);
+	free(node->fib);
+	if(node->event != NULL && node->event->event_fd >= 0)
+		close(node->event->event_fd);
+	free(node->event);
+	free(node->neigh);
+	if(node->metric != NULL && node->metric->metric_fd >= 0)
+		close(node->metric->metric_fd);
+	free(node->metric);
+	if(node->async != NULL) {
+		if(node->async->async_fd >= 0)
+			close(node->async->async_fd);
+		if(node->async->wake_fd >= 0)
+			close(node->async->wake_fd);
+	}
+	free(node->async);
+	free(node->lifetime);
+	if(node->send != NULL && node->send->sock >= 0)
+		close(node->send->sock);
+	free(node->send);
+	if(node->sched != NULL) { // messages still in the backlog
+		for(i = 0; i < NUM_MSG_CLASSES; i++) {
+			struct token_bucket *tb = &node->sched->buckets[i];
+			for(j = 0; j < tb->count; j++)
+				free(tb->backlog[(tb->head + j) % SCHED_BACKLOG_LEN].buf);
+		}
+	}
+	free(node->sched);
+	free(node->jitter);
+	free(node->dup);
+	free(node->sync);
+	if(node->queue != NULL)
+		for(i = 0; i < NUM_QUEUES; i++)
+			if(node->queue->loop_h[i] != NULL)
+				nfq_close(node->queue->loop_h[i]);
+	free(node->queue);
+	if(node->loop != NULL && node->loop->epfd >= 0)
+		close(node->loop->epfd);
+	free(node->loop);
+	if(node->timer != NULL) {
+		if(node->timer->timer_fd >= 0)
+			close(node->timer->timer_fd);
+		free(node->timer->timers);
+	}
+	free(node->timer);
+	if(node->handoff != NULL) {
+		if(node->handoff->ring != NULL)
+			ring_destroy(node->handoff->ring);
+		for(i = 0; i < HANDOFF_MAX_WORKERS; i++)
+			if(node->handoff->pool_rings[i] != NULL)
+				ring_destroy(node->handoff->pool_rings[i]);
+	}
+	free(node->handoff);
+	if(node->pool != NULL)
+		free(node->pool->bufs);
+	free(node->pool);
+	if(node->netns >= 0)
+		close(node->netns);
+	free(node);
+}
+
+TestbedHandle CreateTestbed(uint8_t *netns)
+{
+	struct testbed *node = calloc(1, sizeof(*node));
+	if(node == NULL)
+		return NULL;
+	pthread_mutex_init(&node->lock, NULL);
+	pthread_mutex_init(&node->state_lock, NULL);
+	pthread_mutex_init(&node->thread_lock, NULL);
+
+	char path[256];
+	if(netns == NULL) // namespace of the process
+		snprintf(path, sizeof(path), "/proc/self/ns/net");
+	else if(netns[0] == '/') // path of a namespace file
+		snprintf(path, sizeof(path), "%s", (char *)netns);
+	else // named namespace (ip netns add)
+		snprintf(path, sizeof(path), "/var/run/netns/%s", (char *)netns);
+	node->netns = open(path, O_RDONLY | O_CLOEXEC);
+
+	// threads only have to switch namespace for a node outside the process's
+	struct stat ns, self;
+	if(node->netns < 0 || fstat(node->netns, &ns) < 0 || stat("/proc/self/ns/net", &self) < 0) {
+		free_state(node);
+		return NULL;
+	}
+	node->ns_ino = (ns.st_ino == self.st_ino && ns.st_dev == self.st_dev) ? 0 : ns.st_ino;
+	return node;
+}
+
+int UseTestbed(TestbedHandle node)
+{
+	if(node == NULL)
+		return -1;
+	drop_nl_sock(node->ns_ino);
+	cur_node = node;
+	return 0;
+}
+
+int DestroyTestbed(TestbedHandle node)
+{
+	if(node == NULL || node == default_node)
+		return -1;
+
+	pthread_mutex_lock(&node->thread_lock);
+	int i, n = node->num_threads;
+	for(i = 0; i < n; i++) {
+		if(pthread_equal(node->threads[i], pthread_self())) { // called from one of its callbacks
+			pthread_mutex_unlock(&node->thread_lock);
+			return -1;
+		}
+	}
+	node->num_threads = 0;
+	pthread_mutex_unlock(&node->thread_lock);
+
+	// the threads can only be cancelled where they wait without holding a lock (see wait_begin)
+	for(i = 0; i < n; i++)
+		pthread_cancel(node->threads[i]);
+	for(i = 0; i < n; i++)
+		pthread_join(node->threads[i], NULL);
+
+	if(cur_node == node) { // back to the default node
+		cur_node = NULL;
+		drop_nl_sock(0);
+	}
+	free_state(node);
+	return 0;
+}
 
 int InitializeAPI() // required to be called first
 {
+	check(InitializeLoop());
 	check(InitializeIF());
 	check(InitializeRoute());
+	check(InitializeFib());
+	check(InitializeNeigh());
+	check(InitializeEvent()); // loads the neighbour table
+	check(InitializeAsync());
+	check(InitializeTimer());
+	check(InitializeMetric()); // uses the timer service in event loop mode
+	check(InitializeLifetime()); // uses the timer service
 	check(InitializeSend());
+	check(InitializeSched());
+	check(InitializeJitter());
+	check(InitializeDup());
+	check(InitializePool());
 	check(InitializeQueue());
-	if(f_err != 0)
+	if(testbed()->f_err != 0)
 		return -1;
 	return 0;
 }
 
-// receive message (through the msghdr format) over socket fd
+static void close_nl_sock(void *sock)
+{
+	close((int)(intptr_t)sock - 1);
+}
+
+static void make_nl_key()
+{
+	pthread_key_create(&nl_key, close_nl_sock);
+}
+
+int nl_sock()
+{
+	if(nl_fd < 0) { // first request from this thread (or since it changed node)
+		nl_fd = ns_socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+		nl_ns = testbed()->ns_ino;
+		if(nl_fd >= 0) {
+			pthread_once(&nl_once, make_nl_key);
+			pthread_setspecific(nl_key, (void *)(intptr_t)(nl_fd + 1)); // 0 would mean no socket
+		}
+	}
+	return nl_fd;
+}
+
+int nl_next_seq()
+{
+	nl_seq = (nl_seq == INT32_MAX) ? 1 : nl_seq + 1;
+	return nl_seq;
+}
+
+int nl_send(struct sockaddr_nl *sa, struct nlmsghdr *nl)
+{
+	int sock = nl_sock();
+	if(sock < 0)
+		return -1;
+	nl->nlmsg_seq = nl_next_seq();
+
+	struct iovec iov = { nl, nl->nlmsg_len };
+	struct msghdr msg = { sa, sizeof(*sa), &iov, 1, NULL, 0, 0 };
+	return (sendmsg(sock, &msg, 0) < 0) ? -1 : (int)nl->nlmsg_seq;
+}
+
+int get_reply(struct sockaddr_nl *sa, void *buf, size_t len, int seq)
+{
+	int r;
+	do { // drop replies to earlier requests that were given up on
+		r = get_msg(sa, buf, len);
+	} while(r >= (int)sizeof(struct nlmsghdr) && ((struct nlmsghdr*)buf)->nlmsg_seq != (uint32_t)seq);
+	return r;
+}
+
+// receive message (through the msghdr format) over the calling thread's netlink socket
 int get_msg(struct sockaddr_nl *sa, void *buf, size_t len)
 {
 	struct iovec iov;
@@ -44,13 +402,13 @@ int get_msg(struct sockaddr_nl *sa, void *buf, size_t len)
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
 
-	return recvmsg(fd, &msg, 0); // block to receive message from kernel
+	return recvmsg(nl_sock(), &msg, 0); // block to receive message from kernel
 }
 
 void check(int val) // check for error returned
 {
 	if (val < 0) {
-		f_err = 1;
+		testbed()->f_err = 1;
 	}
 } 
 
@@ -0,0 +1,221 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SubmitRouteAsync - queue a route change and return right away
+- InitializeAsync() - open the async netlink socket and start its I/O thread (or add it to the event loop)
+
+Route changes are pipelined: the I/O thread keeps up to ASYNC_MAX_INFLIGHT requests
+outstanding on its own netlink socket, and completes each one when the ACK with its
+sequence number comes back. Callers (for example queue callbacks) never block on the kernel.
+In event loop mode the socket and its eventfd are read by the loop, so completion callbacks
+run on the loop's thread like every other callback.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_route.h"
+#include "api_async.h"
+#include "api_fib.h"
+#include "api_loop.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// move queued route changes into free in-flight slots and pack them into one buffer
+static uint32_t fill_inflight(char *batch, uint32_t size)
+{
+	struct async_state *st = testbed()->async;
+	struct rt_request req;
+	uint32_t len = 0;
+
+	pthread_mutex_lock(&st->async_lock);
+	while(st->queue_count > 0) {
+		struct async_req *slot = &st->inflight[st->async_seq % ASYNC_MAX_INFLIGHT];
+		if(slot->used) // oldest request in this slot is still waiting for its ACK
+			break;
+
+		struct async_req *a = &st->queue[st->queue_head];
+		int n = build_request(&req, AF_INET, a->op->dest, a->op->next_hop,
+			(a->op->action == ROUTE_DELETE) ? RTM_DELROUTE : RTM_NEWROUTE);
+		if(len + NLMSG_ALIGN(n) > size)
+			break;
+
+		req.nl.nlmsg_seq = st->async_seq;
+		memcpy(batch + len, &req, n);
+		len += NLMSG_ALIGN(n);
+
+		*slot = *a;
+		slot->seq = st->async_seq++;
+		slot->used = 1;
+		st->queue_head = (st->queue_head + 1) % ASYNC_QUEUE_LEN;
+		st->queue_count--;
+	}
+	pthread_mutex_unlock(&st->async_lock);
+	return len;
+}
+
+// complete an in-flight route change with the kernel's result
+static void complete(uint32_t seq, int error)
+{
+	struct async_state *st = testbed()->async;
+	pthread_mutex_lock(&st->async_lock);
+	struct async_req *slot = &st->inflight[seq % ASYNC_MAX_INFLIGHT];
+	if(!slot->used || slot->seq != seq) { // not one of ours (or already completed)
+		pthread_mutex_unlock(&st->async_lock);
+		return;
+	}
+	struct async_req done = *slot;
+	slot->used = 0;
+	pthread_mutex_unlock(&st->async_lock);
+
+	done.op->error = error; // status slot for callers that poll
+	fib_apply(done.op);
+	if(done.cb != NULL)
+		(*done.cb)(done.op, done.arg);
+}
+
+// fail everything in flight (the async socket itself returned an error)
+static void fail_inflight(int error)
+{
+	struct async_state *st = testbed()->async;
+	uint32_t i;
+	for(i = 0; i < ASYNC_MAX_INFLIGHT; i++) {
+		if(st->inflight[i].used)
+			complete(st->inflight[i].seq, error);
+	}
+}
+
+// send everything that fits in flight with one sendmsg
+static void send_pending()
+{
+	struct async_state *st = testbed()->async;
+	char batch[ROUTE_BATCH_BUFLEN];
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	uint32_t len = fill_inflight(batch, sizeof(batch));
+	if(len > 0) {
+		struct iovec iov = { batch, len };
+		struct msghdr msg = { &sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
+		if(sendmsg(st->async_fd, &msg, 0) < 0)
+			fail_inflight(-errno);
+	}
+}
+
+// complete the route changes whose ACKs have arrived
+static void read_acks()
+{
+	struct async_state *st = testbed()->async;
+	char buf[BUFLEN];
+	int r = recv(st->async_fd, buf, BUFLEN, MSG_DONTWAIT);
+	if(r < 0) {
+		if(errno != EAGAIN && errno != EINTR)
+			fail_inflight(-errno);
+		return;
+	}
+
+	struct nlmsghdr *nl = NULL;
+	for_each_nlmsg(nl, buf, r) {
+		if(nl->nlmsg_type == NLMSG_ERROR) {
+			struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(nl);
+			complete(nl->nlmsg_seq, err->error);
+		}
+	}
+}
+
+// event loop callback of wake_fd: new submissions
+static void loop_wake(int fd, void *arg)
+{
+	uint64_t n;
+	read(fd, &n, sizeof(n));
+	send_pending();
+}
+
+// event loop callback of async_fd: ACKs free in-flight slots for queued changes
+static void loop_acks(int fd, void *arg)
+{
+	read_acks();
+	send_pending();
+}
+
+void *thread_func_async()
+{
+	struct async_state *st = testbed()->async;
+	struct pollfd pfd[2] = { { st->async_fd, POLLIN, 0 }, { st->wake_fd, POLLIN, 0 } };
+	while(1) {
+		send_pending();
+
+		wait_begin();
+		int r = poll(pfd, 2, -1);
+		wait_end();
+		if(r < 0)
+			continue;
+
+		if(pfd[1].revents & POLLIN) { // new submissions, picked up at the top of the loop
+			uint64_t n;
+			read(st->wake_fd, &n, sizeof(n));
+		}
+
+		if(pfd[0].revents & POLLIN)
+			read_acks();
+	}
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SubmitRouteAsync(struct route_op *op, RouteCallback cb, void *arg)
+{
+	struct async_state *st = testbed()->async;
+	if(op == NULL || st == NULL || st->async_fd < 0)
+		return -1;
+
+	pthread_mutex_lock(&st->async_lock);
+	if(st->queue_count == ASYNC_QUEUE_LEN) {
+		pthread_mutex_unlock(&st->async_lock);
+		return -1;
+	}
+	struct async_req *a = &st->queue[(st->queue_head + st->queue_count) % ASYNC_QUEUE_LEN];
+	a->op = op;
+	a->cb = cb;
+	a->arg = arg;
+	op->error = ROUTE_PENDING;
+	st->queue_count++;
+	pthread_mutex_unlock(&st->async_lock);
+
+	uint64_t one = 1;
+	write(st->wake_fd, &one, sizeof(one)); // wake the I/O thread
+	return 0;
+}
+
+int InitializeAsync()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct async_state *st = node->async;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->async_lock, NULL);
+		st->async_seq = 1;
+		node->async = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	if(st == NULL)
+		return -1;
+
+	st->async_fd = ns_socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	st->wake_fd = eventfd(0, EFD_NONBLOCK);
+	if(st->async_fd < 0 || st->wake_fd < 0)
+		return -1;
+
+	if(loop_enabled()) // complete route changes on the event loop instead of a thread
+		return (loop_add(st->async_fd, loop_acks, NULL) < 0 || loop_add(st->wake_fd, loop_wake, NULL) < 0) ? -1 : 0;
+
+	if(start_thread(&st->async_thread, thread_func_async))
+	{
+		printf("error creating async route thread\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- IsDuplicate - check and record an (originator, sequence number) pair
+- EnableDuplicateFilter - drop duplicate control messages before the incoming control callback
+- InitializeDup() - clear the duplicate caches (if any were allocated)
+
+A cache is a ring of DUP_GENERATIONS fixed-size hash tables. New keys go into the
+current generation, lookups check every generation, and rotating the ring clears the
+oldest generation by bumping its stamp. Memory use is fixed and every operation is O(1).
+IsDuplicate and the filter of EnableDuplicateFilter each have their own cache (both are
+allocated by the first call to either), so a callback that also calls IsDuplicate on
+messages that passed the filter still sees them as new.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_dup.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// empty a cache, keys are then held for hold_time ms
+static void cache_reset(struct dup_cache *c, uint32_t hold_time)
+{
+	memset(c->gens, 0, sizeof(c->gens));
+	int g;
+	for(g = 0; g < DUP_GENERATIONS; g++)
+		c->gens[g].stamp = 1; // slots start at stamp 0, so the cache starts empty
+	c->cur_gen = 0;
+	// a key survives at least DUP_GENERATIONS-1 rotations, so it is held for at least hold_time
+	c->gen_interval = hold_time / (DUP_GENERATIONS - 1);
+	if(c->gen_interval == 0) // hold times under DUP_GENERATIONS-1 ms still rotate every ms
+		c->gen_interval = 1;
+	clock_gettime(CLOCK_MONOTONIC, &c->last_rotate);
+}
+
+// empty both caches and disable the filter
+static void dup_reset(struct dup_state *st)
+{
+	cache_reset(&st->user, DEFAULT_DUP_HOLD_TIME);
+	cache_reset(&st->filter, DEFAULT_DUP_HOLD_TIME);
+	st->filter_enabled = 0;
+}
+
+// allocate the caches on first use
+static struct dup_state *dup_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct dup_state *st = node->dup;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->dup_lock, NULL);
+		dup_reset(st);
+		node->dup = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+static uint32_t hash_key(uint32_t orig, uint32_t seq)
+{
+	uint64_t k = ((uint64_t)orig << 32) | seq;
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	return (uint32_t)k & (DUP_SLOTS - 1);
+}
+
+// clear the oldest generation and make it the current one
+static void rotate(struct dup_cache *c)
+{
+	c->cur_gen = (c->cur_gen + 1) % DUP_GENERATIONS;
+	c->gens[c->cur_gen].stamp++;
+	c->gens[c->cur_gen].count = 0;
+}
+
+// rotate once for every interval that passed since the last rotation
+static void expire(struct dup_cache *c, struct timespec *now)
+{
+	uint64_t elapsed = (now->tv_sec - c->last_rotate.tv_sec) * 1000 + (now->tv_nsec - c->last_rotate.tv_nsec) / 1000000;
+	if(elapsed < c->gen_interval)
+		return;
+
+	uint64_t n = elapsed / c->gen_interval;
+	uint32_t i;
+	for(i = 0; i < n && i < DUP_GENERATIONS; i++)
+		rotate(c);
+
+	if(n >= DUP_GENERATIONS) { // everything expired, restart the clock
+		c->last_rotate = *now;
+		return;
+	}
+	uint64_t ms = n * c->gen_interval; // keep the remainder for the next rotation
+	c->last_rotate.tv_sec += ms / 1000;
+	c->last_rotate.tv_nsec += (ms % 1000) * 1000000;
+	if(c->last_rotate.tv_nsec >= 1000000000) {
+		c->last_rotate.tv_sec++;
+		c->last_rotate.tv_nsec -= 1000000000;
+	}
+}
+
+static int lookup(struct dup_cache *c, uint32_t orig, uint32_t seq, uint32_t h)
+{
+	uint32_t g, i;
+	for(g = 0; g < DUP_GENERATIONS; g++) {
+		struct dup_gen *gen = &c->gens[g];
+		for(i = 0; i < DUP_SLOTS; i++) { // linear probe until an empty slot
+			struct dup_slot *s = &gen->slots[(h + i) & (DUP_SLOTS - 1)];
+			if(s->stamp != gen->stamp)
+				break;
+			if(s->orig == orig && s->seq == seq)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static void insert(struct dup_cache *c, uint32_t orig, uint32_t seq, uint32_t h)
+{
+	if(c->gens[c->cur_gen].count >= DUP_MAX_LOAD) // budget used up, forget the oldest generation early
+		rotate(c);
+
+	struct dup_gen *gen = &c->gens[c->cur_gen];
+	uint32_t i;
+	for(i = 0; i < DUP_SLOTS; i++) {
+		struct dup_slot *s = &gen->slots[(h + i) & (DUP_SLOTS - 1)];
+		if(s->stamp != gen->stamp) {
+			s->orig = orig;
+			s->seq = seq;
+			s->stamp = gen->stamp;
+			gen->count++;
+			return;
+		}
+	}
+}
+
+// check and record a key in one cache (dup_lock held)
+static int check_key(struct dup_cache *c, uint32_t orig, uint32_t seq)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint32_t h = hash_key(orig, seq);
+	expire(c, &now);
+	int found = lookup(c, orig, seq, h);
+	if(!found)
+		insert(c, orig, seq, h);
+	return found;
+}
+
+// read a big-endian (network order) field of 1, 2 or 4 bytes
+static uint32_t read_field(uint8_t *p, uint8_t size)
+{
+	uint32_t v = 0;
+	uint8_t i;
+	for(i = 0; i < size; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+int dup_filter_packet(uint8_t *payload, uint32_t payload_length)
+{
+	struct dup_state *st = testbed()->dup;
+	if(st == NULL || !st->filter_enabled)
+		return 0;
+
+	pthread_mutex_lock(&st->dup_lock);
+	// only filter messages of the configured type that are long enough to hold the key
+	int dup = 0;
+	if(st->filter_type_offset >= 0 &&
+	   ((uint32_t)st->filter_type_offset >= payload_length || payload[st->filter_type_offset] != st->filter_type))
+		goto done;
+	if(st->filter_orig_offset + sizeof(uint32_t) > payload_length || st->filter_seq_offset + st->filter_seq_size > payload_length)
+		goto done;
+
+	uint32_t orig;
+	memcpy(&orig, payload + st->filter_orig_offset, sizeof(orig));
+	dup = check_key(&st->filter, orig, read_field(payload + st->filter_seq_offset, st->filter_seq_size));
+done:
+	pthread_mutex_unlock(&st->dup_lock);
+	return dup;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int IsDuplicate(uint32_t orig, uint32_t seq)
+{
+	struct dup_state *st = testbed()->dup;
+	if(st == NULL && (st = dup_alloc()) == NULL) // out of memory, treat it as new
+		return 0;
+
+	pthread_mutex_lock(&st->dup_lock);
+	int found = check_key(&st->user, orig, seq);
+	pthread_mutex_unlock(&st->dup_lock);
+	return found;
+}
+
+int EnableDuplicateFilter(int32_t type_offset, uint8_t type, uint32_t orig_offset, uint32_t seq_offset, uint8_t seq_size, uint32_t hold_time)
+{
+	struct dup_state *st = testbed()->dup;
+	if(seq_size != 1 && seq_size != 2 && seq_size != 4)
+		return -1;
+	if(st == NULL && hold_time == 0) // stays disabled, nothing to allocate
+		return 0;
+	if(st == NULL && (st = dup_alloc()) == NULL)
+		return -1;
+
+	pthread_mutex_lock(&st->dup_lock);
+	st->filter_type_offset = type_offset;
+	st->filter_type = type;
+	st->filter_orig_offset = orig_offset;
+	st->filter_seq_offset = seq_offset;
+	st->filter_seq_size = seq_size;
+	st->filter_enabled = (hold_time != 0); // hold_time of 0 disables the filter
+	if(hold_time != 0) // keys of the old configuration would not match the new one
+		cache_reset(&st->filter, hold_time);
+	pthread_mutex_unlock(&st->dup_lock);
+	return 0;
+}
+
+int InitializeDup()
+{
+	struct dup_state *st = testbed()->dup;
+	if(st == NULL) // allocated on first use
+		return 0;
+	pthread_mutex_lock(&st->dup_lock);
+	dup_reset(st);
+	pthread_mutex_unlock(&st->dup_lock);
+	return 0;
+}
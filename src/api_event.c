@@ -0,0 +1,232 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- RegisterEventCallback - deliver route, address and link change events to the user
+- InitializeEvent() - join the rtnetlink multicast groups and start the event thread (or add the socket to the event loop)
+
+The kernel pushes every change to the routing table, interface addresses, links and neighbours to the
+event socket, so cached state (interface addresses, the route mirror, neighbours) is kept in sync
+without polling. If the socket overflows the lost events cannot be recovered, so all of that state
+is reloaded with fresh dumps instead, and the socket gets a large receive buffer so that is rare.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_if.h"
+#include "api_fib.h"
+#include "api_lifetime.h"
+#include "api_neigh.h"
+#include "api_event.h"
+#include "api_loop.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// allocate the event state of the node (the callback may be registered before InitializeAPI)
+static struct event_state *event_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct event_state *st = node->event;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		st->event_fd = -1;
+		node->event = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+int parse_route_msg(struct nlmsghdr *nl, struct net_event *ev)
+{
+	struct rtmsg *rt = (struct rtmsg*)NLMSG_DATA(nl);
+	if(rt->rtm_family != AF_INET || rt->rtm_type != RTN_UNICAST)
+		return -1;
+
+	memset(ev, 0, sizeof(*ev));
+	ev->type = (nl->nlmsg_type == RTM_DELROUTE) ? EVENT_ROUTE_DEL : EVENT_ROUTE_ADD;
+	ev->prefix_len = rt->rtm_dst_len;
+	ev->table = rt->rtm_table;
+
+	int len = RTM_PAYLOAD(nl);
+	struct rtattr *rta = NULL;
+	for_each_rattr(rta, RTM_RTA(rt), len) {
+		if(rta->rta_type == RTA_DST)
+			memcpy(&ev->address, RTA_DATA(rta), sizeof(ev->address));
+		else if(rta->rta_type == RTA_GATEWAY)
+			memcpy(&ev->next_hop, RTA_DATA(rta), sizeof(ev->next_hop));
+		else if(rta->rta_type == RTA_OIF)
+			memcpy(&ev->ifindex, RTA_DATA(rta), sizeof(ev->ifindex));
+		else if(rta->rta_type == RTA_TABLE) // tables above 255 only fit in this attribute
+			memcpy(&ev->table, RTA_DATA(rta), sizeof(ev->table));
+		else if(rta->rta_type == RTA_PRIORITY)
+			memcpy(&ev->metric, RTA_DATA(rta), sizeof(ev->metric));
+		else if(rta->rta_type == RTA_MULTIPATH && ev->next_hop == 0) { // report the first next hop
+			struct rtnexthop *nh = RTA_DATA(rta);
+			int nlen = nh->rtnh_len - sizeof(*nh);
+			struct rtattr *nrta = NULL;
+			ev->ifindex = nh->rtnh_ifindex;
+			for_each_rattr(nrta, RTNH_DATA(nh), nlen) {
+				if(nrta->rta_type == RTA_GATEWAY)
+					memcpy(&ev->next_hop, RTA_DATA(nrta), sizeof(ev->next_hop));
+			}
+		}
+	}
+	return 0;
+}
+
+// parse an address change and update the interface cache and the testbed interfaces
+static int parse_addr_msg(struct nlmsghdr *nl, struct net_event *ev)
+{
+	struct ifaddrmsg *ifa = (struct ifaddrmsg*)NLMSG_DATA(nl);
+	if(ifa->ifa_family != AF_INET)
+		return -1;
+
+	memset(ev, 0, sizeof(*ev));
+	ev->type = (nl->nlmsg_type == RTM_DELADDR) ? EVENT_ADDR_DEL : EVENT_ADDR_ADD;
+	ev->prefix_len = ifa->ifa_prefixlen;
+	ev->ifindex = ifa->ifa_index;
+
+	struct if_addr entry;
+	parse_ifa_msg(ifa, IFA_RTA(ifa), IFA_PAYLOAD(nl), &entry);
+	if_cache_update(ev->type == EVENT_ADDR_ADD, &entry);
+	ev->address = entry.local_ip;
+	return 0;
+}
+
+static int parse_link_msg(struct nlmsghdr *nl, struct net_event *ev)
+{
+	struct ifinfomsg *ifi = (struct ifinfomsg*)NLMSG_DATA(nl);
+	memset(ev, 0, sizeof(*ev));
+	ev->ifindex = ifi->ifi_index;
+	if(nl->nlmsg_type == RTM_NEWLINK && (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING))
+		ev->type = EVENT_LINK_UP;
+	else
+		ev->type = EVENT_LINK_DOWN;
+	return 0;
+}
+
+static void event_resync()
+{
+	if(if_cache_load() < 0)
+		fprintf(stderr, "interface reload failed\n");
+	if(fib_resync() < 0)
+		fprintf(stderr, "route reload failed\n");
+	if(neigh_load(1) < 0)
+		fprintf(stderr, "neighbour reload failed\n");
+}
+
+int read_events()
+{
+	struct event_state *st = testbed()->event;
+	char buf[EVENT_BUFLEN];
+	struct net_event ev;
+
+	wait_begin();
+	int len = recv(st->event_fd, buf, sizeof(buf), 0);
+	wait_end();
+	if(len < 0 && errno == EINTR)
+		return 0;
+	if(len < 0 && errno == ENOBUFS) { // events were lost, the cached state may be stale
+		fprintf(stderr, "event socket overrun, reloading\n");
+		event_resync();
+		return 0;
+	}
+	if(len < 0) {
+		fprintf(stderr, "event socket error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	struct nlmsghdr *nl = NULL;
+	for_each_nlmsg(nl, buf, len) {
+		int r = -1;
+		switch(nl->nlmsg_type) {
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE:
+			r = parse_route_msg(nl, &ev);
+			if(r == 0)
+				fib_event(&ev);
+			if(r == 0 && ev.type == EVENT_ROUTE_DEL && lifetime_deleted(ev.address))
+				ev.type = EVENT_ROUTE_EXPIRED;
+			break;
+		case RTM_NEWADDR:
+		case RTM_DELADDR:
+			r = parse_addr_msg(nl, &ev);
+			break;
+		case RTM_NEWLINK:
+		case RTM_DELLINK:
+			r = parse_link_msg(nl, &ev);
+			break;
+		case RTM_NEWNEIGH:
+		case RTM_DELNEIGH: // reported to the neighbour callback instead
+			neigh_event(nl);
+			break;
+		}
+
+		EventCallback cb = st->event_cb;
+		if(r == 0 && cb != NULL)
+			(*cb)(&ev);
+	}
+	return len;
+}
+
+// read the event socket when the event loop finds it readable
+static void loop_events(int fd, void *arg)
+{
+	if(read_events() < 0) // broken socket, stop polling it
+		RemoveLoopFd(fd);
+}
+
+void *thread_func_event()
+{
+	while(read_events() >= 0);
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int RegisterEventCallback(EventCallback cb)
+{
+	struct event_state *st = event_alloc();
+	if(st == NULL)
+		return -1;
+	st->event_cb = cb;
+	return 0;
+}
+
+int InitializeEvent()
+{
+	struct event_state *st = event_alloc();
+	if(st == NULL)
+		return -1;
+	st->event_fd = ns_socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if(st->event_fd < 0)
+		return -1;
+
+	// a large buffer makes overflows (and the dumps that recover from them) rare; SO_RCVBUFFORCE
+	// needs CAP_NET_ADMIN, SO_RCVBUF is capped by net.core.rmem_max
+	int size = EVENT_RCVBUF;
+	if(setsockopt(st->event_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+		setsockopt(st->event_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = EVENT_GROUPS; // join the multicast groups
+	if(bind(st->event_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		return -1;
+
+	// reload the interface cache and the neighbours now that changes are being reported, so none are missed
+	if(if_cache_load() < 0 || (testbed()->neigh != NULL && neigh_load(0) < 0))
+		return -1;
+
+	if(loop_enabled()) // read from the event loop instead of a thread
+		return loop_add(st->event_fd, loop_events, NULL);
+
+	if(start_thread(&st->event_thread, thread_func_event))
+	{
+		printf("error creating event thread\n");
+		return -1;
+	}
+	return 0;
+}
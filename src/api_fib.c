@@ -0,0 +1,415 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SearchTable - longest prefix match against the routes known to the testbed
+- MirrorMainTable - load the kernel's main routing table into the mirror (route events keep it current)
+- InitializeFib() - clear the route mirror
+
+The mirror is one open-addressed hash table keyed by (prefix, length, origin), so a route of
+the API's table and a main table route to the same prefix are kept apart. A lookup probes it
+once for every prefix length that is in use, longest first, so host routes cost one probe. Like
+the policy rule that looks up the API's table before main, routes of the API's table are
+searched first and main table routes only if none of them matches.
+Writers hold fib_lock and bump fib_seq around each change. Readers never lock: they retry
+if fib_seq changed (or was odd) while they were reading, so queue callbacks can search the
+table for every packet. If the event socket overflows and route events are lost, the event
+thread reloads the mirror from a fresh dump (fib_resync).
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_if.h"
+#include "api_fib.h"
+#include "api_event.h"
+#include "api_route.h"
+#include "api_sync.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+static uint32_t prefix_mask(uint8_t len)
+{
+	return (len == 0) ? 0 : htonl(~0U << (32 - len));
+}
+
+static uint32_t fib_hash(uint32_t prefix, uint8_t len, uint8_t origin)
+{
+	uint32_t h = prefix ^ ((uint32_t)len << 24) ^ ((uint32_t)origin << 16);
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h & (FIB_SIZE - 1);
+}
+
+static void write_begin()
+{
+	struct fib_state *st = testbed()->fib;
+	pthread_mutex_lock(&st->fib_lock);
+	atomic_fetch_add_explicit(&st->fib_seq, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static void write_end()
+{
+	struct fib_state *st = testbed()->fib;
+	atomic_fetch_add_explicit(&st->fib_seq, 1, memory_order_release);
+	pthread_mutex_unlock(&st->fib_lock);
+}
+
+// origin of the routes of a table: the API's table or main (the API's table wins if it is main)
+static uint8_t table_origin(uint32_t table)
+{
+	return (table == testbed()->route->route_table) ? FIB_ORIGIN_API : FIB_ORIGIN_KERNEL;
+}
+
+// rebuild the list of prefix lengths in use by one origin after one was added or removed
+static void update_lens(uint8_t origin)
+{
+	struct fib_state *st = testbed()->fib;
+	uint32_t o = origin - 1;
+	int l;
+	st->num_lens[o] = 0;
+	for(l = 32; l >= 0; l--) {
+		if(st->len_count[o][l] > 0)
+			st->lens[o][st->num_lens[o]++] = l;
+	}
+}
+
+// find the slot of a route, or -1 (caller holds fib_lock or is a reader inside the seqlock)
+static int find_slot(uint32_t prefix, uint8_t len, uint8_t origin)
+{
+	struct fib_state *st = testbed()->fib;
+	uint32_t i, h = fib_hash(prefix, len, origin);
+	for(i = 0; i < FIB_SIZE; i++) {
+		struct fib_entry *e = &st->fib[(h + i) & (FIB_SIZE - 1)];
+		if(!e->used)
+			return -1;
+		if(e->prefix == prefix && e->len == len && e->origin == origin)
+			return (h + i) & (FIB_SIZE - 1);
+	}
+	return -1;
+}
+
+int fib_insert(uint32_t prefix, uint8_t len, uint32_t next_hop, int ifindex, uint8_t origin)
+{
+	struct fib_state *st = testbed()->fib;
+	if(len > 32 || st == NULL || (origin != FIB_ORIGIN_API && origin != FIB_ORIGIN_KERNEL))
+		return -1;
+	prefix &= prefix_mask(len);
+
+	write_begin();
+	int slot = find_slot(prefix, len, origin);
+	if(slot < 0) { // new route, take the first free slot in its chain
+		if(st->fib_count == FIB_MAX_ROUTES) {
+			write_end();
+			return -1;
+		}
+		uint32_t h = fib_hash(prefix, len, origin);
+		for(slot = h; st->fib[slot].used; slot = (slot + 1) & (FIB_SIZE - 1));
+		st->fib_count++;
+		if(st->len_count[origin - 1][len]++ == 0)
+			update_lens(origin);
+	}
+
+	struct fib_entry *e = &st->fib[slot];
+	e->prefix = prefix;
+	e->len = len;
+	e->next_hop = next_hop;
+	e->ifindex = ifindex;
+	e->origin = origin;
+	e->used = 1;
+	e->seen = 1;
+	write_end();
+	return 0;
+}
+
+int fib_remove(uint32_t prefix, uint8_t len, uint8_t origin)
+{
+	struct fib_state *st = testbed()->fib;
+	if(len > 32 || st == NULL || (origin != FIB_ORIGIN_API && origin != FIB_ORIGIN_KERNEL))
+		return -1;
+	prefix &= prefix_mask(len);
+
+	write_begin();
+	int i = find_slot(prefix, len, origin);
+	if(i < 0) {
+		write_end();
+		return -1;
+	}
+
+	// backward shift deletion, so probe chains never need tombstones
+	uint32_t j = i;
+	while(1) {
+		j = (j + 1) & (FIB_SIZE - 1);
+		if(!st->fib[j].used)
+			break;
+		uint32_t k = fib_hash(st->fib[j].prefix, st->fib[j].len, st->fib[j].origin); // home slot of entry j
+		if((j > (uint32_t)i && (k <= (uint32_t)i || k > j)) || (j < (uint32_t)i && (k <= (uint32_t)i && k > j))) {
+			st->fib[i] = st->fib[j];
+			i = j;
+		}
+	}
+	st->fib[i].used = 0;
+	st->fib_count--;
+	if(--st->len_count[origin - 1][len] == 0)
+		update_lens(origin);
+	write_end();
+	return 0;
+}
+
+// longest prefix match among the routes of one origin (reader inside the seqlock)
+static int lookup_origin(uint32_t dest, uint8_t origin, struct fib_entry *out)
+{
+	struct fib_state *st = testbed()->fib;
+	uint32_t o = origin - 1, n;
+	for(n = 0; n < st->num_lens[o] && n < 33; n++) { // longest prefix first
+		uint8_t len = st->lens[o][n];
+		int slot = find_slot(dest & prefix_mask(len), len, origin);
+		if(slot >= 0) {
+			*out = st->fib[slot];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int fib_lookup(uint32_t dest, struct fib_entry *out)
+{
+	struct fib_state *st = testbed()->fib;
+	struct route_state *rt = testbed()->route;
+	unsigned int seq;
+	int found;
+	if(st == NULL) // InitializeFib not called
+		return 0;
+	// the API's own table is looked up before main (its policy rule), unless it is main
+	int own_table = (rt != NULL && rt->route_table != RT_TABLE_MAIN);
+	do {
+		seq = atomic_load_explicit(&st->fib_seq, memory_order_acquire);
+		found = 0;
+		if(seq & 1)
+			continue; // writer in progress
+
+		struct fib_entry e;
+		found = lookup_origin(dest, FIB_ORIGIN_API, out);
+		if((!found || !own_table) && lookup_origin(dest, FIB_ORIGIN_KERNEL, &e) && (!found || e.len > out->len)) {
+			*out = e;
+			found = 1;
+		}
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->fib_seq, memory_order_relaxed));
+	return found;
+}
+
+void fib_apply(struct route_op *op)
+{
+	if(op->error != 0)
+		return;
+	if(op->action == ROUTE_DELETE) {
+		fib_remove(op->dest, 32, FIB_ORIGIN_API);
+		sync_forget(op->dest, 32, 0);
+	}
+	else
+		fib_insert(op->dest, 32, op->next_hop, if_for_addr(op->next_hop), FIB_ORIGIN_API);
+}
+
+// send netlink message to dump the routing table
+static int get_routes(struct sockaddr_nl *sa)
+{
+	char buf[BUFLEN];
+	memset(buf, 0, BUFLEN);
+
+	struct nlmsghdr *nl = (struct nlmsghdr*)buf;
+	nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	nl->nlmsg_type = RTM_GETROUTE;
+	nl->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+
+	struct rtmsg *rt = (struct rtmsg*)NLMSG_DATA(nl);
+	rt->rtm_family = AF_INET;
+
+	return nl_send(sa, nl); // sequence number of the dump
+}
+
+// add one route from the dump to the mirror (main table unicast routes only)
+static void parse_rt_msg(struct nlmsghdr *nl, void *arg)
+{
+	struct net_event ev;
+	if(parse_route_msg(nl, &ev) < 0 || ev.table != RT_TABLE_MAIN)
+		return;
+	fib_insert(ev.address, ev.prefix_len, ev.next_hop, ev.ifindex, table_origin(ev.table));
+}
+
+// dump every ipv4 route and pass each one to parse
+static int dump_routes(void (*parse)(struct nlmsghdr *nl, void *arg), void *arg)
+{
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	int seq = get_routes(&sa);
+	int len = 0;
+	int err = (seq < 0);
+
+	char buf[BUFLEN];
+	int done = 0;
+	while(!done && !err) {
+		len = get_reply(&sa, buf, BUFLEN, seq);
+		if(len < 0) {
+			err = 1;
+			break;
+		}
+
+		struct nlmsghdr *nl = NULL;
+		for(nl = (struct nlmsghdr*)buf; NLMSG_OK(nl, (uint32_t)len); nl = NLMSG_NEXT(nl, len)) {
+			if(nl->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if(nl->nlmsg_type == NLMSG_ERROR) {
+				err = 1;
+				break;
+			}
+			if(nl->nlmsg_type == RTM_NEWROUTE)
+				(*parse)(nl, arg);
+		}
+	}
+
+	return err ? -1 : 0;
+}
+
+// refresh one route from the resync dump: routes a route event would have mirrored are
+// (re)inserted, and routes of the API's table are kept for sync_resync
+static void resync_rt_msg(struct nlmsghdr *nl, void *arg)
+{
+	struct fib_state *st = testbed()->fib;
+	struct resync_routes *api = arg;
+	struct net_event ev;
+	if(parse_route_msg(nl, &ev) < 0)
+		return;
+	if(ev.table != RT_TABLE_MAIN && ev.table != testbed()->route->route_table)
+		return;
+
+	if(ev.table == testbed()->route->route_table) {
+		if(api->count == api->size) {
+			uint32_t size = api->size ? api->size * 2 : 256;
+			struct route_spec *r = realloc(api->routes, size * sizeof(*r));
+			if(r == NULL)
+				api->failed = 1;
+			else {
+				api->routes = r;
+				api->size = size;
+			}
+		}
+		if(api->count < api->size) {
+			struct route_spec *r = &api->routes[api->count++];
+			memset(r, 0, sizeof(*r));
+			r->dest = ev.address;
+			r->prefix_len = ev.prefix_len;
+			r->metric = ev.metric;
+		}
+	}
+
+	uint8_t origin = table_origin(ev.table);
+	pthread_mutex_lock(&st->fib_lock);
+	int slot = find_slot(ev.address & prefix_mask(ev.prefix_len), ev.prefix_len, origin);
+	pthread_mutex_unlock(&st->fib_lock);
+
+	if(slot >= 0 || st->mirror_all)
+		fib_insert(ev.address, ev.prefix_len, ev.next_hop, ev.ifindex, origin);
+}
+
+int fib_resync()
+{
+	struct fib_state *st = testbed()->fib;
+	struct resync_routes api;
+	uint32_t i;
+	memset(&api, 0, sizeof(api));
+
+	write_begin(); // routes inserted from here on are current, only older ones can be stale
+	for(i = 0; i < FIB_SIZE; i++)
+		st->fib[i].seen = 0;
+	write_end();
+
+	if(dump_routes(resync_rt_msg, &api) < 0) {
+		free(api.routes);
+		return -1;
+	}
+
+	// drop the routes the kernel no longer has (a removal can shift a later route into slot i)
+	for(i = 0; i < FIB_SIZE; i++) {
+		pthread_mutex_lock(&st->fib_lock);
+		struct fib_entry e = st->fib[i];
+		pthread_mutex_unlock(&st->fib_lock);
+		if(e.used && !e.seen && fib_remove(e.prefix, e.len, e.origin) == 0)
+			i--;
+	}
+
+	if(!api.failed)
+		sync_resync(api.routes, api.count);
+	free(api.routes);
+	return 0;
+}
+
+void fib_event(struct net_event *ev)
+{
+	struct fib_state *st = testbed()->fib;
+	if(st == NULL || (ev->table != RT_TABLE_MAIN && ev->table != testbed()->route->route_table))
+		return;
+	uint8_t origin = table_origin(ev->table);
+	if(ev->type == EVENT_ROUTE_DEL) { // deleted by the kernel or another program
+		fib_remove(ev->address, ev->prefix_len, origin);
+		if(ev->table == testbed()->route->route_table)
+			sync_forget(ev->address, ev->prefix_len, ev->metric);
+		return;
+	}
+
+	pthread_mutex_lock(&st->fib_lock);
+	int known = (find_slot(ev->address & prefix_mask(ev->prefix_len), ev->prefix_len, origin) >= 0);
+	pthread_mutex_unlock(&st->fib_lock);
+
+	if(known && origin == FIB_ORIGIN_API) // echo of our own change, already mirrored
+		return;
+	if(known || st->mirror_all)
+		fib_insert(ev->address, ev->prefix_len, ev->next_hop, ev->ifindex, origin);
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SearchTable(uint32_t dest_address, uint32_t *next_hop)
+{
+	struct fib_entry e;
+	if(!fib_lookup(dest_address, &e))
+		return 0;
+	if(next_hop != NULL)
+		*next_hop = e.next_hop;
+	return 1;
+}
+
+int MirrorMainTable()
+{
+	struct fib_state *st = testbed()->fib;
+	st->mirror_all = 1;
+	return dump_routes(parse_rt_msg, NULL);
+}
+
+int InitializeFib()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct fib_state *st = node->fib;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->fib_lock, NULL);
+		node->fib = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	if(st == NULL)
+		return -1;
+
+	write_begin();
+	memset(st->fib, 0, sizeof(st->fib));
+	memset(st->len_count, 0, sizeof(st->len_count));
+	memset(st->num_lens, 0, sizeof(st->num_lens));
+	st->fib_count = 0;
+	write_end();
+	return 0;
+}
@@ -0,0 +1,414 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SetQueueHandoff - run every queue callback on one protocol worker thread
+- SetQueueWorkers - spread the incoming data and forward callbacks over a pool of workers, in order within each flow
+
+By default each queue thread calls the user's callback itself, so callbacks run on four
+threads and the protocol's tables must be locked (and their cache lines move between cores).
+With the handoff the queue threads only parse each packet and put a handle to its receive
+buffer (see api_pool.c) into a bounded lock-free ring (many producers, one consumer), so the
+packet is never copied; one worker takes the packets in batches,
+calls the callbacks and issues the verdicts, so the protocol's data stays on one core.
+
+Heavy data-plane callbacks (inspection, encryption) need the opposite: more cores. The worker
+pool gives each worker its own ring and sends every packet of a flow to the same worker, so
+flows are handled in parallel while the packets of one flow (a TCP connection) keep their order.
+Neither is set up until SetQueueHandoff or SetQueueWorkers first asks for it.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_queue.h"
+#include "api_loop.h"
+#include "api_pool.h"
+#include "api_handoff.h"
+
+static __thread int pushed = 0; // packets the calling queue thread pushed since its last wake
+static __thread uint32_t pushed_workers = 0; // pool rings the calling queue thread pushed to since its last wake, one bit each
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// allocate the handoff state on first use
+static struct handoff_state *handoff_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct handoff_state *st = node->handoff;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL)
+		node->handoff = st;
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+struct pkt_ring *ring_create()
+{
+	struct pkt_ring *r = aligned_alloc(CACHE_LINE, sizeof(struct pkt_ring));
+	if(r == NULL)
+		return NULL;
+	memset(r, 0, sizeof(*r));
+
+	size_t i;
+	for(i = 0; i < HANDOFF_RING_LEN; i++)
+		atomic_init(&r->slots[i].seq, i);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->sleeping, 0);
+	atomic_init(&r->full_waiters, 0);
+	r->head = 0;
+	r->wake_fd = eventfd(0, EFD_CLOEXEC);
+	r->space_fd = eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE); // one read per waiting receiver
+	if(r->wake_fd < 0 || r->space_fd < 0) {
+		if(r->wake_fd >= 0)
+			close(r->wake_fd);
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+struct pkt_desc *ring_reserve(struct pkt_ring *r, size_t *pos)
+{
+	size_t p = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	while(1) {
+		struct ring_slot *s = &r->slots[p & (HANDOFF_RING_LEN - 1)];
+		size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)p;
+		if(dif == 0) { // free, try to take it
+			if(atomic_compare_exchange_weak_explicit(&r->tail, &p, p + 1, memory_order_relaxed, memory_order_relaxed)) {
+				*pos = p;
+				return &s->d;
+			}
+		}
+		else if(dif < 0) { // full, sleep until the worker frees slots
+			ring_wake(r);
+			atomic_fetch_add_explicit(&r->full_waiters, 1, memory_order_relaxed);
+			atomic_thread_fence(memory_order_seq_cst); // full_waiters is seen before the slot is checked again
+			if(atomic_load_explicit(&s->seq, memory_order_acquire) == seq) {
+				uint64_t n;
+				wait_begin(); // DestroyTestbed may have stopped the worker
+				read(r->space_fd, &n, sizeof(n));
+				wait_end();
+			}
+			atomic_fetch_sub_explicit(&r->full_waiters, 1, memory_order_relaxed);
+			p = atomic_load_explicit(&r->tail, memory_order_relaxed);
+		}
+		else { // another receiver took it
+			p = atomic_load_explicit(&r->tail, memory_order_relaxed);
+		}
+	}
+}
+
+void ring_publish(struct pkt_ring *r, size_t pos)
+{
+	atomic_store_explicit(&r->slots[pos & (HANDOFF_RING_LEN - 1)].seq, pos + 1, memory_order_release);
+}
+
+struct pkt_desc *ring_peek(struct pkt_ring *r)
+{
+	struct ring_slot *s = &r->slots[r->head & (HANDOFF_RING_LEN - 1)];
+	if(atomic_load_explicit(&s->seq, memory_order_acquire) != r->head + 1)
+		return NULL;
+	return &s->d;
+}
+
+void ring_release(struct pkt_ring *r)
+{
+	struct ring_slot *s = &r->slots[r->head & (HANDOFF_RING_LEN - 1)];
+	atomic_store_explicit(&s->seq, r->head + HANDOFF_RING_LEN, memory_order_release);
+	r->head++;
+	if((r->head & (HANDOFF_BATCH - 1)) == 0) // receivers waiting on a full ring can go on
+		ring_space(r);
+}
+
+void ring_destroy(struct pkt_ring *r)
+{
+	close(r->wake_fd);
+	close(r->space_fd);
+	free(r);
+}
+
+void ring_wake(struct pkt_ring *r)
+{
+	atomic_thread_fence(memory_order_seq_cst); // the published slots are seen before sleeping is read
+	if(atomic_load_explicit(&r->sleeping, memory_order_relaxed)) {
+		uint64_t one = 1;
+		write(r->wake_fd, &one, sizeof(one));
+	}
+}
+
+void ring_space(struct pkt_ring *r)
+{
+	atomic_thread_fence(memory_order_seq_cst); // the released slots are seen before full_waiters is read
+	int n = atomic_load_explicit(&r->full_waiters, memory_order_relaxed);
+	if(n > 0) {
+		uint64_t v = n;
+		write(r->space_fd, &v, sizeof(v));
+	}
+}
+
+void ring_wait(struct pkt_ring *r)
+{
+	ring_space(r); // slots released since the last multiple of HANDOFF_BATCH
+	atomic_store_explicit(&r->sleeping, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst); // sleeping is seen before the ring is checked
+	if(ring_peek(r) == NULL) {
+		uint64_t n;
+		wait_begin();
+		read(r->wake_fd, &n, sizeof(n));
+		wait_end();
+	}
+	atomic_store_explicit(&r->sleeping, 0, memory_order_relaxed);
+}
+
+int handoff_enabled()
+{
+	struct handoff_state *st = testbed()->handoff;
+	return st != NULL && atomic_load_explicit(&st->enabled, memory_order_relaxed);
+}
+
+int handoff_push(struct nfq_q_handle *qh, uint32_t id, uint16_t queue, struct packet *pkt)
+{
+	struct handoff_state *st = testbed()->handoff;
+	pkt = packet_hold(pkt);
+	if(pkt == NULL) // needed a copy and every buffer is held
+		return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
+
+	size_t pos;
+	struct pkt_desc *d = ring_reserve(st->ring, &pos);
+	d->qh = qh;
+	d->id = id;
+	d->queue = queue;
+	d->pkt = pkt;
+	ring_publish(st->ring, pos);
+	pushed++;
+	return 0;
+}
+
+int workers_enabled(uint16_t queue)
+{
+	if(queue != QUEUE_IN_DATA && queue != QUEUE_FORWARD) // control packets stay in order on one thread
+		return 0;
+	struct handoff_state *st = testbed()->handoff;
+	return st != NULL && atomic_load_explicit(&st->num_workers, memory_order_relaxed) > 0;
+}
+
+static uint32_t flow_hash(struct packet *pkt)
+{
+	struct iphdr *iph = (struct iphdr *)pkt->raw_pack;
+	if(pkt->length < sizeof(struct iphdr))
+		return 0;
+
+	uint32_t h = (iph->saddr * 0x9e3779b1) ^ iph->daddr;
+	h = (h ^ iph->protocol) * 0x85ebca6b;
+	uint32_t hdr_len = iph->ihl * 4;
+	if((iph->protocol == IPPROTO_TCP || iph->protocol == IPPROTO_UDP) &&
+	   !(iph->frag_off & htons(0x3fff)) && pkt->length >= hdr_len + 4) { // not a fragment (MF flag and offset clear)
+		uint32_t ports; // source and destination port
+		memcpy(&ports, pkt->raw_pack + hdr_len, sizeof(ports));
+		h = (h ^ ports) * 0xc2b2ae35;
+	}
+	return h ^ (h >> 16);
+}
+
+int worker_push(struct nfq_q_handle *qh, uint32_t id, uint16_t queue, struct packet *pkt)
+{
+	struct handoff_state *st = testbed()->handoff;
+	uint32_t w = flow_hash(pkt) % atomic_load_explicit(&st->num_workers, memory_order_relaxed);
+	pkt = packet_hold(pkt);
+	if(pkt == NULL) // needed a copy and every buffer is held
+		return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
+
+	size_t pos;
+	struct pkt_desc *d = ring_reserve(st->pool_rings[w], &pos);
+	d->qh = qh;
+	d->id = id;
+	d->queue = queue;
+	d->pkt = pkt;
+	ring_publish(st->pool_rings[w], pos);
+	pushed_workers |= 1u << w;
+	return 0;
+}
+
+void handoff_wake()
+{
+	struct handoff_state *st = testbed()->handoff;
+	if(st == NULL) // nothing was ever pushed
+		return;
+	if(pushed > 0 && st->ring != NULL)
+		ring_wake(st->ring);
+	pushed = 0;
+
+	int i;
+	for(i = 0; pushed_workers != 0; i++, pushed_workers >>= 1) {
+		if(pushed_workers & 1)
+			ring_wake(st->pool_rings[i]);
+	}
+}
+
+uint8_t handoff_callback(struct pkt_desc *d)
+{
+	struct queue_state *q = testbed()->queue;
+	CallbackFunction cb = NULL;
+	switch(d->queue) {
+	case QUEUE_IN_CONTROL:
+		cb = q->incoming_control;
+		break;
+	case QUEUE_IN_DATA:
+		cb = q->incoming_data;
+		break;
+	case QUEUE_OUT:
+		cb = q->outgoing;
+		break;
+	case QUEUE_FORWARD:
+		cb = q->forwarded;
+		break;
+	}
+	if(cb == NULL)
+		return PACKET_ACCEPT;
+
+	struct packet *pkt = d->pkt;
+	clock_gettime(CLOCK_REALTIME, &pkt->info.deliver_time); // time spent in the ring counts as queueing delay
+	return (*cb)(pkt->raw_pack, pkt->src, pkt->dest, pkt->payload, pkt->payload_length, &pkt->info);
+}
+
+static void add_verdict(struct verdict_batch *b, struct pkt_desc *d, uint8_t verdict)
+{
+	struct verdict_batch *v = &b[d->queue];
+	if(verdict != PACKET_DROP) { // ids of one queue arrive in order, so the last one covers the rest
+		v->qh = d->qh;
+		v->id = d->id;
+		return;
+	}
+	if(v->qh != NULL) {
+		nfq_set_verdict_batch(v->qh, v->id, NF_ACCEPT);
+		v->qh = NULL;
+	}
+	nfq_set_verdict(d->qh, d->id, NF_DROP, 0, NULL);
+}
+
+static void flush_verdicts(struct verdict_batch *b)
+{
+	int i;
+	for(i = 0; i <= QUEUE_IN_DATA; i++) {
+		if(b[i].qh != NULL) {
+			nfq_set_verdict_batch(b[i].qh, b[i].id, NF_ACCEPT);
+			b[i].qh = NULL;
+		}
+	}
+}
+
+void *thread_func_handoff()
+{
+	struct handoff_state *st = testbed()->handoff;
+	struct verdict_batch b[QUEUE_IN_DATA + 1];
+	memset(b, 0, sizeof(b));
+
+	while(1) {
+		ring_wait(st->ring);
+
+		int n = 0;
+		struct pkt_desc *d;
+		while((d = ring_peek(st->ring)) != NULL) {
+			add_verdict(b, d, handoff_callback(d));
+			ReleasePacket(d->pkt); // the buffer stays out of the pool if the callback held it
+			ring_release(st->ring);
+			if(++n == HANDOFF_BATCH) {
+				flush_verdicts(b);
+				n = 0;
+			}
+		}
+		flush_verdicts(b);
+	}
+	return NULL;
+}
+
+void *thread_func_worker()
+{
+	struct handoff_state *st = testbed()->handoff;
+	struct pkt_ring *r = st->pool_rings[atomic_fetch_add(&st->next_worker, 1)]; // created before this thread
+
+	while(1) {
+		ring_wait(r);
+
+		struct pkt_desc *d;
+		while((d = ring_peek(r)) != NULL) {
+			if(handoff_callback(d) == PACKET_DROP)
+				nfq_set_verdict(d->qh, d->id, NF_DROP, 0, NULL);
+			else
+				nfq_set_verdict(d->qh, d->id, NF_ACCEPT, 0, NULL);
+			ReleasePacket(d->pkt);
+			ring_release(r);
+		}
+	}
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SetQueueHandoff(uint8_t enable)
+{
+	struct testbed *node = testbed();
+	struct handoff_state *st = node->handoff;
+	if(loop_enabled()) // the event loop already runs every callback on one thread
+		return -1;
+	if(st == NULL && !enable) // stays off, nothing to allocate
+		return 0;
+	if(st == NULL && (st = handoff_alloc()) == NULL)
+		return -1;
+
+	pthread_mutex_lock(&node->lock);
+	if(enable && st->ring == NULL) {
+		st->ring = ring_create();
+		if(st->ring == NULL || start_thread(&st->worker_thread, thread_func_handoff)) {
+			printf("error creating protocol worker thread\n");
+			if(st->ring != NULL) {
+				ring_destroy(st->ring);
+				st->ring = NULL;
+			}
+			pthread_mutex_unlock(&node->lock);
+			return -1;
+		}
+	}
+	atomic_store(&st->enabled, enable != 0);
+	pthread_mutex_unlock(&node->lock);
+	return 0;
+}
+
+int SetQueueWorkers(uint8_t workers)
+{
+	struct testbed *node = testbed();
+	struct handoff_state *st = node->handoff;
+	struct queue_state *q = node->queue;
+	if(loop_enabled() || workers > HANDOFF_MAX_WORKERS)
+		return -1;
+	if(st == NULL && workers == 0) // stays off, nothing to allocate
+		return 0;
+	if(st == NULL && (st = handoff_alloc()) == NULL)
+		return -1;
+
+	pthread_mutex_lock(&node->lock);
+	if(q != NULL && (q->incoming_data != NULL || q->forwarded != NULL)) { // flows would move between workers
+		pthread_mutex_unlock(&node->lock);
+		return -1;
+	}
+	int i;
+	for(i = 0; i < workers; i++) {
+		if(st->pool_rings[i] != NULL) // started by an earlier call
+			continue;
+		st->pool_rings[i] = ring_create();
+		if(st->pool_rings[i] == NULL || start_thread(&st->pool_threads[i], thread_func_worker)) {
+			printf("error creating callback worker thread\n");
+			if(st->pool_rings[i] != NULL) {
+				ring_destroy(st->pool_rings[i]);
+				st->pool_rings[i] = NULL;
+			}
+			pthread_mutex_unlock(&node->lock);
+			return -1;
+		}
+	}
+	atomic_store(&st->num_workers, workers);
+	pthread_mutex_unlock(&node->lock);
+	return 0;
+}
@@ -1,24 +1,96 @@
 /*
 Andre Koka - Created 9/28/2023
-             Last Updated: 11/7/2023
+             Last Updated: 10/19/2026
 
 The basic API file for the MANET Testbed - to implement:
-- GetInterfaceIP - retrieve ipv4 of an interface given its index
-- SetInterface 	 - set current working interface (UNUSED)
+- GetInterfaceIP - retrieve ipv4 of an interface given its name, from the address cache
+- SetInterface 	 - add an interface (radio) to the set used by the testbed
 - InitializeIF() - set global and local ip address for later use
-				 - open netlink socket for testbed
+				 - open netlink socket for the initializing thread
+
+The addresses of every interface are read with one RTM_GETADDR dump and kept in a cache
+that the event thread updates on RTM_NEWADDR/RTM_DELADDR. Readers never lock (the cache is
+a seqlock like the route mirror), so checking an address costs no netlink round trip. The
+testbed interfaces are updated under the same seqlock, and a new interface is published by
+storing num_ifaces after its slot is set up, so the send path and the queue, event and
+metrics threads read them without locking.
 
 Adapted from: https://github.com/d0u9/examples/blob/master/C/netlink/ip_show.c
 */
 
 #include "api.h"
 #include "api_if.h"
-
-uint32_t * addr; // stores address to return
-char  *interface_name = "wlan0"; // wlan0 by default
+#include "api_send.h"
 
 // ---------------------- HELPER FUNCTIONS ------------------
 
+// allocate the interface cache of the node on first use (SetInterface may come before InitializeAPI)
+static struct if_state *if_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct if_state *st = node->iface;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->cache_lock, NULL);
+		node->iface = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+// if_nametoindex in the node's namespace (see ns_run)
+static int name_to_index(void *name)
+{
+	return if_nametoindex(name);
+}
+
+static void cache_write_begin()
+{
+	struct if_state *st = testbed()->iface;
+	pthread_mutex_lock(&st->cache_lock);
+	atomic_fetch_add_explicit(&st->cache_seq, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static void cache_write_end()
+{
+	struct if_state *st = testbed()->iface;
+	atomic_fetch_add_explicit(&st->cache_seq, 1, memory_order_release);
+	pthread_mutex_unlock(&st->cache_lock);
+}
+
+// update the addresses of a testbed interface, NULL if it has none (cache_lock held)
+static void set_if_addr(struct testbed_if *iface, struct if_addr *entry)
+{
+	struct testbed *node = testbed();
+	iface->local_ip = (entry != NULL) ? entry->local_ip : 0;
+	iface->broadcast_ip = (entry != NULL) ? entry->broadcast_ip : 0;
+	if(entry != NULL)
+		iface->prefix_len = entry->prefix_len;
+	if(iface == &node->ifaces[0]) { // keep the primary interface fields of the node in sync
+		node->local_ip = iface->local_ip;
+		node->broadcast_ip = iface->broadcast_ip;
+	}
+}
+
+// the address a testbed interface should use: its current one while cached, else a primary one (cache_lock held)
+static struct if_addr *pick_if_addr(struct testbed_if *iface)
+{
+	struct if_state *st = testbed()->iface;
+	struct if_addr *any = NULL;
+	uint32_t i;
+	for(i = 0; i < st->cache_count; i++) {
+		struct if_addr *a = &st->cache[i];
+		if(a->index != iface->index)
+			continue;
+		if(iface->local_ip != 0 && a->local_ip == iface->local_ip)
+			return a;
+		if(any == NULL || (any->secondary && !a->secondary))
+			any = a;
+	}
+	return any;
+}
+
 static int get_ip(struct sockaddr_nl *sa, int domain) // send netlink message to get ip
 {
 	char buf[BUFLEN];
@@ -35,98 +107,294 @@ static int get_ip(struct sockaddr_nl *sa, int domain) // send netlink message to
 	ifa = (struct ifaddrmsg*)NLMSG_DATA(nl);
 	ifa->ifa_family = domain; // we only get ipv4 address here
 
-	// prepare struct msghdr for sending.
-	struct iovec iov = { nl, nl->nlmsg_len };
-	struct msghdr msg = { sa, sizeof(*sa), &iov, 1, NULL, 0, 0 };
-
-	// send netlink message to kernel.
-	int r = sendmsg(fd, &msg, 0);
-	return (r < 0) ? -1 : 0;
+	// send netlink message to kernel, returns its sequence number
+	return nl_send(sa, nl);
 }
 
-static int parse_ifa_msg(struct ifaddrmsg *ifa, void *buf, size_t len, uint8_t type)
+int parse_ifa_msg(struct ifaddrmsg *ifa, void *buf, size_t len, struct if_addr *entry)
 {
-	// parse information only when this is the desired interface
-	if(ifa->ifa_index == if_nametoindex(interface_name)) {
-		struct rtattr *rta = NULL;
-		for_each_rattr(rta, buf, len) {
-			if (rta->rta_type == IFA_ADDRESS && !type) {
-				addr = (uint32_t  *)RTA_DATA(rta);
-			}
-			else if (rta->rta_type == IFA_LOCAL) {}
-			else if (rta->rta_type == IFA_BROADCAST && type) {
-				addr = (uint32_t *)RTA_DATA(rta);
-			}
-		}
-	}
-	else if (if_nametoindex(interface_name) == 0) // handling bad interface name
-		f_err = -1;
+	memset(entry, 0, sizeof(*entry));
+	entry->index = ifa->ifa_index;
+	entry->prefix_len = ifa->ifa_prefixlen;
+	entry->secondary = (ifa->ifa_flags & IFA_F_SECONDARY) != 0;
 
-	return f_err;
+	struct rtattr *rta = NULL;
+	for_each_rattr(rta, buf, len) {
+		if (rta->rta_type == IFA_ADDRESS)
+			memcpy(&entry->local_ip, RTA_DATA(rta), sizeof(entry->local_ip)); // copy out, buf is reused
+		else if (rta->rta_type == IFA_BROADCAST)
+			memcpy(&entry->broadcast_ip, RTA_DATA(rta), sizeof(entry->broadcast_ip));
+		else if (rta->rta_type == IFA_LABEL)
+			strncpy(entry->name, RTA_DATA(rta), IF_NAMESIZE - 1);
+	}
+	return 0;
 }
 
-static uint32_t parse_nl_if_msg(void *buf, size_t len, uint8_t type)
+static uint32_t parse_nl_if_msg(void *buf, size_t len, struct if_addr *entries, uint32_t *count)
 {
 	// only handle ERROR and NEW_ADDR message types
 	struct nlmsghdr *nl = NULL;
 	for_each_nlmsg(nl, buf, len) {
-		if (nl->nlmsg_type == NLMSG_ERROR) {
-			f_err = -1;
-			return -1;
-		}
+		if (nl->nlmsg_type == NLMSG_ERROR)
+			return NLMSG_ERROR;
 
-		if (nl->nlmsg_type == RTM_NEWADDR) {
+		if (nl->nlmsg_type == RTM_NEWADDR && *count < IF_CACHE_MAX) {
 			struct ifaddrmsg *ifa;
 			ifa = (struct ifaddrmsg*)NLMSG_DATA(nl);
-			parse_ifa_msg(ifa, IFA_RTA(ifa), IFA_PAYLOAD(nl), type);
+			parse_ifa_msg(ifa, IFA_RTA(ifa), IFA_PAYLOAD(nl), &entries[(*count)++]);
 			continue;
 		}
 	}
 	return nl->nlmsg_type;
 }
 
-// ---------------------- API FUNCTIONS ------------------
-
-uint32_t GetInterfaceIP(uint8_t *interface, uint8_t type)
+int if_cache_load()
 {
-	pthread_mutex_lock(&lock); // thread safety
-
-	int len = 0;
-	if(interface != NULL) // if bad input, use last inteface (wlan0 default)
-		interface_name = (char *)interface; 
+	struct if_state *st = if_alloc();
+	struct if_addr entries[IF_CACHE_MAX];
+	uint32_t count = 0;
+	if(st == NULL)
+		return -1;
 
 	// create netlink socket address
 	struct sockaddr_nl sa;
 	memset(&sa, 0, sizeof(sa));
 	sa.nl_family = AF_NETLINK;
 
-	// send netlink message requesting ip
-	len = get_ip(&sa, AF_INET);
-	check(len);
+	// send netlink message requesting every ip
+	int seq = get_ip(&sa, AF_INET);
+	if(seq < 0)
+		return -1;
 
 	// receive and parse netlink reply
 	char buf[BUFLEN];
 	uint32_t nl_msg_type;
 	do {
-		len = get_msg(&sa, buf, BUFLEN);
-		check(len);
-		nl_msg_type = parse_nl_if_msg(buf, len, type);
+		int len = get_reply(&sa, buf, BUFLEN, seq);
+		if(len < 0)
+			return -1;
+		nl_msg_type = parse_nl_if_msg(buf, len, entries, &count);
 	} while (nl_msg_type != NLMSG_DONE && nl_msg_type != NLMSG_ERROR);
+	if(nl_msg_type == NLMSG_ERROR)
+		return -1;
+
+	cache_write_begin();
+	memcpy(st->cache, entries, count * sizeof(entries[0]));
+	st->cache_count = count;
+	st->cache_loaded = 1;
+
+	// refresh the testbed interfaces too, addresses may have changed while events were lost
+	struct testbed *node = testbed();
+	int i, n = if_count();
+	for(i = 0; i < n; i++)
+		set_if_addr(&node->ifaces[i], pick_if_addr(&node->ifaces[i]));
+	cache_write_end();
+	return 0;
+}
+
+void if_cache_update(int add, struct if_addr *entry)
+{
+	struct if_state *st = testbed()->iface;
+	cache_write_begin();
+	uint32_t i;
+	for(i = 0; i < st->cache_count; i++) {
+		if(st->cache[i].index == entry->index && st->cache[i].local_ip == entry->local_ip)
+			break;
+	}
+	if(add && i == st->cache_count && st->cache_count < IF_CACHE_MAX)
+		st->cache_count++; // new address
+	if(add && i < st->cache_count)
+		st->cache[i] = *entry;
+	else if(!add && i < st->cache_count) // removed, keep the cache packed
+		st->cache[i] = st->cache[--st->cache_count];
 
-	pthread_mutex_unlock(&lock);
-	return (f_err != 0) ? -1 : *addr;
+	// a secondary address does not replace the interface's address, and a removed one falls back to another
+	struct testbed_if *iface = if_by_index(entry->index);
+	if(iface != NULL)
+		set_if_addr(iface, pick_if_addr(iface));
+	cache_write_end();
+}
+
+int if_cache_find(unsigned int index, const char *name, struct if_addr *out)
+{
+	struct if_state *st = testbed()->iface;
+	unsigned int seq;
+	int found;
+	if(st == NULL)
+		return 0;
+	do {
+		seq = atomic_load_explicit(&st->cache_seq, memory_order_acquire);
+		found = 0;
+		if(seq & 1)
+			continue; // writer in progress
+
+		uint32_t i;
+		for(i = 0; i < st->cache_count && i < IF_CACHE_MAX; i++) {
+			if(index ? (st->cache[i].index == index) : (strncmp(st->cache[i].name, name, IF_NAMESIZE) == 0)) {
+				if(found && st->cache[i].secondary) // keep the primary address found first
+					continue;
+				*out = st->cache[i];
+				found = 1;
+				if(!out->secondary)
+					break;
+			}
+		}
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->cache_seq, memory_order_relaxed));
+	return found;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+uint32_t GetInterfaceIP(uint8_t *interface, uint8_t type)
+{
+	struct testbed *node = testbed();
+	struct if_state *st = if_alloc();
+	if(st == NULL || (!st->cache_loaded && if_cache_load() < 0)) // first call (the event thread keeps it current after that)
+		return -1;
+
+	struct if_addr entry;
+	int found;
+	if(interface != NULL) // label of the address, the interface name unless it has an alias
+		found = if_cache_find(0, (char *)interface, &entry);
+	else if(if_count() > 0) // no name given, use the primary interface
+		found = if_cache_find(node->ifaces[0].index, NULL, &entry);
+	else
+		found = if_cache_find(0, DEFAULT_INTERFACE, &entry);
+	if(!found) // handling bad interface name
+		return -1;
+
+	return (type == 0) ? entry.local_ip : entry.broadcast_ip;
+}
+
+int SetInterface(uint8_t *interface)
+{
+	struct testbed *node = testbed();
+	struct if_state *st = if_alloc();
+	if(interface == NULL || st == NULL)
+		return -1;
+
+	int index = ns_run(name_to_index, interface);
+	if(index <= 0)
+		return -1;
+	if(if_by_index(index) != NULL) // already in use
+		return 0;
+
+	struct if_addr entry;
+	if((!st->cache_loaded && if_cache_load() < 0) || !if_cache_find(index, NULL, &entry))
+		return -1;
+	uint8_t hw_stamps;
+	int sock = open_if_sock((char *)interface, &hw_stamps);
+	if(sock < 0)
+		return -1;
+
+	// readers never lock: set the new slot up, then publish it by storing the new count
+	pthread_mutex_lock(&st->cache_lock);
+	int n = atomic_load_explicit(&node->num_ifaces, memory_order_relaxed);
+	if(n == MAX_INTERFACES || if_by_index(index) != NULL) {
+		pthread_mutex_unlock(&st->cache_lock);
+		close(sock);
+		return (n == MAX_INTERFACES) ? -1 : 0;
+	}
+	struct testbed_if *iface = &node->ifaces[n];
+	memset(iface, 0, sizeof(*iface));
+	strncpy(iface->name, (char *)interface, IF_NAMESIZE - 1);
+	iface->index = index;
+	iface->sock = sock;
+	iface->hw_stamps = hw_stamps;
+	set_if_addr(iface, &entry); // the first interface is the primary one
+	atomic_store_explicit(&node->num_ifaces, n + 1, memory_order_release);
+	pthread_mutex_unlock(&st->cache_lock);
+	return 0;
+}
+
+int if_count()
+{
+	return atomic_load_explicit(&testbed()->num_ifaces, memory_order_acquire);
+}
+
+uint32_t if_broadcast(struct testbed_if *iface)
+{
+	struct if_state *st = testbed()->iface;
+	unsigned int seq;
+	uint32_t brd;
+	do {
+		seq = atomic_load_explicit(&st->cache_seq, memory_order_acquire);
+		brd = iface->broadcast_ip;
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->cache_seq, memory_order_relaxed));
+	return brd;
+}
+
+int if_for_addr(uint32_t address)
+{
+	struct testbed *node = testbed();
+	struct if_state *st = node->iface;
+	unsigned int seq;
+	int i, n, index;
+	if(st == NULL) // no interfaces yet
+		return 0;
+	do {
+		seq = atomic_load_explicit(&st->cache_seq, memory_order_acquire);
+		n = if_count();
+		index = (n > 0) ? node->ifaces[0].index : 0; // the primary interface if none match
+		for(i = 0; i < n; i++) { // pick the interface whose subnet holds the address
+			uint32_t mask = (node->ifaces[i].prefix_len == 0) ? 0 : htonl(~0U << (32 - node->ifaces[i].prefix_len));
+			if((address & mask) == (node->ifaces[i].local_ip & mask)) {
+				index = node->ifaces[i].index;
+				break;
+			}
+		}
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->cache_seq, memory_order_relaxed));
+	return index;
+}
+
+struct testbed_if *if_by_index(int index)
+{
+	struct testbed *node = testbed();
+	int i, n = if_count();
+	for(i = 0; i < n; i++) { // slots never move and their index is set before they are published
+		if(node->ifaces[i].index == index)
+			return &node->ifaces[i];
+	}
+	return NULL;
+}
+
+int is_own_broadcast(uint32_t src, uint32_t dest)
+{
+	struct testbed *node = testbed();
+	struct if_state *st = node->iface;
+	unsigned int seq;
+	int i, n, own;
+	if(st == NULL)
+		return 0;
+	do {
+		seq = atomic_load_explicit(&st->cache_seq, memory_order_acquire);
+		n = if_count();
+		own = 0;
+		for(i = 0; i < n; i++) {
+			if(dest == node->ifaces[i].broadcast_ip && src == node->ifaces[i].local_ip) {
+				own = 1;
+				break;
+			}
+		}
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->cache_seq, memory_order_relaxed));
+	return own;
 }
 
 int InitializeIF()
 {
-	if(!fd) {  // create socket
-		fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-		check(fd); }
+	struct testbed *node = testbed();
+	if(if_alloc() == NULL)
+		return -1;
+	check(nl_sock()); // netlink socket of the initializing thread
 	
-	local_ip = GetInterfaceIP(NULL, 0); // set global vars
-	broadcast_ip = GetInterfaceIP(NULL, 1); // set global vars
+	if(if_count() == 0) // no SetInterface before InitializeAPI, use the default radio
+		check(SetInterface((uint8_t *)DEFAULT_INTERFACE));
 	
-	if(local_ip == 0 || broadcast_ip == 0 || f_err != 0)
+	if(node->local_ip == 0 || node->broadcast_ip == 0 || node->f_err != 0)
 		return -1;
 	else
 		return 0;
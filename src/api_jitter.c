@@ -0,0 +1,203 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SetBroadcastJitter - enable RFC 5148 jitter (and optional merging) for broadcasts
+- InitializeJitter() - nothing to do until jitter is enabled (kept for the InitializeAPI sequence)
+
+Neighbours that receive the same flooded message would otherwise rebroadcast it at
+nearly the same time and collide. Jittered broadcasts are held by a timer thread and
+then handed to the send scheduler (api_sched.c). In event loop mode each held broadcast
+gets a StartTimer timer instead, so it is sent from the loop's thread. The held broadcasts
+take about 90 KB, so they and the timer thread are only set up the first time jitter is enabled.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_sched.h"
+#include "api_jitter.h"
+#include "api_loop.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+static int before(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec < b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// allocate the jitter state and start its timer thread on first use
+static struct jitter_state *jitter_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct jitter_state *st = node->jitter;
+	if(st != NULL || (st = calloc(1, sizeof(*st))) == NULL) {
+		pthread_mutex_unlock(&node->state_lock);
+		return st;
+	}
+	pthread_mutex_init(&st->jitter_lock, NULL);
+	pthread_condattr_t attr; // jitter timers run on the monotonic clock
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&st->jitter_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	// seed with the node address so neighbours do not pick the same delays
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	st->seed = node->local_ip ^ now.tv_nsec ^ getpid();
+	node->jitter = st;
+
+	// in event loop mode held broadcasts use StartTimer timers instead of a thread
+	if(!loop_enabled() && start_thread(&st->jitter_thread, thread_func_jitter)) {
+		printf("error creating jitter thread\n");
+		st->max_jitter = JITTER_BROKEN;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+// copy a due broadcast out of its slot and hand it to the scheduler (called with jitter_lock held)
+static void send_slot(struct jitter_msg *j)
+{
+	struct jitter_state *st = testbed()->jitter;
+	uint8_t buf[JITTER_MAX_PACKET];
+	uint32_t size = j->size;
+	uint8_t msg_class = j->msg_class;
+	int ifindex = j->ifindex;
+	memcpy(buf, j->buf, size);
+	j->used = 0;
+	pthread_mutex_unlock(&st->jitter_lock); // send without holding the lock
+	sched_send(0, buf, size, 1, msg_class, ifindex);
+	pthread_mutex_lock(&st->jitter_lock);
+}
+
+// timer callback of one held broadcast (event loop mode)
+static void jitter_expire(void *arg)
+{
+	struct jitter_state *st = testbed()->jitter;
+	struct jitter_msg *j = &st->pending[(uintptr_t)arg];
+	pthread_mutex_lock(&st->jitter_lock);
+	if(j->used)
+		send_slot(j);
+	pthread_mutex_unlock(&st->jitter_lock);
+}
+
+int jitter_send(uint8_t *msg_buf, uint32_t size, uint8_t msg_class, int ifindex)
+{
+	struct jitter_state *st = testbed()->jitter;
+	if(st == NULL) // jitter was never enabled
+		return sched_send(0, msg_buf, size, 1, msg_class, ifindex);
+	pthread_mutex_lock(&st->jitter_lock);
+	if(st->max_jitter == 0 || st->max_jitter == JITTER_BROKEN || size > JITTER_MAX_PACKET) { // no jitter, send through the scheduler now
+		pthread_mutex_unlock(&st->jitter_lock);
+		return sched_send(0, msg_buf, size, 1, msg_class, ifindex);
+	}
+
+	int i, slot = -1;
+	for(i = 0; i < JITTER_MAX_PENDING; i++) {
+		struct jitter_msg *j = &st->pending[i];
+		// RFC 5148: a message can ride along with a pending one, keeping the pending timer
+		if(st->merge_pending && j->used && j->msg_class == msg_class && j->ifindex == ifindex && j->size + size <= JITTER_MAX_PACKET) {
+			memcpy(j->buf + j->size, msg_buf, size);
+			j->size += size;
+			pthread_mutex_unlock(&st->jitter_lock);
+			return 0;
+		}
+		if(!j->used && slot < 0)
+			slot = i;
+	}
+
+	if(slot < 0) { // every timer is in use, send without jitter rather than drop
+		pthread_mutex_unlock(&st->jitter_lock);
+		return sched_send(0, msg_buf, size, 1, msg_class, ifindex);
+	}
+
+	// pick a uniformly random delay in [0, max_jitter] ms
+	struct jitter_msg *j = &st->pending[slot];
+	long delay = (long)(((double)rand_r(&st->seed) / RAND_MAX) * st->max_jitter * 1000000);
+	clock_gettime(CLOCK_MONOTONIC, &j->due);
+	j->due.tv_sec += delay / 1000000000;
+	j->due.tv_nsec += delay % 1000000000;
+	if(j->due.tv_nsec >= 1000000000) {
+		j->due.tv_sec++;
+		j->due.tv_nsec -= 1000000000;
+	}
+	j->msg_class = msg_class;
+	j->ifindex = ifindex;
+	j->size = size;
+	memcpy(j->buf, msg_buf, size);
+	j->used = 1;
+
+	if(loop_enabled()) { // the timing wheel has 1 ms ticks, round up
+		if(StartTimer((delay + 999999) / 1000000, 0, jitter_expire, (void *)(uintptr_t)slot) < 0)
+			send_slot(j);
+	}
+	else
+		pthread_cond_signal(&st->jitter_cond); // timer thread may need to wake earlier
+	pthread_mutex_unlock(&st->jitter_lock);
+	return 0;
+}
+
+void *thread_func_jitter()
+{
+	struct jitter_state *st = testbed()->jitter;
+	struct timespec now;
+
+	pthread_mutex_lock(&st->jitter_lock);
+	pthread_cleanup_push(unlock_on_cancel, &st->jitter_lock);
+	while(1) {
+		// find the next broadcast to go out
+		int i, next = -1;
+		for(i = 0; i < JITTER_MAX_PENDING; i++) {
+			if(st->pending[i].used && (next < 0 || before(&st->pending[i].due, &st->pending[next].due)))
+				next = i;
+		}
+
+		if(next < 0) {
+			wait_begin();
+			pthread_cond_wait(&st->jitter_cond, &st->jitter_lock);
+			wait_end();
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(before(&now, &st->pending[next].due)) {
+			wait_begin();
+			pthread_cond_timedwait(&st->jitter_cond, &st->jitter_lock, &st->pending[next].due);
+			wait_end();
+			continue;
+		}
+
+		send_slot(&st->pending[next]); // timer expired
+	}
+
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SetBroadcastJitter(uint32_t jitter, uint8_t merge)
+{
+	struct jitter_state *st = testbed()->jitter;
+	if(st == NULL && jitter == 0) // stays disabled, nothing to allocate
+		return 0;
+	if(st == NULL && (st = jitter_alloc()) == NULL)
+		return -1;
+	pthread_mutex_lock(&st->jitter_lock);
+	if(st->max_jitter == JITTER_BROKEN) { // the timer thread could not be started
+		pthread_mutex_unlock(&st->jitter_lock);
+		return -1;
+	}
+	st->max_jitter = jitter;
+	st->merge_pending = merge;
+	pthread_mutex_unlock(&st->jitter_lock);
+	return 0;
+}
+
+int InitializeJitter()
+{
+	return 0; // the state and timer thread are set up by the first SetBroadcastJitter
+}
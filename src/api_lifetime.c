@@ -0,0 +1,304 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- AddTimedRoute - add a route that is deleted when its lifetime runs out
+- TouchRoute - refresh the lifetime of a route (for example when it carries data)
+- SetRouteAutoRefresh - refresh routes for the destinations seen by the forward and outgoing queues
+- InitializeLifetime() - clear the route lifetimes (if any were tracked)
+
+Each route with a lifetime (like AODV ACTIVE_ROUTE_TIMEOUT) has one timer of the timer service
+(api_timer.c), so nothing wakes up while no route is about to expire, and expiries run on the
+timer thread or the event loop. TouchRoute only moves the expiry time forward; a route that is
+still alive when its timer fires gets a new timer for the rest of its lifetime. Routes that
+expire in the same 1 ms tick are deleted with one ApplyRouteBatch.
+
+Routes added with an expiry (route_spec.expires) are tracked here too: as LIFETIME_KERNEL if
+the kernel enforces RTA_EXPIRES, otherwise as LIFETIME_FIXED host routes that the wheel
+deletes. Either way the route's delete event is reported as EVENT_ROUTE_EXPIRED. The table
+is allocated by the first route that gets a lifetime (or SetRouteAutoRefresh).
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_lifetime.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+static uint32_t dest_hash(uint32_t dest)
+{
+	uint32_t h = dest;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h & (LIFETIME_HASH - 1);
+}
+
+// stop every route timer and empty the table (lifetime_lock held, or a new table)
+static void lifetime_reset(struct lifetime_state *st)
+{
+	int32_t i;
+	for(i = 0; i < LIFETIME_MAX_ROUTES; i++) { // stop the timers of an earlier initialization
+		if(st->routes[i].used && st->routes[i].timer >= 0)
+			StopTimer(st->routes[i].timer);
+		st->routes[i].used = 0;
+		st->routes[i].gen++;
+		st->routes[i].timer = -1;
+	}
+	for(i = 0; i < LIFETIME_HASH; i++)
+		st->buckets[i] = -1;
+	st->free_list = -1;
+	for(i = LIFETIME_MAX_ROUTES - 1; i >= 0; i--) {
+		st->routes[i].hnext = st->free_list;
+		st->free_list = i;
+	}
+	if(st->flush_timer >= 0)
+		StopTimer(st->flush_timer);
+	st->flush_timer = -1;
+	st->num_expired = 0;
+	clock_gettime(CLOCK_MONOTONIC, &st->start);
+}
+
+// allocate the lifetime table on first use
+static struct lifetime_state *lifetime_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct lifetime_state *st = node->lifetime;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->lifetime_lock, NULL);
+		pthread_mutex_init(&st->expire_lock, NULL);
+		st->flush_timer = -1;
+		st->auto_refresh = 1;
+		lifetime_reset(st);
+		node->lifetime = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+// ms since start
+static uint64_t now_ms()
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - st->start.tv_sec) * 1000 + (now.tv_nsec - st->start.tv_nsec) / 1000000;
+}
+
+static int32_t find_route(uint32_t dest)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	int32_t i;
+	for(i = st->buckets[dest_hash(dest)]; i >= 0; i = st->routes[i].hnext) {
+		if(st->routes[i].dest == dest)
+			return i;
+	}
+	return -1;
+}
+
+static void free_route(int32_t i)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	int32_t *p = &st->buckets[dest_hash(st->routes[i].dest)];
+	while(*p != i)
+		p = &st->routes[*p].hnext;
+	*p = st->routes[i].hnext;
+
+	if(st->routes[i].timer >= 0)
+		StopTimer(st->routes[i].timer);
+	st->routes[i].timer = -1;
+	st->routes[i].used = 0;
+	st->routes[i].gen++; // a timer that already fired for the old route is ignored
+	st->routes[i].hnext = st->free_list;
+	st->free_list = i;
+}
+
+// delete the routes that expired in the last tick with one netlink send
+static void flush_expired(void *arg)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	pthread_mutex_lock(&st->expire_lock);
+	pthread_mutex_lock(&st->lifetime_lock);
+	uint32_t i, n = 0;
+	for(i = 0; i < st->num_expired; i++) { // a route added again since it expired must not be deleted
+		int32_t r = find_route(st->expired[i].dest);
+		if(r >= 0 && (st->routes[r].flags & LIFETIME_EXPIRED))
+			st->expired[n++] = st->expired[i];
+	}
+	st->flush_timer = -1;
+	pthread_mutex_unlock(&st->lifetime_lock);
+
+	// timer callbacks run one at a time, so no route is added to expired meanwhile
+	if(n > 0)
+		ApplyRouteBatch(st->expired, n);
+	st->num_expired = 0;
+	pthread_mutex_unlock(&st->expire_lock);
+}
+
+// the timer of a route fired: expire it, or wait for the expiry TouchRoute moved it to
+static void route_timeout(void *arg)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	uint32_t key = (uint32_t)(uintptr_t)arg;
+	int32_t i = key & (LIFETIME_MAX_ROUTES - 1);
+	struct route_timer *r = &st->routes[i];
+
+	pthread_mutex_lock(&st->lifetime_lock);
+	if(!r->used || r->gen != (key >> LIFETIME_INDEX_BITS)) { // deleted since the timer fired
+		pthread_mutex_unlock(&st->lifetime_lock);
+		return;
+	}
+	r->timer = -1;
+	uint64_t now = now_ms();
+	if(r->expires > now) {
+		arm_route(i, r->expires - now);
+	}
+	else if(r->flags & LIFETIME_EXPIRED) {
+		free_route(i); // no delete event arrived during the grace period
+	}
+	else {
+		if(!(r->flags & LIFETIME_KERNEL) && st->num_expired < LIFETIME_MAX_ROUTES) { // the kernel deletes its own routes
+			struct route_op *op = &st->expired[st->num_expired++];
+			op->action = ROUTE_DELETE;
+			op->dest = r->dest;
+			op->next_hop = r->next_hop;
+			if(st->flush_timer < 0) // after the other routes that expire in this tick
+				st->flush_timer = StartTimer(0, 0, flush_expired, NULL);
+		}
+		// keep the route until its delete event, so the event feed can report it as expired
+		r->flags |= LIFETIME_EXPIRED;
+		r->expires = now + LIFETIME_GRACE_MS;
+		arm_route(i, LIFETIME_GRACE_MS);
+	}
+	pthread_mutex_unlock(&st->lifetime_lock);
+}
+
+static int arm_route(int32_t i, uint64_t delay)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	struct route_timer *r = &st->routes[i];
+	if(delay > UINT32_MAX)
+		delay = UINT32_MAX; // the timer fires early and is rearmed
+	r->due = now_ms() + delay;
+	r->timer = StartTimer(delay, 0, route_timeout, (void *)(uintptr_t)(i | ((uint32_t)r->gen << LIFETIME_INDEX_BITS)));
+	return (r->timer < 0) ? -1 : 0;
+}
+
+void lifetime_packet(uint32_t dest)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st != NULL && st->auto_refresh)
+		TouchRoute(dest);
+}
+
+int lifetime_track(uint32_t dest, uint32_t next_hop, uint32_t lifetime, uint8_t flags)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st == NULL && (st = lifetime_alloc()) == NULL)
+		return -1;
+	pthread_mutex_lock(&st->lifetime_lock);
+	int32_t i = find_route(dest);
+	if(i < 0) {
+		if(st->free_list < 0) { // table full, the route stays without a lifetime
+			pthread_mutex_unlock(&st->lifetime_lock);
+			return -1;
+		}
+		i = st->free_list;
+		st->free_list = st->routes[i].hnext;
+		uint32_t h = dest_hash(dest);
+		st->routes[i].hnext = st->buckets[h];
+		st->buckets[h] = i;
+		st->routes[i].used = 1;
+		st->routes[i].timer = -1;
+		st->routes[i].dest = dest;
+	}
+
+	struct route_timer *r = &st->routes[i];
+	r->next_hop = next_hop;
+	r->flags = flags;
+	r->lifetime = (lifetime == 0) ? 1 : lifetime;
+	r->expires = now_ms() + r->lifetime;
+	int err = 0;
+	if(r->timer < 0) {
+		err = arm_route(i, r->lifetime);
+	}
+	else if(r->expires < r->due) { // lifetime was shortened, fire earlier
+		RestartTimer(r->timer, r->lifetime);
+		r->due = r->expires;
+	}
+	if(err < 0) // no timer left, do not keep a route that would never expire
+		free_route(i);
+
+	pthread_mutex_unlock(&st->lifetime_lock);
+	return err;
+}
+
+int lifetime_deleted(uint32_t dest)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st == NULL) // no route ever had a lifetime
+		return 0;
+	pthread_mutex_lock(&st->lifetime_lock);
+	int was_expired = 0;
+	int32_t i = find_route(dest);
+	if(i >= 0) {
+		struct route_timer *r = &st->routes[i];
+		was_expired = (r->flags & LIFETIME_EXPIRED) ||
+			((r->flags & LIFETIME_KERNEL) && r->expires <= now_ms() + LIFETIME_SLACK_MS);
+		free_route(i); // the route is gone, stop tracking it
+	}
+	pthread_mutex_unlock(&st->lifetime_lock);
+	return was_expired;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int AddTimedRoute(uint32_t dest_address, uint32_t next_hop, uint32_t lifetime)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st == NULL && (st = lifetime_alloc()) == NULL)
+		return -1;
+	pthread_mutex_lock(&st->expire_lock); // an expiry delete must not overtake this add
+	int r = AddUnicastRoutingEntry(dest_address, next_hop);
+	if(r == 0)
+		r = lifetime_track(dest_address, next_hop, lifetime, 0);
+	pthread_mutex_unlock(&st->expire_lock);
+	return r;
+}
+
+int TouchRoute(uint32_t dest_address)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&st->lifetime_lock);
+	int32_t i = find_route(dest_address);
+	if(i >= 0 && st->routes[i].flags != 0) // expired, or a fixed expiry that is not refreshed
+		i = -1;
+	if(i >= 0) // only the expiry time moves, it is checked when the route's timer fires
+		st->routes[i].expires = now_ms() + st->routes[i].lifetime;
+	pthread_mutex_unlock(&st->lifetime_lock);
+	return (i >= 0) ? 0 : -1;
+}
+
+int SetRouteAutoRefresh(uint8_t enable)
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st == NULL && (st = lifetime_alloc()) == NULL)
+		return -1;
+	st->auto_refresh = enable;
+	return 0;
+}
+
+int InitializeLifetime()
+{
+	struct lifetime_state *st = testbed()->lifetime;
+	if(st == NULL) // allocated on first use
+		return 0;
+	pthread_mutex_lock(&st->lifetime_lock);
+	lifetime_reset(st);
+	pthread_mutex_unlock(&st->lifetime_lock);
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SetEventLoopMode - deliver packets, events and timers from one epoll loop instead of one thread per queue
+- RunEventLoop - run the loop on the calling thread (EVENT_LOOP_USER)
+- GetEventLoopFd - nest the loop in the user's own poll loop
+- AddLoopFd / RemoveLoopFd - add the user's own sockets to the loop
+- AddLoopTimer / CancelLoopTimer - protocol timers (the timing wheel of api_timer.c, which runs in the loop)
+- InitializeLoop() - create the epoll fd (and the loop thread for EVENT_LOOP_THREAD)
+
+In the default mode each queue and the event feed have a thread, so the user's callbacks run
+concurrently and the protocol must lock its own tables. In loop mode every callback runs to
+completion on one thread, which removes that locking and keeps the protocol's data in one
+core's cache (a good fit for a small CPU running a simple protocol). The loop's state is only
+allocated by SetEventLoopMode, so nodes in the default mode do not carry it.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_loop.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+int loop_enabled()
+{
+	struct loop_state *st = testbed()->loop;
+	return st != NULL && st->mode != EVENT_LOOP_OFF;
+}
+
+// allocate the loop's state when a loop mode is selected
+static struct loop_state *loop_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct loop_state *st = node->loop;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->loop_lock, NULL);
+		st->epfd = -1;
+		node->loop = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+// take a free slot and add fd to epoll with it, returns the slot
+static int add_source(int fd, struct loop_source *src)
+{
+	struct loop_state *st = testbed()->loop;
+	if(st == NULL || st->epfd < 0 || fd < 0)
+		return -1;
+
+	int i;
+	pthread_mutex_lock(&st->loop_lock);
+	for(i = 0; i < LOOP_MAX_SOURCES; i++) {
+		if(!st->sources[i].used)
+			break;
+	}
+	if(i == LOOP_MAX_SOURCES) {
+		pthread_mutex_unlock(&st->loop_lock);
+		return -1;
+	}
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = ((uint64_t)fd << 32) | i; // the fd lets dispatch skip events of a reused slot
+	if(epoll_ctl(st->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		pthread_mutex_unlock(&st->loop_lock);
+		return -1;
+	}
+	st->sources[i] = *src;
+	st->sources[i].fd = fd;
+	st->sources[i].used = 1;
+	pthread_mutex_unlock(&st->loop_lock);
+	return i;
+}
+
+// remove slot i from epoll and release it (loop_lock held)
+static void remove_source(int i)
+{
+	struct loop_state *st = testbed()->loop;
+	epoll_ctl(st->epfd, EPOLL_CTL_DEL, st->sources[i].fd, NULL);
+	st->sources[i].used = 0;
+}
+
+int loop_add(int fd, LoopCallback cb, void *arg)
+{
+	struct loop_source src;
+	memset(&src, 0, sizeof(src));
+	src.fd_cb = cb;
+	src.arg = arg;
+	return (add_source(fd, &src) < 0) ? -1 : 0;
+}
+
+static int dispatch(struct epoll_event *ev)
+{
+	struct loop_state *st = testbed()->loop;
+	uint32_t i = (uint32_t)ev->data.u64;
+	int fd = (int)(ev->data.u64 >> 32);
+
+	pthread_mutex_lock(&st->loop_lock);
+	if(!st->sources[i].used || st->sources[i].fd != fd) { // removed by an earlier callback
+		pthread_mutex_unlock(&st->loop_lock);
+		return 0;
+	}
+	struct loop_source src = st->sources[i];
+	pthread_mutex_unlock(&st->loop_lock);
+
+	// run the callback without the lock, so it can add and remove sources
+	(*src.fd_cb)(fd, src.arg);
+	return 1;
+}
+
+void *thread_func_loop()
+{
+	while(RunEventLoop(-1) >= 0);
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SetEventLoopMode(uint8_t mode)
+{
+	struct loop_state *st = testbed()->loop;
+	if(mode > EVENT_LOOP_THREAD || (st != NULL && st->epfd >= 0)) // only before InitializeAPI
+		return -1;
+	if(st == NULL && mode == EVENT_LOOP_OFF) // the default, nothing to allocate
+		return 0;
+	if(st == NULL && (st = loop_alloc()) == NULL)
+		return -1;
+	st->mode = mode;
+	return 0;
+}
+
+int RunEventLoop(int timeout_ms)
+{
+	struct loop_state *st = testbed()->loop;
+	struct epoll_event evs[LOOP_MAX_EVENTS];
+	if(st == NULL || st->epfd < 0)
+		return -1;
+
+	wait_begin();
+	int n = epoll_wait(st->epfd, evs, LOOP_MAX_EVENTS, timeout_ms);
+	wait_end();
+	if(n < 0)
+		return (errno == EINTR) ? 0 : -1;
+
+	int i, run = 0;
+	for(i = 0; i < n; i++)
+		run += dispatch(&evs[i]);
+	return run;
+}
+
+int GetEventLoopFd()
+{
+	struct loop_state *st = testbed()->loop;
+	return (st != NULL) ? st->epfd : -1;
+}
+
+int AddLoopFd(int fd, LoopCallback cb, void *arg)
+{
+	if(cb == NULL)
+		return -1;
+	return loop_add(fd, cb, arg);
+}
+
+int RemoveLoopFd(int fd)
+{
+	struct loop_state *st = testbed()->loop;
+	int i, r = -1;
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&st->loop_lock);
+	for(i = 0; i < LOOP_MAX_SOURCES; i++) {
+		if(st->sources[i].used && st->sources[i].fd == fd) {
+			remove_source(i);
+			r = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&st->loop_lock);
+	return r;
+}
+
+int AddLoopTimer(uint32_t delay, uint32_t interval, TimerCallback cb, void *arg)
+{
+	if(cb == NULL || !loop_enabled())
+		return -1;
+	return StartTimer(delay, interval, cb, arg); // the timing wheel runs in the loop
+}
+
+int CancelLoopTimer(int id)
+{
+	return StopTimer(id);
+}
+
+int InitializeLoop()
+{
+	struct loop_state *st = testbed()->loop;
+	if(st == NULL || st->mode == EVENT_LOOP_OFF)
+		return 0;
+
+	st->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(st->epfd < 0)
+		return -1;
+
+	if(st->mode == EVENT_LOOP_THREAD && start_thread(&st->loop_thread, thread_func_loop))
+	{
+		printf("error creating event loop thread\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,368 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- GetLinkMetrics - get the smoothed link quality to one neighbour
+- GetAllLinkMetrics - get the link quality to every station
+- SetLinkMetricsInterval - change how often the station statistics are read
+- InitializeMetric() - find nl80211 and start the metrics thread (or its event loop timer)
+
+Signal, tx bitrate, tx retries and tx failures of every station come from one nl80211
+NL80211_CMD_GET_STATION dump per interface and period, read by one thread (or by a timer on the
+event loop's thread in event loop mode). The results are
+smoothed (EWMA) and published as one table that readers copy from without locking, so
+metric-based protocols (ETX, ETT, airtime) can check a link as often as they like.
+Works with any mac80211 driver, including the mac80211_hwsim virtual radios.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_if.h"
+#include "api_neigh.h"
+#include "api_metric.h"
+#include "api_loop.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// allocate the link metrics of the node (the interval may be set before InitializeAPI)
+static struct metric_state *metric_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct metric_state *st = node->metric;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		st->metric_fd = -1;
+		st->family = -1;
+		st->metric_interval = DEFAULT_METRIC_INTERVAL;
+		node->metric = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+static struct rtattr *add_attr(struct nlmsghdr *nl, uint16_t type, void *data, uint16_t len)
+{
+	struct rtattr *rta = (struct rtattr*)(((char *)nl) + NLMSG_ALIGN(nl->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	if(len > 0)
+		memcpy(RTA_DATA(rta), data, len);
+	nl->nlmsg_len = NLMSG_ALIGN(nl->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+	return rta;
+}
+
+// send a generic netlink request on the metrics socket, returns its sequence number
+static int genl_send(uint16_t type, uint8_t cmd, uint16_t flags, struct nlmsghdr *nl)
+{
+	struct metric_state *st = testbed()->metric;
+	nl->nlmsg_type = type;
+	nl->nlmsg_flags = NLM_F_REQUEST | flags;
+	nl->nlmsg_seq = ++st->metric_seq;
+	struct genlmsghdr *genl = (struct genlmsghdr*)NLMSG_DATA(nl);
+	genl->cmd = cmd;
+	genl->version = 1;
+	return (send(st->metric_fd, nl, nl->nlmsg_len, 0) < 0) ? -1 : (int)nl->nlmsg_seq;
+}
+
+static int get_family()
+{
+	struct metric_state *st = testbed()->metric;
+	char buf[BUFLEN];
+	memset(buf, 0, BUFLEN);
+	struct nlmsghdr *nl = (struct nlmsghdr*)buf;
+	nl->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	add_attr(nl, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+	int seq = genl_send(GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0, nl);
+	if(seq < 0)
+		return -1;
+
+	int len;
+	do {
+		len = recv(st->metric_fd, buf, BUFLEN, 0);
+	} while(len >= (int)sizeof(struct nlmsghdr) && nl->nlmsg_seq != (uint32_t)seq);
+	if(len < 0 || !NLMSG_OK(nl, (uint32_t)len) || nl->nlmsg_type == NLMSG_ERROR)
+		return -1;
+
+	int alen = NLMSG_PAYLOAD(nl, GENL_HDRLEN);
+	struct rtattr *rta = NULL;
+	for_each_rattr(rta, ((char *)NLMSG_DATA(nl) + GENL_HDRLEN), alen) {
+		if(rta->rta_type == CTRL_ATTR_FAMILY_ID)
+			return *(uint16_t *)RTA_DATA(rta);
+	}
+	return -1;
+}
+
+// first smoothed value is the sample itself
+static int32_t ewma(int32_t avg, int32_t sample, int first)
+{
+	sample *= METRIC_SCALE;
+	return first ? sample : avg + ((sample - avg) >> METRIC_EWMA_SHIFT);
+}
+
+static struct station *find_station(struct station *table, uint32_t count, uint32_t ifindex, uint8_t *mac)
+{
+	uint32_t i;
+	for(i = 0; i < count; i++) {
+		if(table[i].m.ifindex == ifindex && memcmp(table[i].m.mac, mac, sizeof(table[i].m.mac)) == 0)
+			return &table[i];
+	}
+	return NULL;
+}
+
+static int parse_station(struct nlmsghdr *nl, uint32_t ifindex, struct station *s)
+{
+	struct metric_state *st = testbed()->metric;
+	memset(s, 0, sizeof(*s));
+	s->m.ifindex = ifindex;
+
+	int have_mac = 0, have_signal = 0, have_rate = 0;
+	int8_t signal = 0;
+	uint32_t bitrate = 0; // kbit/s
+	int len = NLMSG_PAYLOAD(nl, GENL_HDRLEN);
+	struct rtattr *rta = NULL;
+	for_each_rattr(rta, ((char *)NLMSG_DATA(nl) + GENL_HDRLEN), len) {
+		if(rta->rta_type == NL80211_ATTR_MAC && RTA_PAYLOAD(rta) == sizeof(s->m.mac)) {
+			memcpy(s->m.mac, RTA_DATA(rta), sizeof(s->m.mac));
+			have_mac = 1;
+		}
+		if((rta->rta_type & NLA_TYPE_MASK) != NL80211_ATTR_STA_INFO)
+			continue;
+
+		int ilen = RTA_PAYLOAD(rta);
+		struct rtattr *info = NULL;
+		for_each_rattr(info, RTA_DATA(rta), ilen) {
+			switch(info->rta_type & NLA_TYPE_MASK) {
+			case NL80211_STA_INFO_SIGNAL_AVG: // preferred over the last frame's signal
+				signal = *(int8_t *)RTA_DATA(info);
+				have_signal = 2;
+				break;
+			case NL80211_STA_INFO_SIGNAL:
+				if(have_signal < 2) {
+					signal = *(int8_t *)RTA_DATA(info);
+					have_signal = 1;
+				}
+				break;
+			case NL80211_STA_INFO_TX_PACKETS:
+				s->m.tx_packets = *(uint32_t *)RTA_DATA(info);
+				break;
+			case NL80211_STA_INFO_TX_RETRIES:
+				s->m.tx_retries = *(uint32_t *)RTA_DATA(info);
+				break;
+			case NL80211_STA_INFO_TX_FAILED:
+				s->m.tx_failed = *(uint32_t *)RTA_DATA(info);
+				break;
+			case NL80211_STA_INFO_TX_BITRATE: {
+				int rlen = RTA_PAYLOAD(info);
+				struct rtattr *rate = NULL;
+				for_each_rattr(rate, RTA_DATA(info), rlen) { // units of 100 kbit/s
+					if((rate->rta_type & NLA_TYPE_MASK) == NL80211_RATE_INFO_BITRATE32)
+						bitrate = *(uint32_t *)RTA_DATA(rate) * 100;
+					else if((rate->rta_type & NLA_TYPE_MASK) == NL80211_RATE_INFO_BITRATE && bitrate == 0)
+						bitrate = *(uint16_t *)RTA_DATA(rate) * 100;
+				}
+				have_rate = (bitrate != 0);
+				break;
+			}
+			}
+		}
+	}
+	if(!have_mac)
+		return -1;
+
+	// smooth with the last values of the same station
+	struct station *old = find_station(st->stations[atomic_load(&st->cur)], st->station_count[atomic_load(&st->cur)], ifindex, s->m.mac);
+	int first = (old == NULL);
+	if(old != NULL) {
+		*s = (struct station){ .m = s->m, .signal_avg = old->signal_avg, .bitrate_avg = old->bitrate_avg,
+			.retry_avg = old->retry_avg, .fail_avg = old->fail_avg };
+		// counters are totals, rate of this period per 1000 packets
+		uint32_t packets = s->m.tx_packets - old->m.tx_packets;
+		if(s->m.tx_packets > old->m.tx_packets) { // counters are reset when a station reconnects
+			s->retry_avg = ewma(old->retry_avg, (s->m.tx_retries - old->m.tx_retries) * 1000ULL / packets, 0);
+			s->fail_avg = ewma(old->fail_avg, (s->m.tx_failed - old->m.tx_failed) * 1000ULL / packets, 0);
+		}
+	}
+	if(have_signal)
+		s->signal_avg = ewma(s->signal_avg, signal, first || s->signal_avg == 0);
+	if(have_rate)
+		s->bitrate_avg = ewma(s->bitrate_avg, bitrate, first || s->bitrate_avg == 0);
+
+	s->m.signal = s->signal_avg / METRIC_SCALE;
+	s->m.tx_bitrate = s->bitrate_avg / METRIC_SCALE;
+	s->m.retry_rate = s->retry_avg / METRIC_SCALE;
+	s->m.fail_rate = s->fail_avg / METRIC_SCALE;
+	s->m.address = neigh_by_lladdr(ifindex, s->m.mac);
+	return 0;
+}
+
+static void dump_stations(uint32_t ifindex, struct station *next, uint32_t *count)
+{
+	struct metric_state *st = testbed()->metric;
+	char req[BUFLEN];
+	memset(req, 0, BUFLEN);
+	struct nlmsghdr *nl = (struct nlmsghdr*)req;
+	nl->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	add_attr(nl, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+	int seq = genl_send(st->family, NL80211_CMD_GET_STATION, NLM_F_DUMP, nl);
+	if(seq < 0)
+		return;
+
+	char buf[METRIC_BUFLEN];
+	while(1) {
+		int len = recv(st->metric_fd, buf, sizeof(buf), 0);
+		if(len < 0)
+			return;
+
+		for(nl = (struct nlmsghdr*)buf; NLMSG_OK(nl, (uint32_t)len); nl = NLMSG_NEXT(nl, len)) {
+			if(nl->nlmsg_seq != (uint32_t)seq) // reply to an earlier dump
+				continue;
+			if(nl->nlmsg_type == NLMSG_DONE || nl->nlmsg_type == NLMSG_ERROR) // done, or not a wireless interface
+				return;
+			if(nl->nlmsg_type == st->family && *count < METRIC_MAX_STATIONS && parse_station(nl, ifindex, &next[*count]) == 0)
+				(*count)++;
+		}
+	}
+}
+
+// dump the stations of every interface into the table readers are not using, then publish it
+static void refresh_stations()
+{
+	struct testbed *node = testbed();
+	struct metric_state *st = node->metric;
+	uint32_t n = 1 - atomic_load(&st->cur); // the table readers are not using
+	uint32_t count = 0;
+	int i, nif = if_count();
+	for(i = 0; i < nif; i++)
+		dump_stations(node->ifaces[i].index, st->stations[n], &count);
+	st->station_count[n] = count;
+
+	// publish the new table, readers that were copying the old one retry
+	atomic_fetch_add_explicit(&st->metric_seqlock, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store(&st->cur, n);
+	atomic_fetch_add_explicit(&st->metric_seqlock, 1, memory_order_release);
+}
+
+// timer callback of event loop mode, re-armed each time so interval changes apply
+static void metric_tick(void *arg)
+{
+	refresh_stations();
+	StartTimer(testbed()->metric->metric_interval, 0, metric_tick, NULL);
+}
+
+void *thread_func_metric()
+{
+	struct metric_state *st = testbed()->metric;
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while(1) {
+		refresh_stations();
+
+		uint32_t interval = st->metric_interval;
+		next.tv_sec += interval / 1000;
+		next.tv_nsec += (interval % 1000) * 1000000;
+		if(next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+		wait_begin();
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		wait_end();
+	}
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int GetLinkMetrics(uint32_t address, struct link_metrics *m)
+{
+	struct metric_state *st = testbed()->metric;
+	if(st == NULL || m == NULL || address == 0) // no nl80211, nothing is measured
+		return -1;
+
+	unsigned int seq;
+	int found;
+	do {
+		seq = atomic_load_explicit(&st->metric_seqlock, memory_order_acquire);
+		found = 0;
+		if(seq & 1)
+			continue; // table being switched
+
+		uint32_t t = atomic_load_explicit(&st->cur, memory_order_relaxed);
+		uint32_t i;
+		for(i = 0; i < st->station_count[t] && i < METRIC_MAX_STATIONS; i++) {
+			if(st->stations[t][i].m.address == address) {
+				*m = st->stations[t][i].m;
+				found = 1;
+				break;
+			}
+		}
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->metric_seqlock, memory_order_relaxed));
+	return found ? 0 : -1;
+}
+
+int GetAllLinkMetrics(struct link_metrics *m, uint32_t max)
+{
+	struct metric_state *st = testbed()->metric;
+	if(st == NULL || m == NULL)
+		return -1;
+
+	unsigned int seq;
+	uint32_t count;
+	do {
+		seq = atomic_load_explicit(&st->metric_seqlock, memory_order_acquire);
+		count = 0;
+		if(seq & 1)
+			continue;
+
+		uint32_t t = atomic_load_explicit(&st->cur, memory_order_relaxed);
+		for(count = 0; count < st->station_count[t] && count < max && count < METRIC_MAX_STATIONS; count++)
+			m[count] = st->stations[t][count].m;
+		atomic_thread_fence(memory_order_acquire);
+	} while((seq & 1) || seq != atomic_load_explicit(&st->metric_seqlock, memory_order_relaxed));
+	return count;
+}
+
+int SetLinkMetricsInterval(uint32_t interval)
+{
+	struct metric_state *st = metric_alloc();
+	if(interval == 0 || st == NULL)
+		return -1;
+	st->metric_interval = interval;
+	return 0;
+}
+
+int InitializeMetric()
+{
+	struct testbed *node = testbed();
+	struct metric_state *st = metric_alloc();
+	if(st == NULL)
+		return -1;
+	st->metric_fd = ns_socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+	if(st->metric_fd < 0)
+		return -1;
+
+	st->family = get_family();
+	if(st->family < 0) { // no wireless drivers loaded, nothing to measure (and no tables to keep)
+		close(st->metric_fd);
+		pthread_mutex_lock(&node->state_lock);
+		node->metric = NULL;
+		pthread_mutex_unlock(&node->state_lock);
+		free(st);
+		return 0;
+	}
+
+	if(loop_enabled()) { // dump from a timer on the event loop instead of a thread
+		metric_tick(NULL);
+		return 0;
+	}
+
+	if(start_thread(&st->metric_thread, thread_func_metric))
+	{
+		printf("error creating link metrics thread\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,262 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- RegisterNeighbourCallback - report neighbours that become unreachable (NUD_FAILED or NUD_STALE)
+- GetNeighbourState - look up the NUD state of a neighbour
+- InitializeNeigh() - allocate the neighbour table (loaded by InitializeEvent once neighbour events are reported)
+
+The kernel already checks every next hop it sends to (ARP and unicast probes), so a failed
+neighbour is known within milliseconds of the first lost packet. The event thread passes
+every neighbour change here, which lets protocols detect link breaks without waiting for
+several missed HELLOs.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_if.h"
+#include "api_neigh.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// allocate the neighbour table of the node (the callback may be registered before InitializeAPI)
+static struct neigh_state *neigh_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct neigh_state *st = node->neigh;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->neigh_lock, NULL);
+		node->neigh = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+static uint32_t addr_hash(uint32_t address)
+{
+	uint32_t h = address;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h & (NEIGH_HASH - 1);
+}
+
+static int32_t find_neigh(uint32_t address)
+{
+	struct neigh_state *st = testbed()->neigh;
+	int32_t i;
+	for(i = st->buckets[addr_hash(address)]; i >= 0; i = st->neighs[i].hnext) {
+		if(st->neighs[i].info.address == address)
+			return i;
+	}
+	return -1;
+}
+
+static void free_neigh(int32_t i)
+{
+	struct neigh_state *st = testbed()->neigh;
+	int32_t *p = &st->buckets[addr_hash(st->neighs[i].info.address)];
+	while(*p != i)
+		p = &st->neighs[*p].hnext;
+	*p = st->neighs[i].hnext;
+
+	st->neighs[i].used = 0;
+	st->neighs[i].hnext = st->free_list;
+	st->free_list = i;
+}
+
+static int parse_neigh_msg(struct nlmsghdr *nl, struct neigh_info *n)
+{
+	struct ndmsg *nd = (struct ndmsg*)NLMSG_DATA(nl);
+	if(nd->ndm_family != AF_INET || if_by_index(nd->ndm_ifindex) == NULL)
+		return -1;
+
+	memset(n, 0, sizeof(*n));
+	n->ifindex = nd->ndm_ifindex;
+	n->state = nd->ndm_state;
+
+	int len = NLMSG_PAYLOAD(nl, sizeof(*nd));
+	struct rtattr *rta = NULL;
+	for_each_rattr(rta, ((char *)nd + NLMSG_ALIGN(sizeof(*nd))), len) {
+		if(rta->rta_type == NDA_DST)
+			memcpy(&n->address, RTA_DATA(rta), sizeof(n->address));
+		else if(rta->rta_type == NDA_LLADDR && RTA_PAYLOAD(rta) == sizeof(n->lladdr))
+			memcpy(n->lladdr, RTA_DATA(rta), sizeof(n->lladdr));
+	}
+	return (n->address == 0) ? -1 : 0;
+}
+
+static int neigh_update(struct neigh_info *n, int del)
+{
+	struct neigh_state *st = testbed()->neigh;
+	int lost = 0;
+	pthread_mutex_lock(&st->neigh_lock);
+	int32_t i = find_neigh(n->address);
+	if(del) { // garbage collected or flushed, not a failure by itself
+		if(i >= 0)
+			free_neigh(i);
+		pthread_mutex_unlock(&st->neigh_lock);
+		return 0;
+	}
+
+	uint16_t old = NUD_NONE;
+	if(i < 0 && st->free_list >= 0) {
+		i = st->free_list;
+		st->free_list = st->neighs[i].hnext;
+		uint32_t h = addr_hash(n->address);
+		st->neighs[i].hnext = st->buckets[h];
+		st->buckets[h] = i;
+		st->neighs[i].used = 1;
+	}
+	else if(i >= 0) {
+		old = st->neighs[i].info.state;
+	}
+
+	if(i >= 0) {
+		st->neighs[i].info = *n;
+		st->neighs[i].seen = 1;
+		if(n->state == NUD_FAILED || n->state == NUD_STALE)
+			lost = (old != n->state);
+	}
+	else { // table full, still report the failure
+		lost = (n->state == NUD_FAILED);
+	}
+	pthread_mutex_unlock(&st->neigh_lock);
+	return lost;
+}
+
+void neigh_event(struct nlmsghdr *nl)
+{
+	struct neigh_state *st = testbed()->neigh;
+	struct neigh_info n;
+	if(st == NULL || parse_neigh_msg(nl, &n) < 0) // no table without InitializeNeigh
+		return;
+
+	NeighbourCallback cb = st->neigh_cb;
+	if(neigh_update(&n, nl->nlmsg_type == RTM_DELNEIGH) && cb != NULL)
+		(*cb)(&n);
+}
+
+int neigh_load(int report)
+{
+	struct neigh_state *st = testbed()->neigh;
+	if(st == NULL)
+		return -1;
+	NeighbourCallback cb = st->neigh_cb;
+	int32_t i;
+	pthread_mutex_lock(&st->neigh_lock); // neighbours updated from here on are current
+	for(i = 0; i < NEIGH_MAX; i++)
+		st->neighs[i].seen = 0;
+	pthread_mutex_unlock(&st->neigh_lock);
+
+	char buf[BUFLEN];
+	memset(buf, 0, BUFLEN);
+	struct nlmsghdr *nl = (struct nlmsghdr*)buf;
+	nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+	nl->nlmsg_type = RTM_GETNEIGH;
+	nl->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	struct ndmsg *nd = (struct ndmsg*)NLMSG_DATA(nl);
+	nd->ndm_family = AF_INET;
+
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	int seq = nl_send(&sa, nl);
+	if(seq < 0)
+		return -1;
+
+	int done = 0;
+	while(!done) {
+		int len = get_reply(&sa, buf, BUFLEN, seq);
+		if(len < 0)
+			return -1;
+
+		for(nl = (struct nlmsghdr*)buf; NLMSG_OK(nl, (uint32_t)len); nl = NLMSG_NEXT(nl, len)) {
+			if(nl->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if(nl->nlmsg_type == NLMSG_ERROR)
+				return -1;
+
+			struct neigh_info n;
+			if(nl->nlmsg_type == RTM_NEWNEIGH && parse_neigh_msg(nl, &n) == 0 &&
+			   neigh_update(&n, 0) && report && cb != NULL)
+				(*cb)(&n);
+		}
+	}
+
+	pthread_mutex_lock(&st->neigh_lock); // drop the neighbours the kernel no longer has
+	for(i = 0; i < NEIGH_MAX; i++) {
+		if(st->neighs[i].used && !st->neighs[i].seen)
+			free_neigh(i);
+	}
+	pthread_mutex_unlock(&st->neigh_lock);
+	return 0;
+}
+
+uint32_t neigh_by_lladdr(uint32_t ifindex, uint8_t *lladdr)
+{
+	struct neigh_state *st = testbed()->neigh;
+	uint32_t address = 0;
+	int32_t i;
+	if(st == NULL)
+		return 0;
+	pthread_mutex_lock(&st->neigh_lock);
+	for(i = 0; i < NEIGH_MAX; i++) {
+		if(st->neighs[i].used && st->neighs[i].info.ifindex == ifindex &&
+		   memcmp(st->neighs[i].info.lladdr, lladdr, sizeof(st->neighs[i].info.lladdr)) == 0) {
+			address = st->neighs[i].info.address;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&st->neigh_lock);
+	return address;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int RegisterNeighbourCallback(NeighbourCallback cb)
+{
+	struct neigh_state *st = neigh_alloc();
+	if(st == NULL)
+		return -1;
+	st->neigh_cb = cb;
+	return 0;
+}
+
+int GetNeighbourState(uint32_t address, struct neigh_info *n)
+{
+	struct neigh_state *st = testbed()->neigh;
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&st->neigh_lock);
+	int32_t i = find_neigh(address);
+	if(i >= 0 && n != NULL)
+		*n = st->neighs[i].info;
+	int state = (i >= 0) ? st->neighs[i].info.state : -1;
+	pthread_mutex_unlock(&st->neigh_lock);
+	return state;
+}
+
+int InitializeNeigh()
+{
+	struct neigh_state *st = neigh_alloc();
+	int32_t i;
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&st->neigh_lock);
+	memset(st->neighs, 0, sizeof(st->neighs));
+	for(i = 0; i < NEIGH_HASH; i++)
+		st->buckets[i] = -1;
+	st->free_list = -1;
+	for(i = NEIGH_MAX - 1; i >= 0; i--) {
+		st->neighs[i].hnext = st->free_list;
+		st->free_list = i;
+	}
+	pthread_mutex_unlock(&st->neigh_lock);
+	return 0; // InitializeEvent loads it once the event socket is subscribed, so no change is missed
+}
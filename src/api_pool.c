@@ -0,0 +1,290 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- HoldPacket - keep a queued packet after its callback returns (to buffer it while a route is found)
+- ClonePacket - share a held packet with another consumer or thread
+- ReleasePacket - drop a held packet
+- GetPoolStats - report the memory used by packet buffers
+- InitializePool() - allocate the packet buffers
+
+The queue threads receive straight into fixed-size buffers taken from a per-node pool instead of
+large stack buffers, and each callback's packet points into its buffer. Holding a packet only
+takes a reference to that buffer, so a protocol can keep packets or pass them to other threads
+with no malloc or memcpy; the buffer goes back to the pool when the last reference is released.
+Packets are copied from the kernel whole (POOL_COPY_RANGE); the rare recv that does not fit in
+a buffer is copied into a heap block owned by the buffer, so it is held and released the same way.
+Memory is bounded by POOL_BUFFERS: when every buffer is held the queues sleep until one is
+released and the kernel queues the packets instead. The last POOL_CONTROL_RESERVE buffers are
+kept for the incoming control queue, so data packets held during route discovery never stop
+the routing messages that would let them go.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_queue.h"
+#include "api_pool.h"
+
+static __thread struct pkt_buf *recv_buf = NULL; // buffer the calling queue thread is handling
+static __thread struct packet scratch; // packet of a recv whose buffer keeps another held packet
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// buffer a packet lives in, NULL for the scratch packet
+static struct pkt_buf *packet_buf(struct packet *pkt)
+{
+	if(pkt == &scratch)
+		return NULL;
+	return (struct pkt_buf *)((uint8_t *)pkt - offsetof(struct pkt_buf, pkt));
+}
+
+// point the fields of pkt at a packet starting at data
+static void packet_set(struct packet *pkt, uint8_t *data, int32_t len)
+{
+	struct iphdr *iph = (struct iphdr *)data;
+	if(len < 0)
+		len = 0;
+	pkt->raw_pack = data;
+	pkt->length = len;
+	pkt->src = (len >= sizeof(struct iphdr)) ? iph->saddr : 0;
+	pkt->dest = (len >= sizeof(struct iphdr)) ? iph->daddr : 0;
+	pkt->payload = data + IP_UDP_HDR_OFFSET;
+	pkt->payload_length = (len > IP_UDP_HDR_OFFSET) ? len - IP_UDP_HDR_OFFSET : 0;
+}
+
+// take a free buffer once in_use admitted it (the free list then has one for every admitted taker)
+static struct pkt_buf *pop_buf(struct pool_state *st)
+{
+	uint64_t top = atomic_load_explicit(&st->free_top, memory_order_acquire);
+	while(1) {
+		uint32_t i = (uint32_t)top;
+		if(i == 0) { // a pool_put is between its push and its in_use decrement
+			top = atomic_load_explicit(&st->free_top, memory_order_acquire);
+			continue;
+		}
+		struct pkt_buf *b = &st->bufs[i - 1];
+		uint64_t next = ((top >> 32) + 1) << 32 | (uint32_t)(b->next + 1);
+		if(atomic_compare_exchange_weak_explicit(&st->free_top, &top, next, memory_order_acquire, memory_order_acquire))
+			return b;
+	}
+}
+
+// count one more buffer in use if the caller's share of the pool has room
+static int admit(struct pool_state *st, uint32_t limit)
+{
+	uint32_t used = atomic_load_explicit(&st->in_use, memory_order_relaxed);
+	do {
+		if(used >= limit)
+			return 0;
+	} while(!atomic_compare_exchange_weak_explicit(&st->in_use, &used, used + 1, memory_order_seq_cst, memory_order_relaxed));
+
+	uint32_t peak = atomic_load_explicit(&st->peak, memory_order_relaxed);
+	while(used + 1 > peak && !atomic_compare_exchange_weak_explicit(&st->peak, &peak, used + 1, memory_order_relaxed, memory_order_relaxed));
+	return 1;
+}
+
+struct pkt_buf *pool_get(int wait, int control)
+{
+	struct pool_state *st = testbed()->pool;
+	if(st == NULL || st->bufs == NULL)
+		return NULL;
+
+	// the last POOL_CONTROL_RESERVE buffers only go to the incoming control queue, so packets
+	// held by the data plane cannot stop routing messages
+	uint32_t limit = control ? POOL_BUFFERS : POOL_BUFFERS - POOL_CONTROL_RESERVE;
+	if(!admit(st, limit)) {
+		if(!wait)
+			return NULL;
+		atomic_fetch_add_explicit(&st->waits, 1, memory_order_relaxed);
+
+		// sleep until pool_put frees a buffer (it signals while anyone waits)
+		pthread_mutex_lock(&st->wait_lock);
+		pthread_cleanup_push(unlock_on_cancel, &st->wait_lock);
+		atomic_fetch_add_explicit(&st->waiters, 1, memory_order_seq_cst);
+		while(!admit(st, limit)) {
+			wait_begin(); // DestroyTestbed may stop this thread while it waits
+			pthread_cond_wait(&st->wait_cond, &st->wait_lock);
+			wait_end();
+		}
+		atomic_fetch_sub_explicit(&st->waiters, 1, memory_order_relaxed);
+		pthread_cleanup_pop(1);
+	}
+
+	struct pkt_buf *b = pop_buf(st);
+	atomic_store_explicit(&b->refs, 1, memory_order_relaxed);
+	return b;
+}
+
+void pool_put(struct pkt_buf *b)
+{
+	if(atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) != 1)
+		return;
+
+	struct pool_state *st = b->pool;
+	uint32_t i = b - st->bufs;
+	b->held = 0;
+	free(b->big);
+	b->big = NULL;
+
+	uint64_t top = atomic_load_explicit(&st->free_top, memory_order_relaxed);
+	uint64_t next;
+	do {
+		b->next = (int32_t)(uint32_t)top - 1;
+		next = ((top >> 32) + 1) << 32 | (i + 1);
+	} while(!atomic_compare_exchange_weak_explicit(&st->free_top, &top, next, memory_order_release, memory_order_relaxed));
+
+	// only now may another taker be admitted, the buffer is already on the free list
+	atomic_fetch_sub_explicit(&st->in_use, 1, memory_order_seq_cst);
+	if(atomic_load_explicit(&st->waiters, memory_order_seq_cst) > 0) {
+		pthread_mutex_lock(&st->wait_lock);
+		pthread_cond_broadcast(&st->wait_cond);
+		pthread_mutex_unlock(&st->wait_lock);
+	}
+}
+
+int pool_recv(int fd, struct pkt_buf *b, uint8_t *tail, int flags)
+{
+	struct iovec iov[2] = { { b->data, POOL_BUFFER_SIZE }, { tail, POOL_RECV_MAX - POOL_BUFFER_SIZE } };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	int n = recvmsg(fd, &msg, flags);
+	if(n <= POOL_BUFFER_SIZE)
+		return n;
+
+	// only big packets pay for the copy into one block
+	uint8_t *big = malloc(n);
+	if(big == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(big, b->data, POOL_BUFFER_SIZE);
+	memcpy(big + POOL_BUFFER_SIZE, tail, n - POOL_BUFFER_SIZE);
+	b->big = big;
+	b->big_len = n;
+	return n;
+}
+
+uint8_t *pool_data(struct pkt_buf *b)
+{
+	return (b->big != NULL) ? b->big : b->data;
+}
+
+void pool_receiving(struct pkt_buf *b)
+{
+	recv_buf = b;
+}
+
+struct packet *packet_start(uint8_t *data, int32_t len)
+{
+	struct pkt_buf *b = recv_buf;
+	struct packet *pkt = &scratch;
+	uint8_t *start = (b != NULL) ? pool_data(b) : NULL;
+	int32_t size = (b != NULL && b->big != NULL) ? b->big_len : POOL_BUFFER_SIZE;
+	if(b != NULL && !b->held && data >= start && data < start + size)
+		pkt = &b->pkt;
+	packet_set(pkt, data, len);
+	return pkt;
+}
+
+struct packet *packet_hold(struct packet *pkt)
+{
+	struct pkt_buf *b = packet_buf(pkt);
+	if(b != NULL) { // already in a buffer, share it
+		b->held = 1;
+		atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&b->pool->held, 1, memory_order_relaxed);
+		return pkt;
+	}
+
+	// another packet of the same recv is held in its buffer (rare), copy this one out
+	if((b = pool_get(0, 0)) == NULL)
+		return NULL;
+	if(pkt->length > POOL_BUFFER_SIZE && (b->big = malloc(pkt->length)) == NULL) {
+		pool_put(b);
+		return NULL;
+	}
+	b->big_len = pkt->length;
+	memcpy(pool_data(b), pkt->raw_pack, pkt->length);
+	b->pkt.info = pkt->info;
+	packet_set(&b->pkt, pool_data(b), pkt->length);
+	b->held = 1;
+	atomic_fetch_add_explicit(&b->pool->held, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&b->pool->copies, 1, memory_order_relaxed);
+	return &b->pkt;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+PacketHandle HoldPacket(struct packet_info *info)
+{
+	if(info == NULL)
+		return NULL;
+	return packet_hold((struct packet *)((uint8_t *)info - offsetof(struct packet, info)));
+}
+
+PacketHandle ClonePacket(PacketHandle pkt)
+{
+	struct pkt_buf *b = (pkt != NULL) ? packet_buf(pkt) : NULL;
+	if(b == NULL)
+		return NULL;
+	atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&b->pool->held, 1, memory_order_relaxed);
+	return pkt;
+}
+
+int ReleasePacket(PacketHandle pkt)
+{
+	struct pkt_buf *b = (pkt != NULL) ? packet_buf(pkt) : NULL;
+	if(b == NULL)
+		return -1;
+	atomic_fetch_sub_explicit(&b->pool->held, 1, memory_order_relaxed);
+	pool_put(b);
+	return 0;
+}
+
+int GetPoolStats(struct pool_stats *stats)
+{
+	struct pool_state *st = testbed()->pool;
+	if(stats == NULL || st == NULL || st->bufs == NULL)
+		return -1;
+	stats->buffers = POOL_BUFFERS;
+	stats->buffer_size = sizeof(struct pkt_buf);
+	stats->in_use = atomic_load(&st->in_use);
+	stats->peak = atomic_load(&st->peak);
+	stats->held = atomic_load(&st->held);
+	stats->waits = atomic_load(&st->waits);
+	stats->copies = atomic_load(&st->copies);
+	return 0;
+}
+
+int InitializePool()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct pool_state *st = node->pool;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->wait_lock, NULL);
+		pthread_cond_init(&st->wait_cond, NULL);
+		node->pool = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	int32_t i;
+	if(st == NULL)
+		return -1;
+	if(st->bufs != NULL) // buffers may still be held, keep them
+		return 0;
+	st->bufs = aligned_alloc(CACHE_LINE, POOL_BUFFERS * sizeof(struct pkt_buf));
+	if(st->bufs == NULL)
+		return -1;
+	memset(st->bufs, 0, POOL_BUFFERS * sizeof(struct pkt_buf));
+
+	for(i = 0; i < POOL_BUFFERS; i++) {
+		st->bufs[i].pool = st;
+		st->bufs[i].next = i + 1 < POOL_BUFFERS ? i + 1 : -1;
+	}
+	atomic_store(&st->free_top, 1); // buffer 0, tag 0
+	return 0;
+}
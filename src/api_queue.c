@@ -1,21 +1,78 @@
 /*
 Andre Koka - Created 11/4/2023
-             Last Updated: 11/7/2023
+             Last Updated: 10/19/2026
 
 The basic API file for the MANET Testbed - to implement:
 - RegisterIncomingCallback - queue incoming packets and handle with the given callback functions (control and data planes separated)
 - RegisterOutgoingCallback - queue outgoing packets and handle with the given callback function
 - RegisterForwardCallback - queue forwarded packets and handle with the given callback function
-- InitializeQueue() - run iptables rules to enable ipv4 forwarding and disable ipv6
+- SetQueueScheduling - give each queue thread its own priority, niceness and CPU (control over data)
+- InitializeQueue() - run iptables rules to enable ipv4 forwarding and disable ipv6 on each interface
+
+The iptables rules and nfq_open run in the node's namespace (ns_system and ns_run in api.c), so a
+node created with CreateTestbed gets its own rules and queues without moving the caller's thread.
 */
 
+#define _GNU_SOURCE // sched_setaffinity
+#include <sched.h>
+#include <sys/resource.h> // setpriority
+#include <sys/syscall.h> // gettid
 #include "api.h"
+#include "api_if.h"
 #include "api_queue.h"
+#include "api_dup.h"
+#include "api_lifetime.h"
+#include "api_loop.h"
+#include "api_handoff.h"
+#include "api_pool.h"
 
 // ---------------------- HELPER FUNCTIONS ------------------
 
+// fill in the interfaces and timestamps of a queued packet for the user callback
+static void fill_packet_info(struct nfq_data *nfa, struct packet_info *info)
+{
+	struct timeval tv;
+	memset(info, 0, sizeof(*info));
+	info->in_ifindex = nfq_get_indev(nfa);
+	info->out_ifindex = nfq_get_outdev(nfa);
+
+	// kernel receive time, only set for received packets (rx timestamping is enabled in api_send.c)
+	if(nfq_get_timestamp(nfa, &tv) == 0) {
+		info->rx_time.tv_sec = tv.tv_sec;
+		info->rx_time.tv_nsec = tv.tv_usec * 1000;
+	}
+	clock_gettime(CLOCK_REALTIME, &info->deliver_time); // rx_time to deliver_time is the queueing delay
+}
+
+// allocate the queue state on first use
+static struct queue_state *queue_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct queue_state *st = node->queue;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->sched_lock, NULL);
+		node->queue = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+// run an iptables rule once for each interface (fmt takes the interface name as its %s)
+static void add_if_rule(const char *fmt)
+{
+	struct testbed *node = testbed();
+	char cmd[256];
+	int i, n = if_count();
+	for(i = 0; i < n; i++) {
+		snprintf(cmd, sizeof(cmd), fmt, node->ifaces[i].name);
+		ns_system(cmd);
+	}
+}
+
 int handle_incoming_control(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_data *nfa, void *data)
 {
+	struct queue_state *st = testbed()->queue;
     printf("entering callback: incoming (control)\n");   
 
 	uint32_t id = -1; // id of packet in the queue
@@ -42,16 +99,28 @@ int handle_incoming_control(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, str
     src = iph->saddr; // get packet sender
     dest = iph->daddr; // get packet destination
 
+	// the packet in its receive buffer (so the user can hold it), with its interfaces and kernel timestamps
+	struct packet *pkt = packet_start(p_data, p_length + IP_UDP_HDR_OFFSET);
+	fill_packet_info(nfa, &pkt->info);
+
 	// prevent delivery of own broadcast messages to user-space
-	if(dest == broadcast_ip && src == local_ip)
+	if(is_own_broadcast(src, dest))
+		return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
+
+	// drop flooded duplicates without waking the user callback
+	if(p_length > 0 && dup_filter_packet(p_payload, p_length))
 		return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
 
     printf("the protocol is %d\n", iph->protocol); // protocol check
 	printf("p_data:%p\tsrc:%X\tdest:%X\tp_data+16:%p\tpayload len:%d\n", 
 		p_data, src, dest, p_payload, p_length);
 
+	// hand the packet to the protocol worker instead of calling the user here
+	if(handoff_enabled())
+		return handoff_push(qh, id, QUEUE_IN_CONTROL, pkt);
+
 	// call user function
- 	uint32_t ret = (*incoming_control)(p_data, src, dest, p_payload, p_length);
+ 	uint32_t ret = (*st->incoming_control)(p_data, src, dest, p_payload, p_length, &pkt->info);
 
 	// set verdict
 	if (ret == 0)
@@ -62,6 +131,7 @@ int handle_incoming_control(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, str
 
 int handle_incoming_data(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_data *nfa, void *data)
 {
+	struct queue_state *st = testbed()->queue;
     printf("entering callback: incoming (data)\n");   
 
 	uint32_t id = -1; // id of packet in the queue
@@ -88,16 +158,28 @@ int handle_incoming_data(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct
     src = iph->saddr; // get packet sender
     dest = iph->daddr; // get packet destination
 
+	// the packet in its receive buffer (so the user can hold it), with its interfaces and kernel timestamps
+	struct packet *pkt = packet_start(p_data, p_length + IP_UDP_HDR_OFFSET);
+	fill_packet_info(nfa, &pkt->info);
+
 	// prevent delivery of own broadcast messages to user-space
-	if(dest == broadcast_ip && src == local_ip)
+	if(is_own_broadcast(src, dest))
 		return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
 
     printf("the protocol is %d\n", iph->protocol); // protocol check
 	printf("p_data:%p\tsrc:%X\tdest:%X\tp_data+16:%p\tpayload len:%d\n", 
 		p_data, src, dest, p_payload, p_length);
 
+	// spread heavy data-plane callbacks over the worker pool, in order within each flow
+	if(workers_enabled(QUEUE_IN_DATA))
+		return worker_push(qh, id, QUEUE_IN_DATA, pkt);
+
+	// hand the packet to the protocol worker instead of calling the user here
+	if(handoff_enabled())
+		return handoff_push(qh, id, QUEUE_IN_DATA, pkt);
+
 	// call user function
- 	uint32_t ret = (*incoming_data)(p_data, src, dest, p_payload, p_length);
+ 	uint32_t ret = (*st->incoming_data)(p_data, src, dest, p_payload, p_length, &pkt->info);
 
 	// set verdict
 	if (ret == 0)
@@ -108,6 +190,7 @@ int handle_incoming_data(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct
 
 int handle_outgoing(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_data *nfa, void *data)
 {
+	struct queue_state *st = testbed()->queue;
     printf("entering callback: outgoing\n");   
 
 	uint32_t id = -1; // id of packet in the queue
@@ -134,16 +217,26 @@ int handle_outgoing(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_
     src = iph->saddr; // get packet sender
     dest = iph->daddr; // get packet destination
 
+	// the packet in its receive buffer (so the user can hold it), with its interfaces and kernel timestamps
+	struct packet *pkt = packet_start(p_data, p_length + IP_UDP_HDR_OFFSET);
+	fill_packet_info(nfa, &pkt->info);
+
 	// prevent delivery of own broadcast messages to user-space
-	if(dest == broadcast_ip && src == local_ip)
+	if(is_own_broadcast(src, dest))
 		return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
 
+	lifetime_packet(dest); // traffic keeps the route to dest alive
+
     printf("the protocol is %d\n", iph->protocol); // protocol check
 	printf("p_data:%p\tsrc:%X\tdest:%X\tp_data+16:%p\tpayload len:%d\n", 
 		p_data, src, dest, p_payload, p_length);
 
+	// hand the packet to the protocol worker instead of calling the user here
+	if(handoff_enabled())
+		return handoff_push(qh, id, QUEUE_OUT, pkt);
+
 	// call user function
- 	uint32_t ret = (*outgoing)(p_data, src, dest, p_payload, p_length);
+ 	uint32_t ret = (*st->outgoing)(p_data, src, dest, p_payload, p_length, &pkt->info);
 
 	// set verdict
 	if (ret == 0)
@@ -154,6 +247,7 @@ int handle_outgoing(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_
 
 int handle_forwarded(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq_data *nfa, void *data)
 {
+	struct queue_state *st = testbed()->queue;
     printf("entering callback: forwarded\n");   
 
 	uint32_t id = -1; // id of packet in the queue
@@ -180,12 +274,26 @@ int handle_forwarded(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq
     src = iph->saddr; // get packet sender
     dest = iph->daddr; // get packet destination
 
+	// the packet in its receive buffer (so the user can hold it), with its interfaces and kernel timestamps
+	struct packet *pkt = packet_start(p_data, p_length + IP_UDP_HDR_OFFSET);
+	fill_packet_info(nfa, &pkt->info);
+
+	lifetime_packet(dest); // traffic keeps the route to dest alive
+
     printf("the protocol is %d\n", iph->protocol); // protocol check
 	printf("p_data:%p\tsrc:%X\tdest:%X\tp_data+16:%p\tpayload len:%d\n", 
 		p_data, src, dest, p_payload, p_length);
 
+	// spread heavy data-plane callbacks over the worker pool, in order within each flow
+	if(workers_enabled(QUEUE_FORWARD))
+		return worker_push(qh, id, QUEUE_FORWARD, pkt);
+
+	// hand the packet to the protocol worker instead of calling the user here
+	if(handoff_enabled())
+		return handoff_push(qh, id, QUEUE_FORWARD, pkt);
+
 	// call user function
- 	uint32_t ret = (*forwarded)(p_data, src, dest, p_payload, p_length);
+ 	uint32_t ret = (*st->forwarded)(p_data, src, dest, p_payload, p_length, &pkt->info);
 
 	// set verdict
 	if (ret == 0)
@@ -194,192 +302,201 @@ int handle_forwarded(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg, struct nfq
 		return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
 }
 
-void *thread_func_in_control()
+// nfq_open on a thread in the node's namespace (run with ns_run)
+static int open_handle(void *arg)
 {
-	struct nfq_handle *h;
-	struct nfq_q_handle *qh;
-	char buf[128000] __attribute__ ((aligned));
-	int num_recv = 0;
-	int thread_fd = 0;
+	*(struct nfq_handle **)arg = nfq_open();
+	return 0;
+}
+
+// open one netfilter queue in copy mode, with cb handling its packets
+static struct nfq_handle *open_queue(uint16_t num, nfq_callback *cb, struct nfq_q_handle **qh)
+{
+	struct nfq_handle *h = NULL;
 
 	// open queue
-	printf("open handle to the netfilter_queue - > queue 0 (incoming control)\n");
-	h = nfq_open();
+	printf("open handle to the netfilter_queue - > queue %d\n", num);
+	ns_run(open_handle, &h); // the queue threads are in the namespace already, the event loop's caller is not
 	if (!h) {
 		fprintf(stderr, "cannot open nfq_open()\n");
 		return NULL;
 	}
 
-	//connect the thread for specific socket
-	printf("binding this socket to queue 0 (incoming control)\n");
-	qh = nfq_create_queue(h, 0, &handle_incoming_control, NULL);
-	if (!qh) {
+	//connect the handle to the specific queue
+	printf("binding this socket to queue %d\n", num);
+	*qh = nfq_create_queue(h, num, cb, NULL);
+	if (!*qh) {
 		fprintf(stderr, "error during nfq_create_queue()\n");
+		nfq_close(h);
 		return NULL;
 	}
 
-	uint32_t ql = nfq_set_queue_maxlen(qh, QUEUE_LEN); // set queue length
+	uint32_t ql = nfq_set_queue_maxlen(*qh, QUEUE_LEN); // set queue length
 
-	//set the queue for copy mode (copy whole packet)
-	if (nfq_set_mode(qh, NFQNL_COPY_PACKET, 0xffff) < 0) {
+	//set the queue for copy mode (copy whole packet, up to what fits in a pool buffer)
+	if (nfq_set_mode(*qh, NFQNL_COPY_PACKET, POOL_COPY_RANGE) < 0) {
 		fprintf(stderr, "can't set packet_copy mode\n");
+		nfq_destroy_queue(*qh);
+		nfq_close(h);
 		return NULL;
 	}
+	return h;
+}
 
-	thread_fd = nfq_fd(h); // get file descriptor for this socket
-	while ((num_recv = recv(thread_fd, buf, sizeof(buf), 0)) && num_recv >= 0) {
-		printf("incoming packet received from queue: queue 0\n");
-		nfq_handle_packet(h, buf, num_recv); // callback functions activated here
-	}
-
-	printf("unbinding from queue 0\n");
-	nfq_destroy_queue(qh);
-
-	printf("closing library handle\n");
-	nfq_close(h);
-
-	return NULL;
+static int apply_sched(uint16_t num)
+{
+	struct queue_state *st = testbed()->queue;
+	struct queue_sched *qs = &st->sched[num];
+	pid_t tid = st->tids[num];
+	struct sched_param param;
+	cpu_set_t cpus;
+	int i, r = 0;
+
+	// the scheduler calls take the kernel thread id, so they act on that thread only
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = qs->rt_priority;
+	if(sched_setscheduler(tid, qs->rt_priority ? SCHED_FIFO : SCHED_OTHER, &param) < 0)
+		r = -1;
+	if(qs->rt_priority == 0 && setpriority(PRIO_PROCESS, tid, qs->nice) < 0)
+		r = -1;
+
+	CPU_ZERO(&cpus);
+	if(qs->cpu >= 0)
+		CPU_SET(qs->cpu, &cpus);
+	else
+		for(i = 0; i < sysconf(_SC_NPROCESSORS_CONF) && i < CPU_SETSIZE; i++)
+			CPU_SET(i, &cpus);
+	if(sched_setaffinity(tid, sizeof(cpus), &cpus) < 0)
+		r = -1;
+	return r;
 }
 
-void *thread_func_in_data()
+// pull packets from one queue until its socket fails (body of the queue threads)
+static void run_queue(uint16_t num, nfq_callback *cb)
 {
-	struct nfq_handle *h;
+	struct queue_state *st = testbed()->queue;
 	struct nfq_q_handle *qh;
-	char buf[128000] __attribute__ ((aligned));
+	struct pkt_buf *b;
+	uint8_t tail[POOL_RECV_MAX - POOL_BUFFER_SIZE]; // rest of a recv that does not fit in a pool buffer
 	int num_recv = 0;
 	int thread_fd = 0;
 
-	// open queue
-	printf("open handle to the netfilter_queue - > queue 4 (incoming data)\n");
-	h = nfq_open();
-	if (!h) {
-		fprintf(stderr, "cannot open nfq_open()\n");
-		return NULL;
-	}
-
-	//connect the thread for specific socket
-	printf("binding this socket to queue 4 (incoming data)\n");
-	qh = nfq_create_queue(h, 4, &handle_incoming_data, NULL);
-	if (!qh) {
-		fprintf(stderr, "error during nfq_create_queue (data)()\n");
-		return NULL;
-	}
-
-	uint32_t ql = nfq_set_queue_maxlen(qh, QUEUE_LEN); // set queue length
+	struct nfq_handle *h = open_queue(num, cb, &qh);
+	if (!h)
+		return;
+	pthread_cleanup_push(close_queue, h); // DestroyTestbed stops this thread in recv or pool_get
 
-	//set the queue for copy mode (copy whole packet)
-	if (nfq_set_mode(qh, NFQNL_COPY_PACKET, 0xffff) < 0) {
-		fprintf(stderr, "can't set packet_copy mode\n");
-		return NULL;
-	}
+	pthread_mutex_lock(&st->sched_lock); // record this thread, and apply any SetQueueScheduling already made
+	st->tids[num] = syscall(SYS_gettid);
+	if (st->sched_set[num] && apply_sched(num) < 0)
+		fprintf(stderr, "can't set scheduling of queue %d\n", num);
+	pthread_mutex_unlock(&st->sched_lock);
 
 	thread_fd = nfq_fd(h); // get file descriptor for this socket
-	while ((num_recv = recv(thread_fd, buf, sizeof(buf), 0)) && num_recv >= 0) {
-		printf("incoming packet received from queue: queue 4\n");
-		nfq_handle_packet(h, buf, num_recv); // callback functions activated here
+	while ((b = pool_get(1, num == QUEUE_IN_CONTROL)) != NULL) { // receive into a pool buffer, so packets can be held without a copy
+		wait_begin();
+		num_recv = pool_recv(thread_fd, b, tail, 0);
+		wait_end();
+		if (num_recv < 0 && errno == ENOMEM) { // a big batch could not be copied, its packets are lost
+			pool_put(b);
+			continue;
+		}
+		if (num_recv <= 0) {
+			pool_put(b);
+			break;
+		}
+		printf("packet received from queue: queue %d\n", num);
+		pool_receiving(b);
+		nfq_handle_packet(h, (char *)pool_data(b), num_recv); // callback functions activated here
+		pool_receiving(NULL);
+		pool_put(b); // back to the pool unless a packet in it was held
+		handoff_wake(); // one wake for the whole batch
 	}
 
-	printf("unbinding from queue 4\n");
+	pthread_cleanup_pop(0);
+	pthread_mutex_lock(&st->sched_lock);
+	st->tids[num] = 0;
+	pthread_mutex_unlock(&st->sched_lock);
+
+	printf("unbinding from queue %d\n", num);
 	nfq_destroy_queue(qh);
 
 	printf("closing library handle\n");
 	nfq_close(h);
-
-	return NULL;
 }
 
-void *thread_func_out()
+// cleanup handler of a queue thread stopped by DestroyTestbed
+static void close_queue(void *h)
 {
-	struct nfq_handle *h;
-	struct nfq_q_handle *qh;
-	char buf[128000] __attribute__ ((aligned));
-	int num_recv = 0;
-	int thread_fd = 0;
+	nfq_close(h);
+}
 
-	// open queue
-	printf("open handle to the netfilter_queue - > queue 1 (outgoing)\n");
-	h = nfq_open();
-	if (!h) {
-		fprintf(stderr, "cannot open nfq_open()\n");
-		return NULL;
+static int recv_batch(int fd, struct nfq_handle *h)
+{
+	struct pkt_buf *b = pool_get(0, h == testbed()->queue->control_h); // no waiting here, releases may come from this thread
+	if (b == NULL)
+		return -1; // every buffer is held, the packets wait in the kernel queue
+	uint8_t tail[POOL_RECV_MAX - POOL_BUFFER_SIZE]; // rest of a recv that does not fit in a pool buffer
+	int num_recv = pool_recv(fd, b, tail, MSG_DONTWAIT);
+	if (num_recv > 0) {
+		pool_receiving(b);
+		nfq_handle_packet(h, (char *)pool_data(b), num_recv); // callback functions activated here
+		pool_receiving(NULL);
 	}
+	pool_put(b);
+	return num_recv;
+}
 
-	//connect the thread for specific socket
-	printf("binding this socket to queue 1 (outgoing)\n");
-	qh = nfq_create_queue(h, 1, &handle_outgoing, NULL);
-	if (!qh) {
-		fprintf(stderr, "error during nfq_create_queue()\n");
-		return NULL;
-	}
+// read one batch of packets when the event loop finds a queue readable
+static void loop_queue(int fd, void *arg)
+{
+	struct queue_state *st = testbed()->queue;
+	struct nfq_handle *h = (struct nfq_handle *)arg;
 
-	uint32_t ql = nfq_set_queue_maxlen(qh, QUEUE_LEN); // set queue length
+	// strict priority: every waiting control message is handled before more data
+	if (st->control_h != NULL && h != st->control_h)
+		while (recv_batch(nfq_fd(st->control_h), st->control_h) > 0);
+	recv_batch(fd, h);
+}
 
-	//set the queue for copy mode (copy whole packet)
-	if (nfq_set_mode(qh, NFQNL_COPY_PACKET, 0xffff) < 0) {
-		fprintf(stderr, "can't set packet_copy mode\n");
-		return NULL;
-	}
+// pull packets from a queue with its own thread, or from the event loop if it is on
+static int start_queue(uint16_t num, nfq_callback *cb, pthread_t *thread, void *(*func)())
+{
+	if (!loop_enabled())
+		return start_thread(thread, func);
 
-	
-	thread_fd = nfq_fd(h); //get file descriptor for this socket
-	while ((num_recv = recv(thread_fd, buf, sizeof(buf), 0)) && num_recv >= 0) {
-		printf("outgoing packet received from queue: queue 1\n");
-		nfq_handle_packet(h, buf, num_recv); // callback functions activated here
-	}
+	struct queue_state *st = testbed()->queue;
+	struct nfq_q_handle *qh;
+	struct nfq_handle *h = open_queue(num, cb, &qh);
+	if (!h)
+		return -1;
+	st->loop_h[num] = h; // closed by DestroyTestbed
+	if (num == QUEUE_IN_CONTROL)
+		st->control_h = h;
+	return loop_add(nfq_fd(h), loop_queue, h);
+}
 
-	printf("unbinding from queue 1\n");
-	nfq_destroy_queue(qh);
+void *thread_func_in_control()
+{
+	run_queue(QUEUE_IN_CONTROL, &handle_incoming_control);
+	return NULL;
+}
 
-	printf("closing library handle\n");
-	nfq_close(h);
+void *thread_func_in_data()
+{
+	run_queue(QUEUE_IN_DATA, &handle_incoming_data);
+	return NULL;
+}
 
+void *thread_func_out()
+{
+	run_queue(QUEUE_OUT, &handle_outgoing);
 	return NULL;
 }
 
 void *thread_func_for()
 {
-	struct nfq_handle *h;
-	struct nfq_q_handle *qh;
-	char buf[128000] __attribute__ ((aligned));
-	int num_recv = 0;
-	int thread_fd = 0;
-
-	// open queue
-	printf("open handle to the netfilter_queue - > queue 2 (forward)\n");
-	h = nfq_open();
-	if (!h) {
-		fprintf(stderr, "cannot open nfq_open()\n");
-		return NULL;
-	}
-
-	//connect the thread for specific socket
-	printf("binding this socket to queue 2 (forward)\n");
-	qh = nfq_create_queue(h, 2, &handle_forwarded, NULL);
-	if (!qh) {
-		fprintf(stderr, "error during nfq_create_queue()\n");
-		return NULL;
-	}
-
-	uint32_t ql = nfq_set_queue_maxlen(qh, QUEUE_LEN);	//set queue length
-
-	//set the queue for copy mode (copy whole packet)
-	if (nfq_set_mode(qh, NFQNL_COPY_PACKET, 0xffff) < 0) {
-		fprintf(stderr, "can't set packet_copy mode\n");
-		return NULL;
-	}
-
-	thread_fd = nfq_fd(h); //get file descriptor for this socket
-	while ((num_recv = recv(thread_fd, buf, sizeof(buf), 0)) && num_recv >= 0) {
-		printf("forwarded packet received from queue: queue 2\n");
-		nfq_handle_packet(h, buf, num_recv); // callback functions activated here
-	}
-
-	printf("unbinding from queue 2\n");
-	nfq_destroy_queue(qh);
-
-	printf("closing library handle\n");
-	nfq_close(h);
-
+	run_queue(QUEUE_FORWARD, &handle_forwarded);
 	return NULL;
 }
 
@@ -387,16 +504,20 @@ void *thread_func_for()
 
 uint32_t RegisterIncomingCallback(CallbackFunction control_cb, CallbackFunction data_cb)
 {
-	pthread_mutex_lock(&lock);
+	struct testbed *node = testbed();
+	struct queue_state *st = queue_alloc();
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&node->lock);
 
 	// setup iptables rules (queue incoming control and data plane message separately)
-	system("sudo /sbin/iptables -A INPUT -p UDP --dport 269 -j NFQUEUE --queue-num 0");
-	system("sudo /sbin/iptables -A INPUT -m iprange --dst-range 192.168.1.1-192.168.1.100 -j NFQUEUE --queue-num 4");
+	add_if_rule("sudo /sbin/iptables -A INPUT -i %s -p UDP --dport 269 -j NFQUEUE --queue-num 0");
+	add_if_rule("sudo /sbin/iptables -A INPUT -i %s -m iprange --dst-range 192.168.1.1-192.168.1.100 -j NFQUEUE --queue-num 4");
 
 	if(control_cb != NULL)
 	{
-		incoming_control = control_cb;
-		if(pthread_create(&in_thread_control, NULL, (void *)thread_func_in_control, NULL))
+		st->incoming_control = control_cb;
+		if(start_queue(QUEUE_IN_CONTROL, &handle_incoming_control, &st->in_thread_control, thread_func_in_control))
 		{
 			printf("error creating incoming thread (data)\n");
 			return -1;
@@ -405,67 +526,109 @@ uint32_t RegisterIncomingCallback(CallbackFunction control_cb, CallbackFunction
 
 	if(data_cb != NULL)
 	{
-		incoming_data = data_cb;
-		if(pthread_create(&in_thread_data, NULL, (void *)thread_func_in_data, NULL))
+		st->incoming_data = data_cb;
+		if(start_queue(QUEUE_IN_DATA, &handle_incoming_data, &st->in_thread_data, thread_func_in_data))
 		{
 			printf("error creating incoming thread (data)\n");
 			return -1;
 		}
 	}
 
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&node->lock);
 	return 0;
 }
 
 uint32_t RegisterOutgoingCallback(CallbackFunction cb)
 {
-	pthread_mutex_lock(&lock);
+	struct testbed *node = testbed();
+	struct queue_state *st = queue_alloc();
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&node->lock);
 
 	// setup iptables rules (queue outgoing data plane messages)
-	system("sudo /sbin/iptables -I OUTPUT -p UDP --dport 269 -j ACCEPT");
-	system("sudo /sbin/iptables -A OUTPUT -m iprange --dst-range 192.168.1.1-192.168.1.100 -j NFQUEUE --queue-num 1");
+	add_if_rule("sudo /sbin/iptables -I OUTPUT -o %s -p UDP --dport 269 -j ACCEPT");
+	add_if_rule("sudo /sbin/iptables -A OUTPUT -o %s -m iprange --dst-range 192.168.1.1-192.168.1.100 -j NFQUEUE --queue-num 1");
 
 	if(cb != NULL)
-		outgoing = cb;
+		st->outgoing = cb;
 	else
 		return -1;
-	if(pthread_create(&out_thread, NULL, (void *)thread_func_out, NULL)) // create thread for outgoing queue
+	if(start_queue(QUEUE_OUT, &handle_outgoing, &st->out_thread, thread_func_out)) // create thread for outgoing queue
 	{
 		printf("error creating outgoing thread\n");
 		return -1;
 	}
 
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&node->lock);
 	return 0;
 }
 
 uint32_t RegisterForwardCallback(CallbackFunction cb)
 {
-	pthread_mutex_lock(&lock);
+	struct testbed *node = testbed();
+	struct queue_state *st = queue_alloc();
+	if(st == NULL)
+		return -1;
+	pthread_mutex_lock(&node->lock);
 
 	// setup iptables rules (queue forwarded data plane messages)
-	system("sudo /sbin/iptables -A FORWARD -p UDP --dport 269 -j DROP");
-	system("sudo /sbin/iptables -A FORWARD -j NFQUEUE --queue-num 2");
+	add_if_rule("sudo /sbin/iptables -A FORWARD -i %s -p UDP --dport 269 -j DROP");
+	add_if_rule("sudo /sbin/iptables -A FORWARD -i %s -j NFQUEUE --queue-num 2");
 
 	if(cb != NULL)
-		forwarded = cb;
+		st->forwarded = cb;
 	else
 		return -1;
-	if(pthread_create(&out_thread, NULL, (void *)thread_func_for, NULL)) // create thread for forward queue
+	if(start_queue(QUEUE_FORWARD, &handle_forwarded, &st->forward_thread, thread_func_for)) // create thread for forward queue
 	{
 		printf("error creating forward thread");
 		return -1;
 	}
 
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&node->lock);
 	return 0;
 }
 
+int SetQueueScheduling(uint16_t queue, struct queue_sched *sched)
+{
+	struct queue_state *st;
+	if(sched == NULL || loop_enabled() || queue >= NUM_QUEUES || queue == 3) // 3 is not a testbed queue
+		return -1;
+	if(sched->rt_priority > 99 || sched->nice < -20 || sched->nice > 19 ||
+	   sched->cpu < -1 || sched->cpu >= sysconf(_SC_NPROCESSORS_CONF))
+		return -1;
+
+	if((st = queue_alloc()) == NULL)
+		return -1;
+
+	int r = 0;
+	pthread_mutex_lock(&st->sched_lock);
+	st->sched[queue] = *sched;
+	st->sched_set[queue] = 1;
+	if(st->tids[queue] != 0) // already running
+		r = apply_sched(queue);
+	pthread_mutex_unlock(&st->sched_lock);
+	return r;
+}
+
 int InitializeQueue()
 {
-	incoming_control = incoming_data = outgoing = forwarded = NULL;
-	int r = system("/sbin/iptables -F"); // flush current iptables rules
-	r = system("sh -c 'echo 1 > /proc/sys/net/ipv4/ip_forward'"); // enable ipv4 forwarding
-	r = system("sh -c 'echo 1 > /proc/sys/net/ipv6/conf/wlan0/disable_ipv6'"); // disable ipv6 
+	struct testbed *node = testbed();
+	struct queue_state *st = queue_alloc();
+	if(st == NULL)
+		return -1;
+	st->incoming_control = st->incoming_data = st->outgoing = st->forwarded = NULL;
+	int r = ns_system("/sbin/iptables -F"); // flush current iptables rules
+	r = ns_system("sh -c 'echo 1 > /proc/sys/net/ipv4/ip_forward'"); // enable ipv4 forwarding
+	if(r < 0)
+		return -1;
+
+	char cmd[256];
+	int i, n = if_count();
+	for(i = 0; i < n; i++) { // disable ipv6 on every testbed interface
+		snprintf(cmd, sizeof(cmd), "sh -c 'echo 1 > /proc/sys/net/ipv6/conf/%s/disable_ipv6'", node->ifaces[i].name);
+		r = ns_system(cmd);
+	}
 	return (r < 0) ? -1 : 0;
 }
\ No newline at end of file
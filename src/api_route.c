@@ -1,70 +1,112 @@
 /*
 Andre Koka - Created 9/28/2023
-             Last Updated: 11/7/2023
+             Last Updated: 10/19/2026
 
 The basic API file for the MANET Testbed - to implement:
 - AddUnicastRoutingEntry - modify current routing table with new address (src, dest, gateway, interface)
 - DeleteEntry - remove a route from the routing table given dest, gateway, interface
-- SwitchRoutingTable - change the current routing table to be changed by the API (may not use)
+- ApplyRouteBatch - add and delete many routes with one netlink send, then collect every ACK
+- AddRoute - add a subnet route with a metric and one or more weighted next hops
+- DeleteRoute - remove a route added with AddRoute
+- SwitchRoutingTable - move the API's routes to a numbered table, selected by a policy rule
+- FlushRoutingTable - delete every route in the API's table with one batched netlink send
 
 Adapted from: https://github.com/d0u9/examples/blob/master/C/netlink/gateway_add.c
 */
 
+#include "../manet_testbed.h"
 #include "api.h"
+#include "api_if.h"
 #include "api_route.h"
+#include "api_fib.h"
+#include "api_sync.h"
+#include "api_event.h"
+#include "api_lifetime.h"
 
-// forms and sends netlink message to add route (dest ip, gateway ip, interface)
-static int form_request(struct sockaddr_nl *sa, int domain, uint32_t dest, uint32_t nexthop, uint8_t action)
+// append one attribute to the request, returns a pointer to it
+static struct rtattr *add_attr(struct nlmsghdr *nl, uint16_t type, void *data, uint16_t len)
+{
+	struct rtattr *rta = (struct rtattr*)(((char *)nl) + NLMSG_ALIGN(nl->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	if(len > 0)
+		memcpy(RTA_DATA(rta), data, len);
+	nl->nlmsg_len = NLMSG_ALIGN(nl->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+	return rta;
+}
+
+// forms netlink message to add route (dest subnet, metric, one or more weighted gateways)
+int build_route(struct rt_request *req, int domain, struct route_spec *route, uint8_t action)
 {
+	struct route_state *st = testbed()->route;
 	// intialize request structure
-	struct rt_request req;
-	memset(&req, 0, sizeof(req));
-	int rt_len = sizeof(struct rtmsg); // rolling calculation of rt attribute sizes
-;	int interface = 3; // indicates wlan0
+	memset(req, 0, sizeof(*req));
+	req->nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
 
 	// setup netlink header
-	req.nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_REPLACE | NLM_F_CREATE | NLM_F_ROOT;
-	req.nl.nlmsg_type = action;
+	req->nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_REPLACE | NLM_F_CREATE | NLM_F_ROOT;
+	req->nl.nlmsg_type = action;
 
 	// set up rtmsg header
-	req.rt.rtm_family = domain;
-	req.rt.rtm_table = RT_TABLE_MAIN; // liable to change
-	req.rt.rtm_protocol = RTPROT_STATIC;
-	req.rt.rtm_scope = RT_SCOPE_UNIVERSE;
-	req.rt.rtm_type = RTN_UNICAST;
-	req.rt.rtm_dst_len = 32; // network prefix size is 32 for ipv4
-
-	// set up first attribute (destination address)
-	struct rtattr* rta = (struct rtattr*)(req.buf);
-	rta->rta_type = RTA_DST;
-	rta->rta_len = RTA_LENGTH(sizeof(uint32_t));
-	memcpy(RTA_DATA(rta), &dest, sizeof(dest));
-	rt_len += rta->rta_len;
-	req.nl.nlmsg_len = NLMSG_LENGTH(rt_len);
-
-	// set up second attribute (interface)
-	rta = (struct rtattr *) (((char *)rta) + rta->rta_len);
-  	rta->rta_type = RTA_OIF;
-  	rta->rta_len = RTA_LENGTH(sizeof(int));
-  	memcpy(RTA_DATA(rta), &interface, sizeof(int));
- 	rt_len += rta->rta_len; // now rt_len is size of rt_msg_hdr + all attributes
-	req.nl.nlmsg_len = NLMSG_LENGTH(rt_len);
-
-	// set up third attribute (gateway)
-	rta = (struct rtattr*) (((char *)rta) + rta->rta_len);
-  	rta->rta_type = RTA_GATEWAY;
-  	rta->rta_len = RTA_LENGTH(sizeof(uint32_t));
-  	memcpy(RTA_DATA(rta), &nexthop, sizeof(uint32_t));
- 	rt_len += rta->rta_len; // now rt_len is size of rt_msg_hdr + all attributes
-	req.nl.nlmsg_len = NLMSG_LENGTH(rt_len); // final update of nlmsg length
-
-	// prepare struct msghdr for sending
-	struct iovec iov = { &req, req.nl.nlmsg_len};
-	struct msghdr msg = { sa, sizeof(*sa), &iov, 1, NULL, 0, 0 };
-
-	// send netlink message to kernel
-	int r = sendmsg(fd, &msg, 0);
-	return (r < 0) ? -1 : 0;
+	req->rt.rtm_family = domain;
+	req->rt.rtm_table = (st->route_table < 256) ? st->route_table : RT_TABLE_UNSPEC; // set by SwitchRoutingTable
+	req->rt.rtm_protocol = RTPROT_STATIC;
+	req->rt.rtm_scope = RT_SCOPE_UNIVERSE;
+	req->rt.rtm_type = RTN_UNICAST;
+	req->rt.rtm_dst_len = route->prefix_len; // 32 for a host route
+
+	uint32_t dest = route->dest & ((route->prefix_len == 0) ? 0 : htonl(~0U << (32 - route->prefix_len)));
+	add_attr(&req->nl, RTA_DST, &dest, sizeof(dest));
+	add_attr(&req->nl, RTA_TABLE, &st->route_table, sizeof(st->route_table)); // needed for tables above 255
+	if(route->metric != 0)
+		add_attr(&req->nl, RTA_PRIORITY, &route->metric, sizeof(route->metric));
+	if(route->expires != 0 && action == RTM_NEWROUTE) // kernel deletes the route (seconds)
+		add_attr(&req->nl, RTA_EXPIRES, &route->expires, sizeof(route->expires));
+
+	if(route->num_hops == 1) { // interface and gateway
+		int interface = if_for_addr(route->hops[0].gateway); // radio whose subnet holds the next hop
+		add_attr(&req->nl, RTA_OIF, &interface, sizeof(interface));
+		add_attr(&req->nl, RTA_GATEWAY, &route->hops[0].gateway, sizeof(uint32_t));
+		return req->nl.nlmsg_len;
+	}
+
+	// several next hops, each an rtnexthop followed by its gateway attribute
+	struct rtattr *mp = add_attr(&req->nl, RTA_MULTIPATH, NULL, 0);
+	uint8_t i;
+	for(i = 0; i < route->num_hops; i++) {
+		struct rtnexthop *nh = (struct rtnexthop*)(((char *)&req->nl) + req->nl.nlmsg_len);
+		memset(nh, 0, sizeof(*nh));
+		nh->rtnh_hops = (route->hops[i].weight == 0) ? 0 : route->hops[i].weight - 1; // kernel weight is hops + 1
+		nh->rtnh_ifindex = if_for_addr(route->hops[i].gateway);
+		req->nl.nlmsg_len += RTNH_ALIGN(sizeof(*nh));
+		add_attr(&req->nl, RTA_GATEWAY, &route->hops[i].gateway, sizeof(uint32_t));
+		nh->rtnh_len = ((char *)&req->nl) + req->nl.nlmsg_len - (char *)nh;
+	}
+	mp->rta_len = ((char *)&req->nl) + req->nl.nlmsg_len - (char *)mp;
+
+	return req->nl.nlmsg_len;
+}
+
+// forms netlink message to add a host route (dest ip, gateway ip, interface)
+int build_request(struct rt_request *req, int domain, uint32_t dest, uint32_t nexthop, uint8_t action)
+{
+	struct route_spec route;
+	memset(&route, 0, sizeof(route));
+	route.dest = dest;
+	route.prefix_len = 32; // network prefix size is 32 for ipv4
+	route.num_hops = 1;
+	route.hops[0].gateway = nexthop;
+	return build_route(req, domain, &route, action);
+}
+
+// forms and sends netlink message to add route (dest ip, gateway ip, interface)
+static int form_request(struct sockaddr_nl *sa, int domain, uint32_t dest, uint32_t nexthop, uint8_t action)
+{
+	struct rt_request req;
+	build_request(&req, domain, dest, nexthop, action);
+
+	// send netlink message to kernel, returns its sequence number
+	return nl_send(sa, &req.nl);
 }
 
 // parse reply from kernel over netlink socket
@@ -78,74 +120,506 @@ uint32_t parse_nl_route_msg(void *buf, size_t len)
 	return nl->nlmsg_type;
 }
 
-int AddUnicastRoutingEntry(uint32_t dest_address, uint32_t next_hop)
+// wait for the ACK of a request, returns the kernel's error (0 for success)
+static int get_ack(struct sockaddr_nl *sa, int seq)
 {
-	pthread_mutex_lock(&lock);
-	int len = 0;
+	if(seq < 0)
+		return -errno;
+	char buf[BUFLEN];
+	int len = get_reply(sa, buf, BUFLEN, seq);
+	if(len < 0)
+		return -errno;
+	if(parse_nl_route_msg(buf, len) != NLMSG_ERROR)
+		return 0;
+	struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(buf);
+	return err->error;
+}
+
+// forms and sends netlink message to add or remove the rule that looks up table before main
+static int form_rule(struct sockaddr_nl *sa, uint32_t table, uint16_t action)
+{
+	struct {
+		struct nlmsghdr nl;
+		struct fib_rule_hdr frh;
+		char buf[64];
+	} req;
+	memset(&req, 0, sizeof(req));
+
+	req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct fib_rule_hdr));
+	req.nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	if(action == RTM_NEWRULE)
+		req.nl.nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+	req.nl.nlmsg_type = action;
+
+	req.frh.family = AF_INET;
+	req.frh.action = FR_ACT_TO_TBL;
+	req.frh.table = (table < 256) ? table : RT_TABLE_UNSPEC;
+
+	uint32_t attrs[2][2] = { { FRA_TABLE, table }, { FRA_PRIORITY, ROUTE_RULE_PRIORITY } };
+	int i;
+	for(i = 0; i < 2; i++) {
+		struct rtattr *rta = (struct rtattr*)(((char *)&req) + NLMSG_ALIGN(req.nl.nlmsg_len));
+		rta->rta_type = attrs[i][0];
+		rta->rta_len = RTA_LENGTH(sizeof(uint32_t));
+		memcpy(RTA_DATA(rta), &attrs[i][1], sizeof(uint32_t));
+		req.nl.nlmsg_len = NLMSG_ALIGN(req.nl.nlmsg_len) + RTA_ALIGN(rta->rta_len);
+	}
+
+	int err = get_ack(sa, nl_send(sa, &req.nl));
+	if(err == -EEXIST && action == RTM_NEWRULE) // left behind by an earlier run
+		err = 0;
+	return (err == 0) ? 0 : -1;
+}
+
+// ask the kernel for a route and check whether it kept the expiry it was added with
+static int probe_expiry(struct sockaddr_nl *sa, uint32_t dest)
+{
+	struct rt_request req;
+	memset(&req, 0, sizeof(req));
+	req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	req.nl.nlmsg_flags = NLM_F_REQUEST;
+	req.nl.nlmsg_type = RTM_GETROUTE;
+	req.rt.rtm_family = AF_INET;
+	req.rt.rtm_dst_len = 32;
+	add_attr(&req.nl, RTA_DST, &dest, sizeof(dest));
+
+	int seq = nl_send(sa, &req.nl);
+	if(seq < 0)
+		return 0;
+
+	char buf[BUFLEN];
+	int len = get_reply(sa, buf, BUFLEN, seq);
+	struct nlmsghdr *nl = NULL;
+	int found = 0;
+	for_each_nlmsg(nl, buf, len) {
+		if(nl->nlmsg_type != RTM_NEWROUTE)
+			continue;
+		struct rtattr *rta = NULL;
+		int alen = RTM_PAYLOAD(nl);
+		for_each_rattr(rta, RTM_RTA(NLMSG_DATA(nl)), alen) {
+			if(rta->rta_type == RTA_EXPIRES)
+				found = 1;
+			else if(rta->rta_type == RTA_CACHEINFO && ((struct rta_cacheinfo*)RTA_DATA(rta))->rta_expires != 0)
+				found = 1;
+		}
+	}
+	return found;
+}
+
+// give a route that was just added its expiry, in the kernel or in the lifetime wheel
+static int track_expiry(struct sockaddr_nl *sa, struct route_spec *route)
+{
+	struct route_state *st = testbed()->route;
+	if(st->kernel_expiry < 0)
+		st->kernel_expiry = probe_expiry(sa, route->dest);
+	if(st->kernel_expiry)
+		return lifetime_track(route->dest, route->hops[0].gateway, route->expires * 1000, LIFETIME_KERNEL);
+	if(route->prefix_len == 32 && route->num_hops == 1 && route->metric == 0) // what the wheel deletes
+		return lifetime_track(route->dest, route->hops[0].gateway, route->expires * 1000, LIFETIME_FIXED);
+	return -1;
+}
+
+// send one route change built from a route_spec and wait for its ACK
+static int send_route(struct route_spec *route, uint8_t action)
+{
+	struct route_state *st = testbed()->route;
+	if(route == NULL || route->prefix_len > 32 || route->num_hops == 0 || route->num_hops > MAX_NEXT_HOPS)
+		return -1;
+	int timed = (route->expires != 0 && action == RTM_NEWROUTE);
+	if(timed && st->kernel_expiry == 0 && !(route->prefix_len == 32 && route->num_hops == 1 && route->metric == 0))
+		return -1; // this route could never be expired
 
 	struct sockaddr_nl sa;
 	memset(&sa, 0, sizeof(sa));
-	sa.nl_family = AF_NETLINK; // for now, only ipv4 support
+	sa.nl_family = AF_NETLINK; // only supports ipv4
+
+	struct rt_request req;
+	build_route(&req, AF_INET, route, action);
+	int err = get_ack(&sa, nl_send(&sa, &req.nl));
+
+	if(err == 0 && timed && track_expiry(&sa, route) < 0) { // remove it rather than leave it forever
+		build_route(&req, AF_INET, route, RTM_DELROUTE);
+		get_ack(&sa, nl_send(&sa, &req.nl));
+		err = -1;
+	}
+
+	if(err == 0) { // keep the userspace mirror in sync (it holds the first next hop)
+		if(action == RTM_DELROUTE) {
+			fib_remove(route->dest, route->prefix_len, FIB_ORIGIN_API);
+			sync_forget(route->dest, route->prefix_len, route->metric);
+		}
+		else
+			fib_insert(route->dest, route->prefix_len, route->hops[0].gateway,
+				if_for_addr(route->hops[0].gateway), FIB_ORIGIN_API);
+	}
+
+	return (err == 0) ? 0 : -1;
+}
 
-	len = form_request(&sa, AF_INET, dest_address, next_hop, RTM_NEWROUTE);
-	check(len);
+// build request i of ApplyRouteBatch
+static int build_op(struct rt_request *req, uint32_t i, void *arg)
+{
+	struct route_op *op = &((struct route_op*)arg)[i];
+	return build_request(req, AF_INET, op->dest, op->next_hop,
+		(op->action == ROUTE_DELETE) ? RTM_DELROUTE : RTM_NEWROUTE);
+}
 
-	// after sending, we need to check the result
+// result of request i of ApplyRouteBatch
+static void op_result(uint32_t i, int error, void *arg)
+{
+	struct route_op *op = &((struct route_op*)arg)[i];
+	op->error = error;
+	fib_apply(op);
+}
+
+uint32_t route_batch(uint32_t count, route_builder build, route_result result, void *arg)
+{
+	static __thread char batch[ROUTE_BATCH_BUFLEN]; // one per thread, so no lock is needed
+	uint8_t pending_req[ROUTE_BATCH_MAX]; // requests of the current chunk still waiting for an ACK
 	char buf[BUFLEN];
-	uint32_t nl_msg_type;
-	len = get_msg(&sa, buf, BUFLEN);
-	check(len);
-
-	nl_msg_type = parse_nl_route_msg(buf, len);
-	if (nl_msg_type == NLMSG_ERROR) {
-		struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(buf);
-		switch (err->error) {
-		case 0:
+	struct rt_request req;
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK; // only supports ipv4
+
+	uint32_t done = 0, failed = 0;
+	while(done < count) {
+		// pack as many requests as fit into one buffer, each with its own sequence number
+		uint32_t first = done, base = nl_next_seq(), len = 0;
+		while(done < count && done - first < ROUTE_BATCH_MAX) {
+			int n = (*build)(&req, done, arg);
+			if(len + NLMSG_ALIGN(n) > ROUTE_BATCH_BUFLEN)
+				break;
+			uint32_t seq = (done == first) ? base : (uint32_t)nl_next_seq();
+			if(seq != base + (done - first)) // sequence numbers wrapped, finish the chunk here
+				break;
+			req.nl.nlmsg_seq = seq;
+			memcpy(batch + len, &req, n);
+			len += NLMSG_ALIGN(n);
+			pending_req[done - first] = 1;
+			done++;
+		}
+
+		struct iovec iov = { batch, len };
+		struct msghdr msg = { &sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
+		uint32_t pending = done - first;
+		if(sendmsg(nl_sock(), &msg, 0) < 0) {
+			int err = -errno;
+			for(; pending > 0; pending--)
+				(*result)(done - pending, err, arg);
+			failed += done - first;
+			continue;
+		}
+
+		// collect one ACK per request, matched by sequence number
+		while(pending > 0) {
+			int r = get_msg(&sa, buf, BUFLEN); // several sequence numbers, so not get_reply
+			if(r < 0) { // give up on the rest of this chunk
+				int err = -errno;
+				uint32_t i;
+				for(i = first; i < done; i++) {
+					if(pending_req[i - first]) {
+						(*result)(i, err, arg);
+						failed++;
+					}
+				}
+				break;
+			}
+
+			struct nlmsghdr *nl = NULL;
+			for_each_nlmsg(nl, buf, r) {
+				if(nl->nlmsg_type != NLMSG_ERROR)
+					continue;
+				uint32_t idx = nl->nlmsg_seq - base;
+				if(idx >= done - first || !pending_req[idx])
+					continue; // stale reply from an earlier request
+				struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(nl);
+				pending_req[idx] = 0;
+				if(err->error != 0)
+					failed++;
+				(*result)(first + idx, err->error, arg);
+				pending--;
+			}
+		}
+	}
+
+	return failed;
+}
+
+// table number from a decimal label or a name in /etc/iproute2/rt_tables, 0 if unknown
+static uint32_t table_id(char *label)
+{
+	char *end;
+	unsigned long id = strtoul(label, &end, 10);
+	if(end != label && *end == '\0')
+		return (id > 0 && id < RT_TABLE_MAX) ? id : 0;
+	if(strcmp(label, "main") == 0)
+		return RT_TABLE_MAIN;
+
+	FILE *f = fopen(RT_TABLES_FILE, "r");
+	if(f == NULL)
+		return 0;
+	char line[128], name[64];
+	id = 0;
+	while(fgets(line, sizeof(line), f) != NULL) {
+		unsigned long n;
+		if(line[0] != '#' && sscanf(line, "%lu %63s", &n, name) == 2 && strcmp(name, label) == 0) {
+			id = n;
+			break;
+		}
+	}
+	fclose(f);
+	return id;
+}
+
+// dump the routes of a table into a growing buffer of RTM_NEWROUTE messages
+static char *dump_table(struct sockaddr_nl *sa, uint32_t table, uint32_t *out_len, uint32_t *out_count)
+{
+	struct {
+		struct nlmsghdr nl;
+		struct rtmsg rt;
+	} req;
+	memset(&req, 0, sizeof(req));
+	req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	req.nl.nlmsg_type = RTM_GETROUTE;
+	req.nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.rt.rtm_family = AF_INET;
+
+	int seq = nl_send(sa, &req.nl);
+	if(seq < 0)
+		return NULL;
+
+	char buf[BUFLEN];
+	char *routes = NULL;
+	uint32_t len = 0, size = 0, count = 0;
+	int done = 0, err = 0;
+	while(!done && !err) {
+		int r = get_reply(sa, buf, BUFLEN, seq);
+		if(r < 0) {
+			err = 1;
 			break;
-		default: // any error in nlmsg goes here
-			f_err = 1;
+		}
+
+		struct nlmsghdr *nl = NULL;
+		for_each_nlmsg(nl, buf, r) {
+			if(nl->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if(nl->nlmsg_type == NLMSG_ERROR) {
+				err = 1;
+				break;
+			}
+			struct net_event ev;
+			if(nl->nlmsg_type != RTM_NEWROUTE || parse_route_msg(nl, &ev) < 0 || ev.table != table)
+				continue;
+
+			if(len + NLMSG_ALIGN(nl->nlmsg_len) > size) {
+				size = (size == 0) ? ROUTE_BATCH_BUFLEN : size * 2;
+				char *grown = realloc(routes, size);
+				if(grown == NULL) {
+					err = 1;
+					break;
+				}
+				routes = grown;
+			}
+			memcpy(routes + len, nl, nl->nlmsg_len);
+			len += NLMSG_ALIGN(nl->nlmsg_len);
+			count++;
 		}
 	}
 
-	pthread_mutex_unlock(&lock);
-	return (f_err == 0) ? 0 : -1;
+	if(err) {
+		free(routes);
+		return NULL;
+	}
+	*out_len = len;
+	*out_count = count;
+	return routes;
 }
 
-int DeleteEntry(uint32_t dest_address, uint32_t next_hop)
+int AddUnicastRoutingEntry(uint32_t dest_address, uint32_t next_hop)
 {
-	pthread_mutex_lock(&lock);
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK; // for now, only ipv4 support
+
+	// send on this thread's socket, then check the result
+	int seq = form_request(&sa, AF_INET, dest_address, next_hop, RTM_NEWROUTE);
+	int err = get_ack(&sa, seq);
+
+	if(err == 0) // keep the userspace mirror in sync
+		fib_insert(dest_address, 32, next_hop, if_for_addr(next_hop), FIB_ORIGIN_API);
 
-	int len = 0;
+	return (err == 0) ? 0 : -1;
+}
+
+int DeleteEntry(uint32_t dest_address, uint32_t next_hop)
+{
 	struct sockaddr_nl sa;
 	memset(&sa, 0, sizeof(sa));
 	sa.nl_family = AF_NETLINK; // only supports ipv4
 
-	len = form_request(&sa, AF_INET, dest_address, next_hop, RTM_DELROUTE); // To get ipv6, use AF_INET6 instead
-	check(len);
+	// send on this thread's socket, then check the result
+	int seq = form_request(&sa, AF_INET, dest_address, next_hop, RTM_DELROUTE); // To get ipv6, use AF_INET6 instead
+	int err = get_ack(&sa, seq);
 
-	// after sending, we need to check the result
+	if(err == 0) {
+		fib_remove(dest_address, 32, FIB_ORIGIN_API);
+		sync_forget(dest_address, 32, 0);
+	}
+
+	return (err == 0) ? 0 : -1;
+}
+
+int ApplyRouteBatch(struct route_op *ops, uint32_t count)
+{
+	uint32_t i;
+	for(i = 0; i < count; i++)
+		ops[i].error = ROUTE_PENDING;
+	return (route_batch(count, build_op, op_result, ops) == 0) ? 0 : -1;
+}
+
+int AddRoute(struct route_spec *route)
+{
+	return send_route(route, RTM_NEWROUTE);
+}
+
+int DeleteRoute(struct route_spec *route)
+{
+	return send_route(route, RTM_DELROUTE);
+}
+
+int SwitchRoutingTable(uint8_t *table)
+{
+	struct route_state *st = testbed()->route;
+	if(table == NULL)
+		return -1;
+	uint32_t id = table_id((char *)table);
+	if(id == 0 || id == RT_TABLE_DEFAULT || id == RT_TABLE_LOCAL)
+		return -1;
+
+	pthread_mutex_lock(&st->table_lock);
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	int r = 0;
+	if(id != st->route_table) {
+		if(id != RT_TABLE_MAIN) // main is already looked up by the default rules
+			r = form_rule(&sa, id, RTM_NEWRULE);
+		if(r == 0 && st->route_table != RT_TABLE_MAIN)
+			form_rule(&sa, st->route_table, RTM_DELRULE);
+		if(r == 0) {
+			st->route_table = id;
+			sync_reset(); // the synced routes are in the old table
+		}
+	}
+
+	pthread_mutex_unlock(&st->table_lock);
+	return r;
+}
+
+int FlushRoutingTable()
+{
+	struct route_state *st = testbed()->route;
+	pthread_mutex_lock(&st->table_lock);
+	if(st->route_table == RT_TABLE_MAIN) { // would also remove routes the API does not own
+		pthread_mutex_unlock(&st->table_lock);
+		return -1;
+	}
+
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	uint32_t len = 0, count = 0;
+	char *routes = dump_table(&sa, st->route_table, &len, &count);
+	if(routes == NULL) {
+		pthread_mutex_unlock(&st->table_lock);
+		return -1;
+	}
+
+	// turn the dumped routes into deletes and send them in as few messages as possible
 	char buf[BUFLEN];
-	uint32_t nl_msg_type;
-	len = get_msg(&sa, buf, BUFLEN);
-	check(len);
-
-	nl_msg_type = parse_nl_route_msg(buf, len);
-	if (nl_msg_type == NLMSG_ERROR) {
-		struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(buf);
-		switch (err->error) {
-		case 0: // indicates no error
-			break;
-		default: // any error in nlmsg goes here
-			f_err = 1;
+	uint8_t pending_req[ROUTE_BATCH_MAX]; // deletes of the current chunk still waiting for an ACK
+	struct net_event routes_ev[ROUTE_BATCH_MAX]; // prefix of each delete, removed from the mirror once acked
+	uint32_t off = 0, failed = 0;
+	while(off < len) {
+		uint32_t start = off, base = nl_next_seq(), n = 0;
+		while(off < len && n < ROUTE_BATCH_MAX) {
+			struct nlmsghdr *nl = (struct nlmsghdr*)(routes + off);
+			if(off - start + NLMSG_ALIGN(nl->nlmsg_len) > ROUTE_BATCH_BUFLEN)
+				break;
+			uint32_t seq = (n == 0) ? base : (uint32_t)nl_next_seq();
+			if(seq != base + n) // sequence numbers wrapped, finish the chunk here
+				break;
+			nl->nlmsg_type = RTM_DELROUTE;
+			nl->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+			nl->nlmsg_seq = seq; // acks are matched by seq - base, as in route_batch
+			nl->nlmsg_pid = 0;
+
+			if(parse_route_msg(nl, &routes_ev[n]) != 0)
+				routes_ev[n].prefix_len = 0xff; // not in the mirror
+			pending_req[n] = 1;
+			off += NLMSG_ALIGN(nl->nlmsg_len);
+			n++;
+		}
+
+		struct iovec iov = { routes + start, off - start };
+		struct msghdr msg = { &sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
+		uint32_t pending = n;
+		if(sendmsg(nl_sock(), &msg, 0) < 0) {
+			failed += pending;
+			continue;
+		}
+
+		while(pending > 0) { // one ACK per route
+			int r = get_msg(&sa, buf, BUFLEN);
+			if(r < 0) {
+				failed += pending;
+				break;
+			}
+			struct nlmsghdr *nl = NULL;
+			for_each_nlmsg(nl, buf, r) {
+				if(nl->nlmsg_type != NLMSG_ERROR)
+					continue;
+				uint32_t idx = nl->nlmsg_seq - base;
+				if(idx >= n || !pending_req[idx])
+					continue; // stale reply from an earlier request
+				struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(nl);
+				pending_req[idx] = 0;
+				pending--;
+				if(err->error != 0 && err->error != -ESRCH) { // already gone is fine
+					failed++;
+					continue;
+				}
+				if(routes_ev[idx].prefix_len <= 32) { // the kernel no longer has it
+					fib_remove(routes_ev[idx].address, routes_ev[idx].prefix_len, FIB_ORIGIN_API);
+					sync_forget(routes_ev[idx].address, routes_ev[idx].prefix_len, routes_ev[idx].metric);
+				}
+			}
 		}
 	}
 
-	pthread_mutex_unlock(&lock);
-	return (f_err == 0) ? 0 : -1;
+	free(routes);
+	if(failed == 0) // the synced routes are gone (after a partial flush, deletes were forgotten one by one)
+		sync_reset();
+	pthread_mutex_unlock(&st->table_lock);
+	return (failed == 0) ? 0 : -1;
 }
 
-int InitializeRoute() // currently unused
+int InitializeRoute()
 {
-	//printf("route initialized\n");
-	return 0;
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct route_state *st = node->route;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->table_lock, NULL);
+		st->route_table = RT_TABLE_MAIN;
+		st->kernel_expiry = -1; // not probed yet
+		node->route = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return (st == NULL) ? -1 : 0;
 }
@@ -0,0 +1,281 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SetRateLimit - set the token bucket (rate and burst) of one control message class
+- SendUnicastClass - send a unicast control message through the scheduler
+- SendBroadcastClass - broadcast a control message through the scheduler
+- SendUnicastIf - send a unicast control message on one interface
+- SendBroadcastIf - broadcast a control message on one interface
+- InitializeSched() - allocate the scheduler, set default rate limits and start its thread (unless the event loop is on)
+
+Control messages are sent in priority order (MSG_CLASS_RERR first, MSG_CLASS_DEFAULT
+last) and each class is limited by its own token bucket, so a broadcast storm of
+RREQs cannot starve route errors and replies. In event loop mode the backlog is drained by a
+StartTimer timer that is armed for the next token, so queued messages go out from the loop's thread.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_send.h"
+#include "api_sched.h"
+#include "api_jitter.h"
+#include "api_loop.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// add the tokens earned since the last refill, up to the burst size
+static void refill(struct token_bucket *tb, struct timespec *now)
+{
+	double elapsed = (now->tv_sec - tb->last.tv_sec) + (now->tv_nsec - tb->last.tv_nsec) / 1e9;
+	tb->tokens += elapsed * tb->rate;
+	if(tb->tokens > tb->burst)
+		tb->tokens = tb->burst;
+	tb->last = *now;
+}
+
+// take one token if available (unlimited classes always have one)
+static int take_token(struct token_bucket *tb, struct timespec *now)
+{
+	if(tb->rate == 0)
+		return 1;
+	refill(tb, now);
+	if(tb->tokens < 1)
+		return 0;
+	tb->tokens -= 1;
+	return 1;
+}
+
+static void push_msg(struct token_bucket *tb, struct sched_msg *m)
+{
+	struct sched_state *st = testbed()->sched;
+	if(tb->count == SCHED_BACKLOG_LEN) { // full, drop the oldest message of this class
+		free(tb->backlog[tb->head].buf);
+		tb->head = (tb->head + 1) % SCHED_BACKLOG_LEN;
+		tb->count--;
+		tb->dropped++;
+		st->backlog_total--;
+	}
+	tb->backlog[(tb->head + tb->count) % SCHED_BACKLOG_LEN] = *m;
+	tb->count++;
+	st->backlog_total++;
+}
+
+static void pop_msg(struct token_bucket *tb, struct sched_msg *m)
+{
+	struct sched_state *st = testbed()->sched;
+	*m = tb->backlog[tb->head];
+	tb->head = (tb->head + 1) % SCHED_BACKLOG_LEN;
+	tb->count--;
+	st->backlog_total--;
+}
+
+// pop the highest priority message that has a token, or set wait to the seconds until the next
+// token of a waiting class (called with sched_lock held)
+static int sched_next(struct sched_msg *m, double *wait)
+{
+	struct sched_state *st = testbed()->sched;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*wait = -1;
+	int i;
+	for(i = 0; i < NUM_MSG_CLASSES; i++) {
+		struct token_bucket *tb = &st->buckets[i];
+		if(tb->count == 0)
+			continue;
+		if(take_token(tb, &now)) {
+			pop_msg(tb, m);
+			return 1;
+		}
+		double t = (1 - tb->tokens) / tb->rate;
+		if(*wait < 0 || t < *wait)
+			*wait = t;
+	}
+	return 0;
+}
+
+// arm the drain timer if there is a backlog and it is not armed (event loop mode, sched_lock held)
+static void arm_drain(uint32_t delay)
+{
+	struct sched_state *st = testbed()->sched;
+	if(st->backlog_total == 0 || st->drain_timer >= 0)
+		return;
+	st->drain_timer = StartTimer(delay, 0, sched_drain, NULL);
+}
+
+// timer callback that sends the backlog while tokens last (event loop mode)
+static void sched_drain(void *arg)
+{
+	struct sched_state *st = testbed()->sched;
+	struct sched_msg m;
+	double wait;
+
+	pthread_mutex_lock(&st->sched_lock);
+	st->drain_timer = -1; // one-shot, already released
+	while(sched_next(&m, &wait)) {
+		pthread_mutex_unlock(&st->sched_lock);
+		send_sock_msg(m.dest, m.buf, NULL, m.type, m.size, m.ifindex);
+		free(m.buf);
+		pthread_mutex_lock(&st->sched_lock);
+	}
+	if(wait >= 0) // the timing wheel has 1 ms ticks, round up
+		arm_drain((uint32_t)(wait * 1000) + 1);
+	pthread_mutex_unlock(&st->sched_lock);
+}
+
+int sched_send(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, int type, uint8_t msg_class, int ifindex)
+{
+	struct sched_state *st = testbed()->sched;
+	if(msg_class >= NUM_MSG_CLASSES || msg_buf == NULL)
+		return -1;
+	if(st == NULL) // InitializeSched not called, nothing is rate limited
+		return (send_sock_msg(dest_address, msg_buf, NULL, type, size, ifindex) < 0) ? -1 : 0;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	struct token_bucket *tb = &st->buckets[msg_class];
+
+	pthread_mutex_lock(&st->sched_lock);
+	// fast path: nothing is waiting ahead of this message, send it from the caller's thread
+	if(st->backlog_total == 0 && take_token(tb, &now)) {
+		pthread_mutex_unlock(&st->sched_lock);
+		return (send_sock_msg(dest_address, msg_buf, NULL, type, size, ifindex) < 0) ? -1 : 0;
+	}
+
+	struct sched_msg m = { dest_address, type, ifindex, size, malloc(size) };
+	if(m.buf == NULL) {
+		pthread_mutex_unlock(&st->sched_lock);
+		return -1;
+	}
+	memcpy(m.buf, msg_buf, size);
+	push_msg(tb, &m);
+	if(loop_enabled())
+		arm_drain(0);
+	else
+		pthread_cond_signal(&st->sched_cond);
+	pthread_mutex_unlock(&st->sched_lock);
+	return 0;
+}
+
+void *thread_func_sched()
+{
+	struct sched_state *st = testbed()->sched;
+	struct timespec wake;
+	struct sched_msg m;
+	double wait;
+
+	pthread_mutex_lock(&st->sched_lock);
+	pthread_cleanup_push(unlock_on_cancel, &st->sched_lock);
+	while(1) {
+		wait_begin();
+		while(st->backlog_total == 0)
+			pthread_cond_wait(&st->sched_cond, &st->sched_lock);
+		wait_end();
+
+		if(sched_next(&m, &wait)) { // send outside the lock so new messages can still be queued
+			pthread_mutex_unlock(&st->sched_lock);
+			send_sock_msg(m.dest, m.buf, NULL, m.type, m.size, m.ifindex);
+			free(m.buf);
+			pthread_mutex_lock(&st->sched_lock);
+			continue;
+		}
+
+		// every waiting class is out of tokens, sleep until one refills (or a new message arrives)
+		clock_gettime(CLOCK_MONOTONIC, &wake);
+		wake.tv_sec += (time_t)wait;
+		wake.tv_nsec += (long)((wait - (time_t)wait) * 1e9);
+		if(wake.tv_nsec >= 1000000000) {
+			wake.tv_sec++;
+			wake.tv_nsec -= 1000000000;
+		}
+		wait_begin();
+		pthread_cond_timedwait(&st->sched_cond, &st->sched_lock, &wake);
+		wait_end();
+	}
+
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SetRateLimit(uint8_t msg_class, uint32_t rate, uint32_t burst)
+{
+	struct sched_state *st = testbed()->sched;
+	if(msg_class >= NUM_MSG_CLASSES || st == NULL)
+		return -1;
+
+	pthread_mutex_lock(&st->sched_lock);
+	struct token_bucket *tb = &st->buckets[msg_class];
+	tb->rate = rate;
+	tb->burst = (burst > 0) ? burst : 1;
+	tb->tokens = tb->burst; // start full
+	clock_gettime(CLOCK_MONOTONIC, &tb->last);
+	if(loop_enabled() && st->drain_timer >= 0) // backlog may be sendable now
+		RestartTimer(st->drain_timer, 0);
+	else
+		pthread_cond_signal(&st->sched_cond);
+	pthread_mutex_unlock(&st->sched_lock);
+	return 0;
+}
+
+int SendUnicastClass(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t msg_class)
+{
+	return sched_send(dest_address, msg_buf, size, 0, msg_class, 0);
+}
+
+int SendBroadcastClass(uint8_t *msg_buf, uint32_t size, uint8_t msg_class)
+{
+	return jitter_send(msg_buf, size, msg_class, 0);
+}
+
+int SendUnicastIf(uint32_t ifindex, uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t msg_class)
+{
+	return sched_send(dest_address, msg_buf, size, 0, msg_class, ifindex);
+}
+
+int SendBroadcastIf(uint32_t ifindex, uint8_t *msg_buf, uint32_t size, uint8_t msg_class)
+{
+	return jitter_send(msg_buf, size, msg_class, ifindex);
+}
+
+int InitializeSched()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct sched_state *st = node->sched;
+	if(st != NULL) { // already started
+		pthread_mutex_unlock(&node->state_lock);
+		return 0;
+	}
+	if((st = calloc(1, sizeof(*st))) == NULL) {
+		pthread_mutex_unlock(&node->state_lock);
+		return -1;
+	}
+	pthread_mutex_init(&st->sched_lock, NULL);
+	st->drain_timer = -1;
+	pthread_condattr_t attr; // token refills are timed on the monotonic clock
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&st->sched_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	node->sched = st;
+	pthread_mutex_unlock(&node->state_lock);
+
+	int i;
+	for(i = 0; i < NUM_MSG_CLASSES; i++)
+		SetRateLimit(i, 0, 1); // unlimited by default
+	SetRateLimit(MSG_CLASS_RREQ, RREQ_RATELIMIT, RREQ_RATELIMIT);
+	SetRateLimit(MSG_CLASS_RERR, RERR_RATELIMIT, RERR_RATELIMIT);
+
+	if(loop_enabled()) // the backlog is drained by a timer instead of a thread
+		return 0;
+
+	if(start_thread(&st->sched_thread, thread_func_sched))
+	{
+		printf("error creating scheduler thread\n");
+		return -1;
+	}
+	return 0;
+}
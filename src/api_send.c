@@ -1,53 +1,303 @@
 /*
 Andre Koka - Created 10/8/2023
-             Last Updated: 11/7/2023
+             Last Updated: 10/19/2026
 
 The basic API file for the MANET Testbed - to implement:
 - SendUnicast - send a unicast message using the UDP socket
-- SendBroadcast - broadcast a message using the UDP socket
+- SendBroadcast - broadcast a message on every interface using the UDP sockets
+- SendUnicastTimestamped - send a unicast message now and return its kernel tx timestamp
+- SendBroadcastTimestamped - broadcast a message now and return its kernel tx timestamp
 - InitializeSend() - initialize the global UDP socket 
+
+Timestamped sends are numbered by the kernel (SOF_TIMESTAMPING_OPT_ID), so the timestamp of a
+send is found by its key even when a late timestamp of an earlier send is still queued.
 */
 
+#include "../manet_testbed.h"
 #include "api.h"
+#include "api_if.h"
 #include "api_send.h"
+#include "api_sched.h"
+#include "api_jitter.h"
 
-int send_sock_msg(uint32_t dest_address, uint8_t *msg_buf, uint8_t *header, int type, uint32_t size)
-{   
+// send one message on one socket
+static int send_to(int s, uint32_t address, uint8_t *msg_buf, uint32_t size)
+{
 	// initalize socket address and send
     struct sockaddr_in destination;
     memset(&destination, 0, sizeof(struct sockaddr_in));
     destination.sin_family = AF_INET;
-	if(type) // sending a broadcast msg
-    	inet_pton(AF_INET, ntop(AF_INET, &broadcast_ip), &(destination.sin_addr));
-	else // sending a unicast msg
-		inet_pton(AF_INET, ntop(AF_INET, &dest_address), &(destination.sin_addr));
+	destination.sin_addr.s_addr = address;
+    destination.sin_port = htons(269); // standard port for MANET comms
+
+    return sendto(s, msg_buf, size, 0, (struct sockaddr*) &destination, sizeof(destination));
+}
+
+// read one message from the socket's error queue, returns 1 if it is a tx timestamp (with its
+// key), 0 if it is something else and -1 if the queue is empty
+static int read_tx_timestamp(int s, struct scm_timestamping *ts, uint32_t *key)
+{
+	char data[64];
+	char control[512];
+	struct iovec iov = { data, sizeof(data) };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if(recvmsg(s, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+		return -1;
+
+	int stamped = 0, keyed = 0;
+	struct cmsghdr *cm;
+	for(cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+		if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+			memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+			stamped = 1;
+		}
+		else if(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) {
+			struct sock_extended_err ee;
+			memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+			if(ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+				*key = ee.ee_data; // SOF_TIMESTAMPING_OPT_ID, counts the timestamped sends
+				keyed = 1;
+			}
+		}
+	}
+	return stamped && keyed;
+}
+
+// drop the timestamps left on the error queue by earlier sends (late or never read)
+static void drain_tx_timestamps(int s)
+{
+	struct scm_timestamping ts;
+	uint32_t key;
+	while(read_tx_timestamp(s, &ts, &key) >= 0);
+}
+
+// wait for the tx timestamps of the send with key *key, then set *key to the next send's key.
+// With OPT_TSONLY the software and hardware timestamps are separate messages
+static int get_tx_timestamp(int s, uint32_t *key, int hw, struct timespec *tx_time)
+{
+	struct pollfd pfd = { s, POLLERR, 0 };
+	struct timespec now, end;
+	int found = 0;
+	uint32_t sent = *key;
+	*key = sent + 1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_nsec += TX_TIMESTAMP_TIMEOUT * 1000000L;
+	end.tv_sec += end.tv_nsec / 1000000000L;
+	end.tv_nsec %= 1000000000L;
+
+	while(1) {
+		struct scm_timestamping ts;
+		uint32_t k;
+		int r = read_tx_timestamp(s, &ts, &k);
+		if(r < 0) { // nothing queued yet, the timestamp comes once the packet reaches the driver (or the nic)
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			long left = (end.tv_sec - now.tv_sec) * 1000 + (end.tv_nsec - now.tv_nsec) / 1000000;
+			if(left <= 0 || poll(&pfd, 1, left) <= 0)
+				break;
+			continue;
+		}
+		if(r == 0 || (int32_t)(k - sent) < 0) // not a timestamp, or a late one of an earlier send
+			continue;
+		if(k != sent) { // a send that failed in the kernel still used a key
+			sent = k;
+			*key = k + 1;
+		}
+
+		if(ts.ts[2].tv_sec != 0 || ts.ts[2].tv_nsec != 0) { // raw hardware timestamp, preferred
+			*tx_time = ts.ts[2];
+			return 0;
+		}
+		if(ts.ts[0].tv_sec != 0 || ts.ts[0].tv_nsec != 0) { // software timestamp
+			*tx_time = ts.ts[0];
+			found = 1;
+			if(!hw) // no hardware timestamp will follow
+				return 0;
+		}
+	}
+	return found ? 0 : -1;
+}
+
+// send one message on one socket, asking the kernel for a tx timestamp of this message only
+static int send_to_stamped(int s, uint32_t *key, int hw, uint32_t address, uint8_t *msg_buf, uint32_t size, struct timespec *tx_time)
+{
+	struct send_state *st = testbed()->send;
+    struct sockaddr_in destination;
+    memset(&destination, 0, sizeof(struct sockaddr_in));
+    destination.sin_family = AF_INET;
+	destination.sin_addr.s_addr = address;
     destination.sin_port = htons(269); // standard port for MANET comms
 
-	// send the message
-    int r = sendto(sock, msg_buf, size, 0, (struct sockaddr*) &destination, sizeof(destination));
-    if(r < 0 || f_err != 0)
+	char control[CMSG_SPACE(sizeof(uint32_t))];
+	struct iovec iov = { msg_buf, size };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_name = &destination;
+	msg.msg_namelen = sizeof(destination);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SO_TIMESTAMPING;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+	uint32_t flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE;
+	memcpy(CMSG_DATA(cm), &flags, sizeof(flags));
+
+	memset(tx_time, 0, sizeof(*tx_time));
+	if(st == NULL) // InitializeSend not called
+		return -1;
+	pthread_mutex_lock(&st->ts_lock);
+	drain_tx_timestamps(s);
+	int r = sendmsg(s, &msg, 0);
+	if(r >= 0)
+		get_tx_timestamp(s, key, hw, tx_time);
+	pthread_mutex_unlock(&st->ts_lock);
+	return r;
+}
+
+int send_sock_msg(uint32_t dest_address, uint8_t *msg_buf, uint8_t *header, int type, uint32_t size, int ifindex)
+{   
+	struct testbed *node = testbed();
+	int r = -1;
+	if(ifindex != 0) { // send on one interface only
+		struct testbed_if *iface = if_by_index(ifindex);
+		if(iface == NULL)
+			return -1;
+		r = send_to(iface->sock, type ? if_broadcast(iface) : dest_address, msg_buf, size);
+	}
+	else if(type) { // sending a broadcast msg, flood it on every interface
+		int i, n = if_count();
+		for(i = 0; i < n; i++) { // one interface failing (down, no address) must not stop the others
+			int sent = send_to(node->ifaces[i].sock, if_broadcast(&node->ifaces[i]), msg_buf, size);
+			if(sent >= 0)
+				r = sent;
+		}
+	}
+	else if(node->send != NULL) // sending a unicast msg, the kernel picks the interface from the routing table
+		r = send_to(node->send->sock, dest_address, msg_buf, size);
+
+    if(r < 0 || node->f_err != 0)
 		return -1;
     return r;
 }
 
 int SendUnicast(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, uint8_t *header)
 {
-	int r = send_sock_msg(dest_address, msg_buf, header, 0, size);
-	return (r < 0) ? -1 : 0;
+	// unclassified messages go through the scheduler so they never jump queued route errors
+	return sched_send(dest_address, msg_buf, size, 0, MSG_CLASS_DEFAULT, 0);
 }
 
 int SendBroadcast(uint8_t *msg_buf, uint32_t size, uint8_t *header)
 {
-	int r = send_sock_msg(0, msg_buf, header, 1, size);
+	return jitter_send(msg_buf, size, MSG_CLASS_DEFAULT, 0); // jittered if SetBroadcastJitter was called
+}
+
+// ask the nic to timestamp packets in hardware (most wifi drivers do not support this)
+static int enable_hw_timestamps(int s, char *name)
+{
+	struct hwtstamp_config cfg;
+	struct ifreq ifr;
+	memset(&cfg, 0, sizeof(cfg));
+	memset(&ifr, 0, sizeof(ifr));
+	cfg.tx_type = HWTSTAMP_TX_ON;
+	cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+	strncpy(ifr.ifr_name, name, IF_NAMESIZE - 1);
+	ifr.ifr_data = (void *)&cfg;
+	return (ioctl(s, SIOCSHWTSTAMP, &ifr) == 0); // failure just means software timestamps only
+}
+
+// set the socket options shared by all control sockets
+static int set_sock_opts(int s)
+{
+	int broadcastEnable=1;
+	int ret=setsockopt(s, SOL_SOCKET, SO_BROADCAST, &broadcastEnable, sizeof(broadcastEnable)); // grant broadcast socket permissions
+	if(ret < 0)
+		return -1;
+
+	// mark control traffic so the kernel qdisc (and the air) prefers it over data
+	int priority = CONTROL_SO_PRIORITY;
+	ret = setsockopt(s, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority));
+	if(ret < 0)
+		return -1;
+	int tos = CONTROL_DSCP << 2; // DSCP is the upper 6 bits of the TOS byte
+	ret = setsockopt(s, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+	if(ret < 0)
+		return -1;
+
+	// report software and hardware timestamps. Enabling rx timestamps also makes the kernel
+	// stamp every received packet, which is what nfq_get_timestamp returns for queued packets.
+	// OPT_ID numbers the timestamped sends, so each tx timestamp can be matched to its send
+	int ts_flags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+		| SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_OPT_TSONLY | SOF_TIMESTAMPING_OPT_ID;
+	setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &ts_flags, sizeof(ts_flags)); // not fatal, timestamps are just left at 0
+	return 0;
+}
+
+int open_if_sock(char *name, uint8_t *hw_stamps)
+{
+	int s = ns_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(s < 0)
+		return -1;
+
+	// pin the socket to its radio so broadcasts leave on the right interface
+	if(setsockopt(s, SOL_SOCKET, SO_BINDTODEVICE, name, strlen(name) + 1) < 0 || set_sock_opts(s) < 0) {
+		close(s);
+		return -1;
+	}
+	*hw_stamps = enable_hw_timestamps(s, name);
+	return s;
+}
+
+int SendUnicastTimestamped(uint32_t dest_address, uint8_t *msg_buf, uint32_t size, struct timespec *tx_time)
+{
+	struct send_state *st = testbed()->send;
+	if(tx_time == NULL || st == NULL)
+		return -1;
+	// the kernel picks the interface, wait for a hardware timestamp if any interface has them
+	struct testbed *node = testbed();
+	int i, hw = 0, n = if_count();
+	for(i = 0; i < n; i++)
+		hw |= node->ifaces[i].hw_stamps;
+	int r = send_to_stamped(st->sock, &st->ts_key, hw, dest_address, msg_buf, size, tx_time);
+	return (r < 0) ? -1 : 0;
+}
+
+int SendBroadcastTimestamped(uint32_t ifindex, uint8_t *msg_buf, uint32_t size, struct timespec *tx_time)
+{
+	struct testbed *node = testbed();
+	struct testbed_if *iface = (ifindex == 0) ? &node->ifaces[0] : if_by_index(ifindex);
+	if(tx_time == NULL || iface == NULL || if_count() == 0)
+		return -1;
+	int r = send_to_stamped(iface->sock, &iface->ts_key, iface->hw_stamps, if_broadcast(iface), msg_buf, size, tx_time);
 	return (r < 0) ? -1 : 0;
 }
 
 int InitializeSend()
 {
-	// open dgram socket for udp
-	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-	int broadcastEnable=1;
-	int ret=setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcastEnable, sizeof(broadcastEnable)); // grant broadcast socket permissions
-	
-	return (ret < 0) ? -1 : 0;
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct send_state *st = node->send;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->ts_lock, NULL);
+		st->sock = -1;
+		node->send = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	if(st == NULL)
+		return -1;
+
+	// open dgram socket for unicast udp (not bound to an interface, routed by the kernel)
+	st->sock = ns_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	check(st->sock);
+	check(set_sock_opts(st->sock));
+
+	return (node->f_err != 0) ? -1 : 0;
 }
@@ -0,0 +1,233 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- SyncRoutes - make the kernel hold exactly the routes of a desired table
+
+Link-state protocols (like OLSR) recompute their whole routing table after each topology
+update. SyncRoutes keeps a copy of the routes it installed, compares it with the new table
+(both sorted by destination) and sends only the routes that were added, removed or changed,
+batched into as few netlink messages as possible. Changed next hops are replaced in place,
+so traffic is never left without a route. Routes removed any other way (DeleteRoute, a flush,
+a table switch, expiry, or another program, even while route events were lost) are dropped from the copy, so the next sync puts
+them back. The copy is allocated by the first SyncRoutes call, so nodes that never sync do not
+pay for it.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_if.h"
+#include "api_route.h"
+#include "api_fib.h"
+#include "api_sync.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+int route_cmp(const void *a, const void *b)
+{
+	const struct route_spec *x = a, *y = b;
+	uint32_t dx = ntohl(x->dest), dy = ntohl(y->dest);
+	if(dx != dy)
+		return (dx < dy) ? -1 : 1;
+	return (int)x->prefix_len - (int)y->prefix_len;
+}
+
+// allocate the copy of installed routes on first use
+static struct sync_state *sync_alloc()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct sync_state *st = node->sync;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->sync_lock, NULL);
+		node->sync = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	return st;
+}
+
+static int same_hops(struct route_spec *a, struct route_spec *b)
+{
+	uint8_t i;
+	if(a->num_hops != b->num_hops)
+		return 0;
+	for(i = 0; i < a->num_hops; i++) {
+		uint8_t wa = a->hops[i].weight ? a->hops[i].weight : 1; // 0 and 1 are the same weight
+		uint8_t wb = b->hops[i].weight ? b->hops[i].weight : 1;
+		if(a->hops[i].gateway != b->hops[i].gateway || (a->num_hops > 1 && wa != wb))
+			return 0;
+	}
+	return 1;
+}
+
+static int build_change(struct rt_request *req, uint32_t i, void *arg)
+{
+	struct sync_change *c = &((struct sync_change*)arg)[i];
+	return build_route(req, AF_INET, c->route, c->action);
+}
+
+static void change_result(uint32_t i, int error, void *arg)
+{
+	struct sync_change *c = &((struct sync_change*)arg)[i];
+	c->error = error;
+	if(error != 0)
+		return;
+	if(c->action == RTM_DELROUTE) // keep the userspace mirror in sync
+		fib_remove(c->route->dest, c->route->prefix_len, FIB_ORIGIN_API);
+	else
+		fib_insert(c->route->dest, c->route->prefix_len, c->route->hops[0].gateway,
+			if_for_addr(c->route->hops[0].gateway), FIB_ORIGIN_API);
+}
+
+void sync_forget(uint32_t dest, uint8_t prefix_len, uint32_t metric)
+{
+	struct sync_state *st = testbed()->sync;
+	struct route_spec key;
+	if(st == NULL) // SyncRoutes never called
+		return;
+	memset(&key, 0, sizeof(key));
+	key.dest = dest & ((prefix_len == 0) ? 0 : htonl(~0U << (32 - prefix_len)));
+	key.prefix_len = prefix_len;
+
+	pthread_mutex_lock(&st->sync_lock);
+	struct route_spec *r = bsearch(&key, st->installed, st->num_installed, sizeof(key), route_cmp);
+	if(r != NULL && r->metric == metric) { // the next SyncRoutes installs it again if it is still wanted
+		uint32_t i = r - st->installed;
+		memmove(r, r + 1, (st->num_installed - i - 1) * sizeof(*r));
+		st->num_installed--;
+	}
+	pthread_mutex_unlock(&st->sync_lock);
+}
+
+void sync_resync(struct route_spec *routes, uint32_t count)
+{
+	struct sync_state *st = testbed()->sync;
+	uint32_t i, j = 0, kept = 0;
+	if(st == NULL)
+		return;
+	qsort(routes, count, sizeof(*routes), route_cmp);
+
+	pthread_mutex_lock(&st->sync_lock);
+	for(i = 0; i < st->num_installed; i++) { // both sorted, walk them together
+		struct route_spec *r = &st->installed[i];
+		while(j < count && route_cmp(&routes[j], r) < 0)
+			j++;
+		uint32_t k;
+		for(k = j; k < count && route_cmp(&routes[k], r) == 0; k++) {
+			if(routes[k].metric == r->metric) { // still in the kernel
+				st->installed[kept++] = *r;
+				break;
+			}
+		}
+	}
+	st->num_installed = kept;
+	pthread_mutex_unlock(&st->sync_lock);
+}
+
+void sync_reset()
+{
+	struct sync_state *st = testbed()->sync;
+	if(st == NULL)
+		return;
+	pthread_mutex_lock(&st->sync_lock);
+	st->num_installed = 0;
+	pthread_mutex_unlock(&st->sync_lock);
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int SyncRoutes(struct route_spec *routes, uint32_t count)
+{
+	struct sync_state *st = testbed()->sync;
+	if(count > SYNC_MAX_ROUTES || (routes == NULL && count > 0))
+		return -1;
+	if(st == NULL && (st = sync_alloc()) == NULL)
+		return -1;
+
+	// sorted copy of the desired table, with host bits cleared
+	struct route_spec *desired = malloc((count ? count : 1) * sizeof(*desired));
+	struct sync_entry *entries = malloc((count + SYNC_MAX_ROUTES + 1) * sizeof(*entries));
+	struct sync_change *changes = malloc((2 * count + SYNC_MAX_ROUTES + 1) * sizeof(*changes));
+	if(desired == NULL || entries == NULL || changes == NULL) {
+		free(desired);
+		free(entries);
+		free(changes);
+		return -1;
+	}
+
+	uint32_t i, j, n = 0;
+	for(i = 0; i < count; i++) {
+		if(routes[i].prefix_len > 32 || routes[i].num_hops == 0 || routes[i].num_hops > MAX_NEXT_HOPS)
+			continue; // not a valid route, left out of the table
+		desired[n] = routes[i];
+		desired[n].dest &= (desired[n].prefix_len == 0) ? 0 : htonl(~0U << (32 - desired[n].prefix_len));
+		desired[n].expires = 0;
+		n++;
+	}
+	qsort(desired, n, sizeof(*desired), route_cmp);
+
+	pthread_mutex_lock(&st->sync_lock);
+
+	// walk both sorted tables once, pairing up routes to the same destination
+	uint32_t num_entries = 0;
+	i = j = 0;
+	while(i < st->num_installed || j < n) {
+		if(j > 0 && j < n && route_cmp(&desired[j], &desired[j - 1]) == 0) {
+			j++; // duplicate destination, the first one wins
+			continue;
+		}
+		int c = (i == st->num_installed) ? 1 : (j == n) ? -1 : route_cmp(&st->installed[i], &desired[j]);
+		struct sync_entry *e = &entries[num_entries++];
+		e->old = (c <= 0) ? &st->installed[i++] : NULL;
+		e->new = (c >= 0) ? &desired[j++] : NULL;
+		e->del = e->add = -1;
+	}
+
+	// deletes go first, so a route whose metric changed is never installed twice
+	uint32_t num_changes = 0;
+	for(i = 0; i < num_entries; i++) {
+		struct sync_entry *e = &entries[i];
+		if(e->old != NULL && (e->new == NULL || e->new->metric != e->old->metric)) {
+			changes[num_changes] = (struct sync_change){ e->old, RTM_DELROUTE, 0 };
+			e->del = num_changes++;
+		}
+	}
+	for(i = 0; i < num_entries; i++) {
+		struct sync_entry *e = &entries[i];
+		if(e->new != NULL && (e->del >= 0 || e->old == NULL || !same_hops(e->old, e->new))) {
+			changes[num_changes] = (struct sync_change){ e->new, RTM_NEWROUTE, 0 };
+			e->add = num_changes++;
+		}
+	}
+
+	uint32_t failed = 0;
+	if(num_changes > 0)
+		failed = route_batch(num_changes, build_change, change_result, changes);
+
+	// record what is installed now, keeping the old route wherever a change failed
+	struct route_spec *now = malloc((num_entries ? num_entries : 1) * sizeof(*now));
+	uint32_t num_now = 0;
+	for(i = 0; now != NULL && i < num_entries && num_now < SYNC_MAX_ROUTES; i++) {
+		struct sync_entry *e = &entries[i];
+		if(e->add >= 0 && changes[e->add].error == 0)
+			now[num_now++] = *e->new;
+		else if(e->add < 0 && e->del < 0) // unchanged
+			now[num_now++] = *e->old;
+		else if(e->del >= 0 && changes[e->del].error != 0 && changes[e->del].error != -ESRCH)
+			now[num_now++] = *e->old; // could not be removed
+		else if(e->del < 0 && e->old != NULL) // replace failed, the old route is still there
+			now[num_now++] = *e->old;
+	}
+	if(now != NULL) {
+		memcpy(st->installed, now, num_now * sizeof(*now));
+		st->num_installed = num_now;
+	}
+
+	pthread_mutex_unlock(&st->sync_lock);
+	free(now);
+	free(desired);
+	free(entries);
+	free(changes);
+	return (failed == 0 && now != NULL) ? 0 : -1;
+}
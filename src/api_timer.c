@@ -0,0 +1,365 @@
+/*
+Andre Koka - Created 10/19/2026
+             Last Updated: 10/19/2026
+
+The basic API file for the MANET Testbed - to implement:
+- StartTimer - start a one-shot or periodic protocol timer (HELLO interval, hold time, RREQ retry)
+- StopTimer - stop a timer
+- RestartTimer - move the expiry of a timer (for example a neighbour hold time refreshed by a HELLO)
+- InitializeTimer() - allocate and clear the timers and start the timer thread (or join the event loop)
+
+Timers live in a hierarchical timing wheel with 1 ms ticks, so starting, stopping and
+restarting a timer is O(1) no matter how many are active. A single timerfd is set to the next
+tick that has timers, so the wheel costs nothing while it is idle. Callbacks run on the timer
+thread, or on the event loop's thread if SetEventLoopMode selected one.
+*/
+
+#include "../manet_testbed.h"
+#include "api.h"
+#include "api_loop.h"
+#include "api_timer.h"
+
+// ---------------------- HELPER FUNCTIONS ------------------
+
+// ms since start
+static uint64_t timer_now()
+{
+	struct timer_state *st = testbed()->timer;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t ns = (int64_t)(now.tv_sec - st->start.tv_sec) * 1000000000 + (now.tv_nsec - st->start.tv_nsec);
+	return ns / 1000000;
+}
+
+// tick a timer started now expires at (rounded up, so it never fires early)
+static uint64_t timer_expiry(uint32_t delay)
+{
+	return timer_now() + delay + 1;
+}
+
+// id of timer i, with its generation so a reused timer is not stopped by an old id
+static int timer_id(int32_t i)
+{
+	struct timer_state *st = testbed()->timer;
+	return ((st->timers[i].gen & 0x3fff) << TIMER_INDEX_BITS) | i;
+}
+
+// timer of an id, or -1 if the id is stale
+static int32_t timer_index(int id)
+{
+	struct timer_state *st = testbed()->timer;
+	int32_t i = id & (TIMER_MAX - 1);
+	if(id < 0 || st->timers == NULL || !st->timers[i].used || timer_id(i) != id)
+		return -1;
+	return i;
+}
+
+static void timer_unlink(int32_t i)
+{
+	struct timer_state *st = testbed()->timer;
+	struct wheel_timer *t = &st->timers[i];
+	if(t->slot == &st->due && t->wnext < 0)
+		st->due_tail = t->wprev;
+	if(t->wprev >= 0)
+		st->timers[t->wprev].wnext = t->wnext;
+	else
+		*t->slot = t->wnext;
+	if(t->wnext >= 0)
+		st->timers[t->wnext].wprev = t->wprev;
+	t->slot = NULL;
+}
+
+static void timer_insert(int32_t i)
+{
+	struct timer_state *st = testbed()->timer;
+	struct wheel_timer *t = &st->timers[i];
+	t->wprev = -1;
+	t->wnext = -1;
+
+	if(t->expires <= st->cur_tick) { // already due, run after the timers that fired before it
+		t->slot = &st->due;
+		t->wprev = st->due_tail;
+		if(st->due_tail >= 0)
+			st->timers[st->due_tail].wnext = i;
+		else
+			st->due = i;
+		st->due_tail = i;
+		return;
+	}
+
+	uint64_t due = t->expires;
+	if(due - st->cur_tick >= TIMER_SPAN) // too far out, revisit at the edge of the wheel
+		due = st->cur_tick + TIMER_SPAN - 1;
+
+	uint64_t delta = due - st->cur_tick;
+	if(delta < TIMER_WHEEL0_SIZE) {
+		t->slot = &st->wheel0[due & (TIMER_WHEEL0_SIZE - 1)];
+	}
+	else {
+		int level = 0;
+		uint32_t shift = TIMER_WHEEL0_BITS;
+		while(level < TIMER_LEVELS - 1 && delta >= ((uint64_t)1 << (shift + TIMER_WHEELN_BITS))) {
+			level++;
+			shift += TIMER_WHEELN_BITS;
+		}
+		t->slot = &st->wheeln[level][(due >> shift) & (TIMER_WHEELN_SIZE - 1)];
+	}
+
+	t->wnext = *t->slot;
+	if(t->wnext >= 0)
+		st->timers[t->wnext].wprev = i;
+	*t->slot = i;
+}
+
+static void free_timer(int32_t i)
+{
+	struct timer_state *st = testbed()->timer;
+	st->timers[i].used = 0;
+	st->timers[i].gen++;
+	st->timers[i].wnext = st->free_list;
+	st->free_list = i;
+	st->active--;
+}
+
+// empty one wheel slot, moving each timer to the due list or a lower level
+static void run_slot(int32_t *slot)
+{
+	struct timer_state *st = testbed()->timer;
+	int32_t i = *slot;
+	*slot = -1;
+	while(i >= 0) {
+		int32_t next = st->timers[i].wnext;
+		timer_insert(i);
+		i = next;
+	}
+}
+
+// advance the wheel one tick, cascading the higher levels at the start of their turns
+static void tick()
+{
+	struct timer_state *st = testbed()->timer;
+	st->cur_tick++;
+
+	int level;
+	uint32_t shift = TIMER_WHEEL0_BITS;
+	for(level = 0; level < TIMER_LEVELS; level++) {
+		if(st->cur_tick & (((uint64_t)1 << shift) - 1))
+			break;
+		shift += TIMER_WHEELN_BITS;
+	}
+	// cascade from the highest level whose turn started, down to level 1
+	while(level > 0) {
+		level--;
+		shift -= TIMER_WHEELN_BITS;
+		run_slot(&st->wheeln[level][(st->cur_tick >> shift) & (TIMER_WHEELN_SIZE - 1)]);
+	}
+	run_slot(&st->wheel0[st->cur_tick & (TIMER_WHEEL0_SIZE - 1)]);
+}
+
+static void arm_wheel()
+{
+	struct timer_state *st = testbed()->timer;
+	uint64_t next = 0;
+	if(st->due >= 0) { // started already due, run at the next tick
+		next = st->cur_tick + 1;
+	}
+	else if(st->active > 0) { // first level 0 slot with timers, or the next cascade
+		uint64_t turn = (st->cur_tick | (TIMER_WHEEL0_SIZE - 1)) + 1;
+		for(next = st->cur_tick + 1; next < turn; next++) {
+			if(st->wheel0[next & (TIMER_WHEEL0_SIZE - 1)] >= 0)
+				break;
+		}
+	}
+	if(next == st->armed_tick)
+		return;
+
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	if(next != 0) {
+		its.it_value.tv_sec = st->start.tv_sec + next / 1000;
+		its.it_value.tv_nsec = st->start.tv_nsec + (next % 1000) * 1000000;
+		if(its.it_value.tv_nsec >= 1000000000) {
+			its.it_value.tv_sec++;
+			its.it_value.tv_nsec -= 1000000000;
+		}
+	}
+	timerfd_settime(st->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	st->armed_tick = next;
+}
+
+void run_timers()
+{
+	struct timer_state *st = testbed()->timer;
+	pthread_mutex_lock(&st->timer_lock);
+	uint64_t target = timer_now();
+	if(st->active == 0 && st->cur_tick < target) // empty wheel, skip the idle ticks
+		st->cur_tick = target;
+	while(st->cur_tick < target) // catch up on every tick since the last run
+		tick();
+
+	// one callback at a time, so a callback can stop timers that are due after it
+	while(st->due >= 0) {
+		int32_t i = st->due;
+		struct wheel_timer *t = &st->timers[i];
+		TimerCallback cb = t->cb;
+		void *arg = t->arg;
+		timer_unlink(i);
+		if(t->interval != 0) { // periodic, keep the phase unless it fell behind
+			t->expires += t->interval;
+			if(t->expires <= st->cur_tick)
+				t->expires = st->cur_tick + t->interval;
+			timer_insert(i);
+		}
+		else {
+			free_timer(i);
+		}
+
+		pthread_mutex_unlock(&st->timer_lock);
+		(*cb)(arg);
+		pthread_mutex_lock(&st->timer_lock);
+	}
+	st->armed_tick = 0; // the timerfd fired
+	arm_wheel();
+	pthread_mutex_unlock(&st->timer_lock);
+}
+
+// run the timers when the event loop finds the timerfd readable
+static void loop_timers(int fd, void *arg)
+{
+	uint64_t expirations;
+	if(read(fd, &expirations, sizeof(expirations)) > 0)
+		run_timers();
+}
+
+void *thread_func_timer()
+{
+	struct timer_state *st = testbed()->timer;
+	uint64_t expirations;
+	while(1) {
+		wait_begin();
+		ssize_t r = read(st->timer_fd, &expirations, sizeof(expirations));
+		wait_end();
+		if(r <= 0 && errno != EINTR)
+			break;
+		run_timers();
+	}
+	return NULL;
+}
+
+// ---------------------- API FUNCTIONS ------------------
+
+int StartTimer(uint32_t delay, uint32_t interval, TimerCallback cb, void *arg)
+{
+	struct timer_state *st = testbed()->timer;
+	if(cb == NULL || st == NULL || st->timers == NULL)
+		return -1;
+
+	pthread_mutex_lock(&st->timer_lock);
+	int32_t i = st->free_list;
+	if(i < 0) {
+		pthread_mutex_unlock(&st->timer_lock);
+		return -1;
+	}
+	st->free_list = st->timers[i].wnext;
+	if(st->active++ == 0) // empty wheel, skip the idle ticks so run_timers has none to catch up on
+		st->cur_tick = timer_now();
+
+	struct wheel_timer *t = &st->timers[i];
+	t->used = 1;
+	t->cb = cb;
+	t->arg = arg;
+	t->interval = interval;
+	t->expires = timer_expiry(delay);
+	timer_insert(i);
+	if(st->armed_tick == 0 || t->expires < st->armed_tick) // fires before the timerfd would
+		arm_wheel();
+	int id = timer_id(i);
+	pthread_mutex_unlock(&st->timer_lock);
+	return id;
+}
+
+int StopTimer(int id)
+{
+	struct timer_state *st = testbed()->timer;
+	if(st == NULL || st->timers == NULL)
+		return -1;
+	pthread_mutex_lock(&st->timer_lock);
+	int32_t i = timer_index(id);
+	if(i >= 0) {
+		timer_unlink(i);
+		free_timer(i);
+	}
+	pthread_mutex_unlock(&st->timer_lock);
+	return (i >= 0) ? 0 : -1;
+}
+
+int RestartTimer(int id, uint32_t delay)
+{
+	struct timer_state *st = testbed()->timer;
+	if(st == NULL || st->timers == NULL)
+		return -1;
+	pthread_mutex_lock(&st->timer_lock);
+	int32_t i = timer_index(id);
+	if(i >= 0) {
+		timer_unlink(i);
+		st->timers[i].expires = timer_expiry(delay);
+		timer_insert(i);
+		if(st->armed_tick == 0 || st->timers[i].expires < st->armed_tick)
+			arm_wheel();
+	}
+	pthread_mutex_unlock(&st->timer_lock);
+	return (i >= 0) ? 0 : -1;
+}
+
+int InitializeTimer()
+{
+	struct testbed *node = testbed();
+	pthread_mutex_lock(&node->state_lock);
+	struct timer_state *st = node->timer;
+	if(st == NULL && (st = calloc(1, sizeof(*st))) != NULL) {
+		pthread_mutex_init(&st->timer_lock, NULL);
+		st->timer_fd = -1;
+		node->timer = st;
+	}
+	pthread_mutex_unlock(&node->state_lock);
+	if(st == NULL)
+		return -1;
+
+	int32_t i;
+	pthread_mutex_lock(&st->timer_lock);
+	if(st->timers == NULL)
+		st->timers = calloc(TIMER_MAX, sizeof(struct wheel_timer));
+	if(st->timers == NULL) {
+		pthread_mutex_unlock(&st->timer_lock);
+		return -1;
+	}
+	for(i = 0; i < TIMER_WHEEL0_SIZE; i++)
+		st->wheel0[i] = -1;
+	memset(st->wheeln, 0xff, sizeof(st->wheeln)); // every slot -1
+	st->due = st->due_tail = -1;
+	st->free_list = -1;
+	for(i = TIMER_MAX - 1; i >= 0; i--) {
+		st->timers[i].used = 0;
+		st->timers[i].wnext = st->free_list;
+		st->free_list = i;
+	}
+	st->active = 0;
+	st->cur_tick = 0;
+	st->armed_tick = 0;
+	clock_gettime(CLOCK_MONOTONIC, &st->start);
+	pthread_mutex_unlock(&st->timer_lock);
+
+	st->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(st->timer_fd < 0)
+		return -1;
+
+	if(loop_enabled()) // run the callbacks on the event loop's thread
+		return loop_add(st->timer_fd, loop_timers, NULL);
+
+	if(start_thread(&st->timer_thread, thread_func_timer))
+	{
+		printf("error creating timer thread\n");
+		return -1;
+	}
+	return 0;
+}
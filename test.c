@@ -9,15 +9,15 @@ char *ntop(int domain, void *buf) // convert ip to string
 	return ip;
 }
 
-int in(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length)
+uint8_t in(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info)
 {
 	printf("incoming!!");
 }
-int in2(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length)
+uint8_t in2(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info)
 {
 	printf("incoming!! 2");
 }
-int out(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length)
+uint8_t out(uint8_t *raw_pack, uint32_t src, uint32_t dest, uint8_t *payload, uint32_t payload_length, struct packet_info *info)
 {
 	printf("outgoing happening\n");
 	//printf("src:%d\tdest:%d\tpay %d\n")